@@ -0,0 +1,140 @@
+/** @file Arena.h
+ * Bump allocator for storage that is all released at once.
+ *
+ * Memory is handed out sequentially from large chunks, and reset()
+ * makes all of it available again without returning the chunks to
+ * the system, so a structure rebuilt every step (such as the tree)
+ * reuses the same memory instead of going through malloc for each of
+ * its blocks.  No destructors are run: an object placed in an Arena
+ * whose destructor has an effect must have it called explicitly
+ * before the Arena is reset.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <new>
+#include <vector>
+
+class Arena {
+    /// Chunks in the order they are used, with their sizes.
+    std::vector<char *> chunks;
+    std::vector<size_t> sizes;
+    size_t iChunk;		///< chunk being allocated from
+    size_t offset;		///< first free byte in it
+    size_t szChunk;		///< size of new chunks
+
+ public:
+    Arena(size_t _szChunk = 1 << 20)
+        : iChunk(0), offset(0), szChunk(_szChunk) {}
+    ~Arena() { release(); }
+
+    /// @brief Uninitialized storage for n objects of type T.
+    template <class T> T *alloc(size_t n) {
+        return (T *) allocBytes(n*sizeof(T));
+    }
+
+    /// @brief Uninitialized, suitably aligned storage of size bytes.
+    void *allocBytes(size_t size) {
+        const size_t align = 16;
+        size = (size + align - 1) & ~(align - 1);
+        while(iChunk < chunks.size() && offset + size > sizes[iChunk]) {
+            iChunk++;
+            offset = 0;
+        }
+        if(iChunk == chunks.size()) {
+            size_t sz = (size > szChunk ? size : szChunk);
+            chunks.push_back(new char[sz]);
+            sizes.push_back(sz);
+            offset = 0;
+        }
+        void *p = chunks[iChunk] + offset;
+        offset += size;
+        return p;
+    }
+
+    /// @brief Release everything allocated, keeping the chunks.
+    void reset() {
+        iChunk = 0;
+        offset = 0;
+    }
+
+    /// @brief Release everything allocated and return the chunks to
+    /// the system.
+    void release() {
+        for(size_t i = 0; i < chunks.size(); i++)
+            delete [] chunks[i];
+        chunks.clear();
+        sizes.clear();
+        iChunk = 0;
+        offset = 0;
+    }
+
+    /// @brief Bytes held by the arena.
+    size_t capacity() const {
+        size_t n = 0;
+        for(size_t i = 0; i < sizes.size(); i++)
+            n += sizes[i];
+        return n;
+    }
+};
+
+/// @brief Growable array whose storage comes from an Arena, with the
+/// part of the CkVec interface used by the tree walks.
+///
+/// Growing copies the elements to a larger block and leaves the old
+/// one in the arena, so the storage of a list is only given back when
+/// the arena is reset.  No destructors are run on the elements.
+template <class T>
+class ArenaList {
+    T *block;
+    size_t blklen;		///< elements allocated in block
+    size_t len;			///< elements in use
+    Arena *arena;
+
+    // Copies would share the block.
+    ArenaList(const ArenaList &);
+    ArenaList &operator=(const ArenaList &);
+
+ public:
+    ArenaList(Arena *_arena = NULL)
+        : block(NULL), blklen(0), len(0), arena(_arena) {}
+    void setArena(Arena *_arena) { arena = _arena; }
+
+    size_t &length() { return len; }
+    size_t length() const { return len; }
+    size_t size() const { return len; }
+    T &operator[](size_t i) { return block[i]; }
+    const T &operator[](size_t i) const { return block[i]; }
+    T *getVec() { return block; }
+
+    void reserve(size_t n) {
+        if(n <= blklen) return;
+        T *b = arena->alloc<T>(n);
+        for(size_t i = 0; i < len; i++)
+            new (&b[i]) T(block[i]);
+        block = b;
+        blklen = n;
+    }
+    void resize(size_t n) {
+        reserve(n);
+        len = n;
+    }
+    void push_back(const T &elt) {
+        if(len == blklen)
+            reserve(blklen < 8 ? 16 : 2*blklen);
+        new (&block[len++]) T(elt);
+    }
+    void insertAtEnd(const T &elt) { push_back(elt); }
+    /// @brief Empty the list, keeping its storage.
+    void clear() { len = 0; }
+    /// @brief Empty the list and drop its storage, which stays in
+    /// the arena until it is reset.
+    void free() {
+        block = NULL;
+        blklen = len = 0;
+    }
+};
+
+#endif
@@ -4,10 +4,13 @@
 ///
 #include "CacheInterface.h"
 #include "ParallelGravity.h"
+#include "DataManager.h"
 #include "Opt.h"
 #include "smooth.h"
 #include "Compute.h"
 #include "TreeWalk.h"
+#include <math.h>
+#include <new>
 
 static const int PAD_reply = sizeof(NodeKey);  // Assume this is bigger
                                            // than a pointer
@@ -16,6 +19,25 @@ EntryTypeGravityParticle::EntryTypeGravityParticle() {
   CkCacheFillMsg<KeyType> msg(0);
 }
 
+/// @param key Key of the filled node or bucket
+/// @param iChunk chunk of cache
+/// @param nBytes size of the fill message
+void CacheStats::filled(KeyType key, int iChunk, int nBytes) {
+  int64_t *c = chunk(iChunk);
+  c[iBytes] += nBytes;
+  Tree::NodeKeyTable<double>::iterator it = fillStart.find(key);
+  if (it == fillStart.end())
+    return;
+  double usec = (CmiWallTimer() - it->second)*1e6;
+  int bin = 0;
+  while (usec >= 2.0 && bin < nLatencyBins - 1) {
+    usec *= 0.5;
+    bin++;
+  }
+  c[iLatency + bin]++;
+  fillStart.erase(it);
+}
+
 /// @param idx Index of the TreePiece
 /// @param key Key of the requested bucket.
 ///
@@ -27,6 +49,7 @@ void * EntryTypeGravityParticle::request(CkArrayIndexMax& idx, KeyType key) {
   *(int*)CkPriorityPtr(msg) = -100000000;
   CkSetQueueing(msg, CK_QUEUEING_IFIFO);
   treeProxy[*idx.data()].fillRequestParticles(msg);
+  stats.fetched(key);
   return NULL;
 }
 
@@ -35,6 +58,16 @@ void * EntryTypeGravityParticle::request(CkArrayIndexMax& idx, KeyType key) {
 /// @param from Index of TreePiece which supplied the data
 /// @return pointer to cached data
 void * EntryTypeGravityParticle::unpack(CkCacheFillMsg<KeyType> *msg, int chunk, CkArrayIndexMax &from) {
+  stats.filled(msg->key, chunk, UsrToEnv(msg)->getTotalsize());
+  if(bCompactFill) {
+    // Expand into the layout of a full fill, which is cached.
+    CompactParticleFill *in = (CompactParticleFill *) msg->data;
+    int total = sizeof(CacheParticle) + (in->end - in->begin) * sizeof(ExternalGravityParticle);
+    CkCacheFillMsg<KeyType> *full = new (total) CkCacheFillMsg<KeyType>(msg->key);
+    in->unpack((CacheParticle *) full->data);
+    CkFreeMsg(msg);
+    msg = full;
+  }
   CacheParticle *data = (CacheParticle*) msg->data;
   data->msg = msg;
   return (void*) data;
@@ -75,6 +108,15 @@ void TreePiece::fillRequestParticles(CkCacheRequestMsg<KeyType> *msg) {
   // a clear distinction between nodes and particles
   const GenericTreeNode *bucket = lookupNode(msg->key >> 1);
   CkAssert(bucket != NULL);
+  if(bCompactFill) {
+    int total = sizeof(CompactParticleFill) + (bucket->lastParticle - bucket->firstParticle) * sizeof(CompactParticle);
+    CkCacheFillMsg<KeyType> *reply = new (total) CkCacheFillMsg<KeyType>(msg->key);
+    ((CompactParticleFill *) reply->data)->pack(myParticles,
+        bucket->firstParticle, bucket->lastParticle);
+    cacheGravPart[msg->replyTo].recvData(reply);
+    delete msg;
+    return;
+  }
   int total = sizeof(CacheParticle) + (bucket->lastParticle - bucket->firstParticle) * sizeof(ExternalGravityParticle);
   CkCacheFillMsg<KeyType> *reply = new (total) CkCacheFillMsg<KeyType>(msg->key);
   CkAssert(reply != NULL);
@@ -92,6 +134,48 @@ void TreePiece::fillRequestParticles(CkCacheRequestMsg<KeyType> *msg) {
   delete msg;
 }
 
+/// @param p Particle array of the TreePiece.
+/// @param first Index of the first particle of the bucket.
+/// @param last Index of the last particle of the bucket.
+void CompactParticleFill::pack(const GravityParticle *p, int first, int last) {
+  const double nSteps = 4294967295.0;  // 2^32 - 1
+  begin = first;
+  end = last;
+  for (int d = 0; d < 3; ++d) {
+    double lo = p[first].position[d];
+    double hi = lo;
+    for (int i = first + 1; i <= last; ++i) {
+      if (p[i].position[d] < lo) lo = p[i].position[d];
+      if (p[i].position[d] > hi) hi = p[i].position[d];
+    }
+    lesser[d] = lo;
+    scale[d] = (hi - lo)/nSteps;
+  }
+  for (int i = first; i <= last; ++i) {
+    CompactParticle &cp = part[i - first];
+    for (int d = 0; d < 3; ++d) {
+      double q = (scale[d] > 0.0 ? (p[i].position[d] - lesser[d])/scale[d] : 0.0);
+      cp.position[d] = (uint32_t) (q < nSteps ? floor(q + 0.5) : nSteps);
+    }
+    cp.mass = p[i].mass;
+    cp.soft = p[i].soft;
+  }
+}
+
+/// @param data Storage for the particles in the layout of a full fill.
+void CompactParticleFill::unpack(CacheParticle *data) const {
+  data->begin = begin;
+  data->end = end;
+  for (int i = 0; i <= end - begin; ++i) {
+    const CompactParticle &cp = part[i];
+    ExternalGravityParticle &p = data->part[i];
+    for (int d = 0; d < 3; ++d)
+      p.position[d] = lesser[d] + cp.position[d]*scale[d];
+    p.mass = cp.mass;
+    p.soft = cp.soft;
+  }
+}
+
 // Methods for "combiner" cache
 
 EntryTypeSmoothParticle::EntryTypeSmoothParticle() {
@@ -102,10 +186,12 @@ void * EntryTypeSmoothParticle::request(CkArrayIndexMax& idx, KeyType key) {
   *(int*)CkPriorityPtr(msg) = -100000000;
   CkSetQueueing(msg, CK_QUEUEING_IFIFO);
   treeProxy[*idx.data()].fillRequestSmoothParticles(msg);
+  stats.fetched(key);
   return NULL;
 }
 
 void * EntryTypeSmoothParticle::unpack(CkCacheFillMsg<KeyType> *msg, int chunk, CkArrayIndexMax &from) {
+    stats.filled(msg->key, chunk, UsrToEnv(msg)->getTotalsize());
     // incoming data
     CacheSmoothParticle *cPartsIn = (CacheSmoothParticle*) msg->data;
     // Cached copy
@@ -341,18 +427,223 @@ EntryTypeGravityNode::EntryTypeGravityNode() {
   // Note that this is compiler dependent; also note that it is unused
   // at the moment -- see unpackSingle() below.
   memcpy(&vptr, &node, sizeof(void*));
+  requesterKey = 1;
+}
+
+CkpvDeclare(CacheDepthModel *, cacheDepthModel);
+
+/// Create the CacheDepthModel of each processor.
+void initCacheDepthModel() {
+  CkpvInitialize(CacheDepthModel *, cacheDepthModel);
+  CkpvAccess(cacheDepthModel) = new CacheDepthModel;
+}
+
+void CacheDepthModel::adapt() {
+  // Start from no limit below the depth adaptiveFillDepth() allows.
+  if (depthMax == 0) depthMax = 2*_cacheLineDepth;
+  if (nContinued > nBottom/2 && depthMax < 2*_cacheLineDepth)
+    depthMax++;
+  else if (nContinued < nBottom/8 && depthMax > 1)
+    depthMax--;
+  nBottom = nContinued = 0;
+}
+
+/// @brief Depth of the fill of node key for a requester located by
+/// requesterKey, no deeper than depthMax.
+///
+/// Walks open a node deeper below it the closer they are to it.  The
+/// distance is measured in the tree: the number of levels g from the
+/// common ancestor of the node and the requester down to the node.
+/// A requester below the node (g = 0) gets 2*nCacheDepth levels, and
+/// one level less for each further level of separation.
+static int adaptiveFillDepth(Tree::NodeKey key, Tree::NodeKey requesterKey, int depthMax) {
+  int levelNode = 0, levelReq = 0;
+  for (Tree::NodeKey k = key; k > 1; k >>= 1) levelNode++;
+  for (Tree::NodeKey k = requesterKey; k > 1; k >>= 1) levelReq++;
+  Tree::NodeKey a = key, b = requesterKey;
+  int level = levelNode;
+  if (levelNode > levelReq) {
+    a >>= levelNode - levelReq;
+    level = levelReq;
+  } else {
+    b >>= levelReq - levelNode;
+  }
+  while (a != b) {
+    a >>= 1;
+    b >>= 1;
+    level--;
+  }
+  int depth = 2*_cacheLineDepth - (levelNode - level);
+  if (depthMax > 0 && depth > depthMax) depth = depthMax;
+  return depth < 1 ? 1 : depth;
 }
 
 void * EntryTypeGravityNode::request(CkArrayIndexMax& idx, KeyType key) {
+  // Set if the fill was kept, but dropped to stay within the budget.
+  bool bDropped = false;
+  if (bRetainNodes) {
+    DataManager *dm = (DataManager*)CkLocalNodeBranch(dataManagerID);
+    CkCacheFillMsg<KeyType> *fill = dm->nodeFills->lookup(key, *idx.data(), bDropped);
+    if (fill != NULL) {
+      // Deliver the kept copy as if it came from the owner.
+      cacheNode[CkMyPe()].recvData(fill);
+      stats.fetched(key, true);
+      return NULL;
+    }
+  }
+  if (bAdaptiveCacheDepth) {
+    CkEntryOptions opts;
+    opts.setPriority((unsigned int) -110000000);
+    treeProxy[*idx.data()].fillRequestNodeDepth(key, CkMyPe(), requesterKey,
+        CkpvAccess(cacheDepthModel)->depthMax, &opts);
+    stats.fetched(key, false, bDropped);
+    return NULL;
+  }
   CkCacheRequestMsg<KeyType> *msg = new (32) CkCacheRequestMsg<KeyType>(key, CkMyPe());
   *(int*)CkPriorityPtr(msg) = -110000000;
   CkSetQueueing(msg, CK_QUEUEING_IFIFO);
 
   treeProxy[*idx.data()].fillRequestNode(msg);
+  stats.fetched(key, false, bDropped);
   return NULL;
 }
 
+/// Round x to single precision, down (dir < 0) or up (dir > 0).
+static inline float roundFloat(double x, int dir) {
+  float f = (float) x;
+  if (dir < 0 && f > x) f = nextafterf(f, -HUGE_VALF);
+  if (dir > 0 && f < x) f = nextafterf(f, HUGE_VALF);
+  return f;
+}
+
+/// Centre of a box, or 0 if the box is empty.
+static inline double boxCenter(double lesser, double greater) {
+  return (lesser <= greater ? 0.5*(lesser + greater) : 0.0);
+}
+
+/// @param node Node to send.
+/// @param bChildren Bit i set if child i is sent after this node.
+void CompactNode::pack(const Tree::BinaryTreeNode *node, int bChildren) {
+  const MultipoleMoments &m = node->moments;
+  double c[3];
+  for (int d = 0; d < 3; ++d) {
+    lesser[d] = node->boundingBox.lesser_corner[d];
+    greater[d] = node->boundingBox.greater_corner[d];
+    c[d] = boxCenter(lesser[d], greater[d]);
+    ballLesser[d] = roundFloat(node->bndBoxBall.lesser_corner[d] - c[d], -1);
+    ballGreater[d] = roundFloat(node->bndBoxBall.greater_corner[d] - c[d], 1);
+    cm[d] = m.cm[d] - c[d];
+  }
+  radius = roundFloat(m.radius, 1);
+  soft = m.soft;
+  totalMass = m.totalMass;
+  const cosmoType *mom0 = (const cosmoType *) &m.mom;
+  const int nMom = momFmomrTerms(iMultipoleOrder);
+  for (int i = 0; i < nMom; ++i)
+    mom[i] = mom0[i];
+  // Grow sizeSm by the error of centerSm so the sphere still bounds.
+  double err2 = 0.0;
+  for (int d = 0; d < 3; ++d) {
+    centerSm[d] = node->centerSm[d] - c[d];
+    double err = (c[d] + centerSm[d]) - node->centerSm[d];
+    err2 += err*err;
+  }
+  sizeSm = roundFloat(node->sizeSm + sqrt(err2), 1);
+  fKeyMax = roundFloat(node->fKeyMax, 1);
+  iParticleTypes = node->iParticleTypes;
+  nSPH = node->nSPH;
+  firstParticle = node->firstParticle;
+  lastParticle = node->lastParticle;
+  remoteIndex = node->remoteIndex;
+  particleCount = node->particleCount;
+  rungs = node->rungs;
+  iRank = node->iRank;
+  type = node->getType();
+  children = bChildren;
+}
+
+/// @param node Node constructed with its key, which is filled in.
+void CompactNode::unpack(Tree::BinaryTreeNode *node) const {
+  MultipoleMoments &m = node->moments;
+  double c[3];
+  for (int d = 0; d < 3; ++d) {
+    node->boundingBox.lesser_corner[d] = lesser[d];
+    node->boundingBox.greater_corner[d] = greater[d];
+    c[d] = boxCenter(lesser[d], greater[d]);
+    node->bndBoxBall.lesser_corner[d] = c[d] + ballLesser[d];
+    node->bndBoxBall.greater_corner[d] = c[d] + ballGreater[d];
+    m.cm[d] = c[d] + cm[d];
+    node->centerSm[d] = c[d] + centerSm[d];
+  }
+  m.radius = radius;
+  m.soft = soft;
+  m.totalMass = totalMass;
+  cosmoType *mom0 = (cosmoType *) &m.mom;
+  const int nMom = momFmomrTerms(iMultipoleOrder);
+  for (int i = 0; i < nMom; ++i)
+    mom0[i] = mom[i];
+  for (unsigned int i = nMom; i < sizeof(mom)/sizeof(mom[0]); ++i)
+    mom0[i] = 0;
+  m.makeFloat();
+  node->sizeSm = sizeSm;
+  node->fKeyMax = fKeyMax;
+  node->iParticleTypes = iParticleTypes;
+  node->nSPH = nSPH;
+  node->firstParticle = firstParticle;
+  node->lastParticle = lastParticle;
+  node->remoteIndex = remoteIndex;
+  node->particleCount = particleCount;
+  node->particlePointer = NULL;
+  node->rungs = rungs;
+  node->iRank = iRank;
+  node->setType((Tree::NodeType) type);
+}
+
+/// @brief Write node and its descendants to depth in depth first order.
+/// @return The number of nodes written.
+static int packCompactNodes(Tree::BinaryTreeNode *node, CompactNode *buffer, int depth) {
+  int bChildren = 0;
+  for (int i = 0; i < 2; ++i)
+    if (depth != 0 && node->children[i] != NULL) bChildren |= 1 << i;
+  buffer->pack(node, bChildren);
+  int used = 1;
+  for (int i = 0; i < 2; ++i)
+    if (bChildren & (1 << i))
+      used += packCompactNodes(node->children[i], buffer->next(used), depth - 1);
+  return used;
+}
+
+/// @brief Rebuild the nodes written by packCompactNodes() in the
+/// layout of BinaryTreeNode::packNodes(), ready for unpackNodes().
+/// @param slot Spacing of the nodes in out.
+/// @return The number of nodes read.
+static int unpackCompactNodes(const CompactNode *in, char *out, Tree::NodeKey key, int slot) {
+  Tree::BinaryTreeNode *node = new (out) Tree::BinaryTreeNode(key, Tree::Invalid, 0, 0, NULL);
+  in->unpack(node);
+  int used = 1;
+  for (int i = 0; i < 2; ++i) {
+    if (in->children & (1 << i)) {
+      node->children[i] = (Tree::BinaryTreeNode *) (long int) (used * slot);
+      used += unpackCompactNodes(in->next(used), out + used * slot, node->getChildKey(i), slot);
+    }
+  }
+  return used;
+}
+
 void * EntryTypeGravityNode::unpack(CkCacheFillMsg<KeyType> *msg, int chunk, CkArrayIndexMax &from) {
+  stats.filled(msg->key, chunk, UsrToEnv(msg)->getTotalsize());
+  if (bRetainNodes)
+    ((DataManager*)CkLocalNodeBranch(dataManagerID))->nodeFills->retain(msg, *from.data());
+  if (bCompactFill) {
+    // Expand into the layout of a full fill, which is cached.
+    int count = *(int *) msg->data;
+    int slot = ALIGN_DEFAULT(sizeof(Tree::BinaryTreeNode)+PAD_reply);
+    CkCacheFillMsg<KeyType> *full = new (count * slot, 8*sizeof(int)) CkCacheFillMsg<KeyType>(msg->key);
+    unpackCompactNodes((CompactNode *) (msg->data + PAD_reply),
+                       full->data + PAD_reply, msg->key, slot);
+    CkFreeMsg(msg);
+    msg = full;
+  }
   // recreate the entire tree inside this message
   Tree::BinaryTreeNode *node = (Tree::BinaryTreeNode *) (((char*)msg->data) + PAD_reply);
   node->unpackNodes();
@@ -409,6 +700,9 @@ void EntryTypeGravityNode::unpackSingle(CkCacheFillMsg<KeyType> *msg, Tree::Bina
     break;
   default:
     node->setType(Tree::Cached);
+    if (bAdaptiveCacheDepth && node->children[0] == NULL
+        && node->children[1] == NULL)
+      CkpvAccess(cacheDepthModel)->received(node->getKey());
   }
   KeyType ckey(node->getKey());
   if (!isRoot) cacheNode.ckLocalBranch()->recvData(ckey, from, (EntryTypeGravityNode*)this, chunk, (void*)node);
@@ -435,20 +729,128 @@ void EntryTypeGravityNode::callback(CkArrayID requestorID, CkArrayIndexMax &requ
 }
 
 
+/// @param msg Node fill as received, before it is unpacked; a copy is
+/// kept unless one from the same owner already is.
+/// @param owner Index of the TreePiece which served the fill
+void NodeFillStore::retain(CkCacheFillMsg<KeyType> *msg, int owner) {
+  CmiLock(lock);
+  Tree::NodeKeyTable<Fill>::iterator it = fills.find(msg->key);
+  if (it == fills.end() || it->second.owner != owner) {
+    if (it != fills.end()) release(it);
+    Fill &f = fills[msg->key];
+    f.msg = (CkCacheFillMsg<KeyType> *) CkCopyMsg((void **) &msg);
+    f.owner = owner;
+    f.lastUse = ++nUses;
+    nBytes += UsrToEnv(f.msg)->getTotalsize();
+    if (!dropped.empty()) dropped.erase(msg->key);
+    evict();
+  }
+  CmiUnlock(lock);
+}
+
+/// @param bDropped Set if a fill of key from owner was dropped to
+/// stay within the budget.
+/// @return A copy of the fill of key kept from owner, or NULL.
+CkCacheFillMsg<KeyType> *NodeFillStore::lookup(KeyType key, int owner,
+                                               bool &bDropped) {
+  CkCacheFillMsg<KeyType> *copy = NULL;
+  bDropped = false;
+  CmiLock(lock);
+  Tree::NodeKeyTable<Fill>::iterator it = fills.find(key);
+  if (it != fills.end() && it->second.owner == owner) {
+    copy = (CkCacheFillMsg<KeyType> *) CkCopyMsg((void **) &it->second.msg);
+    it->second.lastUse = ++nUses;
+  } else if (!dropped.empty()) {
+    Tree::NodeKeyTable<int>::iterator d = dropped.find(key);
+    if (d != dropped.end()) {
+      bDropped = (d->second == owner);
+      dropped.erase(d);
+    }
+  }
+  CmiUnlock(lock);
+  return copy;
+}
+
+void NodeFillStore::clear() {
+  CmiLock(lock);
+  for (Tree::NodeKeyTable<Fill>::iterator it = fills.begin(); it != fills.end(); ++it)
+    CkFreeMsg(it->second.msg);
+  fills.clear();
+  dropped.clear();
+  nBytes = 0;
+  CmiUnlock(lock);
+}
+
+/// @brief Free the fill at it and remove it.  Called with the lock held.
+void NodeFillStore::release(const Tree::NodeKeyTable<Fill>::iterator &it) {
+  nBytes -= UsrToEnv(it->second.msg)->getTotalsize();
+  CkFreeMsg(it->second.msg);
+  fills.erase(it);
+}
+
+/// @brief Drop the fills least recently used until the store is
+/// within 3/4 of the budget, so that the sort is not repeated for
+/// each fill retained.  Called with the lock held.
+void NodeFillStore::evict() {
+  const double dBudgetMB = dCacheBudget > 0.0 ? dCacheBudget : dNodeFillsDefaultMB;
+  const size_t budget = (size_t) (dBudgetMB*1024*1024*CkMyNodeSize());
+  if (nBytes <= budget) return;
+
+  std::vector<std::pair<uint64_t, KeyType> > byUse;
+  byUse.reserve(fills.size());
+  for (Tree::NodeKeyTable<Fill>::iterator it = fills.begin(); it != fills.end(); ++it)
+    byUse.push_back(std::make_pair(it->second.lastUse, it->first));
+  std::sort(byUse.begin(), byUse.end());
+  for (unsigned int i = 0; i < byUse.size() && nBytes > budget/4*3; ++i) {
+    Tree::NodeKeyTable<Fill>::iterator it = fills.find(byUse[i].second);
+    dropped[it->first] = it->second.owner;
+    release(it);
+  }
+}
+
 void TreePiece::fillRequestNode(CkCacheRequestMsg<KeyType> *msg) {
+  replyNodeFill(msg, _cacheLineDepth);
+}
+
+/// @brief Request for a node fill whose depth the owner picks
+/// (bAdaptiveCacheDepth).
+/// @param key Key of the requested node
+/// @param replyTo Processor of the requesting cache
+/// @param requesterKey Smallest node holding the requesting TreePiece
+/// @param depthMax Depth limit of the requesting processor, 0 if none
+void TreePiece::fillRequestNodeDepth(Tree::NodeKey key, int replyTo,
+                                     Tree::NodeKey requesterKey, int depthMax) {
+  CkCacheRequestMsg<KeyType> *msg = new (32) CkCacheRequestMsg<KeyType>(key, replyTo);
+  *(int*)CkPriorityPtr(msg) = -110000000;
+  CkSetQueueing(msg, CK_QUEUEING_IFIFO);
+  // A request forwarded by sendFillReqNodeWhenNull() gets the fixed depth.
+  replyNodeFill(msg, adaptiveFillDepth(key, requesterKey, depthMax));
+}
+
+/// @brief Send the node requested by msg with depth levels below it.
+void TreePiece::replyNodeFill(CkCacheRequestMsg<KeyType> *msg, int depth) {
   const Tree::GenericTreeNode* node = lookupNode(msg->key);
   //GenericTreeNode tmp;
   if(node != NULL) {
     if(_cache) {
 #if 1 || defined CACHE_BUFFER_MSGS
-      int count = ((Tree::BinaryTreeNode*)node)->countDepth(_cacheLineDepth);
-      // Extra bytes are allocated to store the msg pointer at the
-      // beginning of the buffer.  See the free() and the
-      // unpackSingle() method above.
-      CkAssert(sizeof(msg) <= PAD_reply);  // be sure there is enough rooom
-      //CkCacheFillMsg<KeyType> *reply = new (count * (sizeof(Tree::BinaryTreeNode)+PAD_reply), 8*sizeof(int)) CkCacheFillMsg<KeyType>(msg->key);
-      CkCacheFillMsg<KeyType> *reply = new (count * ALIGN_DEFAULT(sizeof(Tree::BinaryTreeNode)+PAD_reply), 8*sizeof(int)) CkCacheFillMsg<KeyType>(msg->key);
-      ((Tree::BinaryTreeNode*)node)->packNodes((Tree::BinaryTreeNode*)(reply->data+PAD_reply), _cacheLineDepth, PAD_reply);
+      int count = ((Tree::BinaryTreeNode*)node)->countDepth(depth);
+      CkCacheFillMsg<KeyType> *reply;
+      if (bCompactFill) {
+        // The node count is stored where a full fill keeps the msg
+        // pointer; EntryTypeGravityNode::unpack() expands the nodes.
+        reply = new (PAD_reply + count * CompactNode::size(), 8*sizeof(int)) CkCacheFillMsg<KeyType>(msg->key);
+        *(int *) reply->data = count;
+        packCompactNodes((Tree::BinaryTreeNode*)node, (CompactNode *) (reply->data + PAD_reply), depth);
+      } else {
+        // Extra bytes are allocated to store the msg pointer at the
+        // beginning of the buffer.  See the free() and the
+        // unpackSingle() method above.
+        CkAssert(sizeof(msg) <= PAD_reply);  // be sure there is enough rooom
+        //CkCacheFillMsg<KeyType> *reply = new (count * (sizeof(Tree::BinaryTreeNode)+PAD_reply), 8*sizeof(int)) CkCacheFillMsg<KeyType>(msg->key);
+        reply = new (count * ALIGN_DEFAULT(sizeof(Tree::BinaryTreeNode)+PAD_reply), 8*sizeof(int)) CkCacheFillMsg<KeyType>(msg->key);
+        ((Tree::BinaryTreeNode*)node)->packNodes((Tree::BinaryTreeNode*)(reply->data+PAD_reply), depth, PAD_reply);
+      }
 #else
       PUP::sizer p1;
       node->pup(p1, msg->depth);
@@ -8,11 +8,80 @@
  */
 
 #include <CkCache.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "config.h"
 #include "gravity.h"
 #include "GenericTreeNode.h"
 #include "keytype.h"
 
+/*********************************************************
+ * Cache telemetry
+ *********************************************************/
+
+/// @brief Counters of one cache entry type, for each chunk.
+///
+/// Each TreePiece keeps one for each of its entry types, and
+/// Main::writeCacheStats() gathers them at the end of every big step.
+/// A request hits, misses (and starts a fill), or finds a fill of the
+/// same key already in flight on this processor.  Misses answered
+/// from the NodeFillStore are also counted as retained.
+class CacheStats {
+public:
+  /// Fill latencies are histogrammed in powers of two: bin i counts
+  /// fills taking 2^i to 2^(i+1) microseconds, bin 0 also the shorter
+  /// ones and the last bin also the longer ones.
+  enum { nLatencyBins = 16 };
+  /// Counters of a chunk, in the order they are written out.
+  enum { iRequest, iHit, iMiss, iDuplicate, iRetained, iRefetch, iBytes,
+         iLatency, nCounters = iLatency + nLatencyBins };
+
+  /// nCounters for each chunk
+  std::vector<int64_t> counts;
+  /// Start times of the fills requested through this entry type.
+  Tree::NodeKeyTable<double> fillStart;
+  /// Set when the entry type's request() starts a fill.
+  bool bFetched;
+  /// Set if the fill is a copy kept from an earlier walk.
+  bool bRetained;
+  /// Set if the fill was kept but dropped to stay within the budget.
+  bool bRefetch;
+
+  CacheStats() : bFetched(false), bRetained(false), bRefetch(false) {}
+
+  inline int64_t *chunk(int iChunk) {
+    if(counts.size() < (size_t) (iChunk + 1)*nCounters)
+      counts.resize((iChunk + 1)*nCounters, 0);
+    return &counts[iChunk*nCounters];
+  }
+  /// @brief Count a request, after requestData() returned.
+  inline void lookup(int iChunk, bool bHit) {
+    int64_t *c = chunk(iChunk);
+    c[iRequest]++;
+    if(bHit) c[iHit]++;
+    else if(bFetched) {
+      c[iMiss]++;
+      if(bRetained) c[iRetained]++;
+      if(bRefetch) c[iRefetch]++;
+    }
+    else c[iDuplicate]++;
+    bFetched = bRetained = bRefetch = false;
+  }
+  /// @brief Note the start of a fill, from request().
+  inline void fetched(KeyType key, bool bKept = false, bool bDropped = false) {
+    fillStart[key] = CmiWallTimer();
+    bFetched = true;
+    bRetained = bKept;
+    bRefetch = bDropped;
+  }
+  void filled(KeyType key, int iChunk, int nBytes);
+  void clear() {
+    counts.clear();
+    fillStart.clear();
+    bFetched = bRetained = bRefetch = false;
+  }
+};
+
 /*********************************************************
  * Gravity interface: Particles
  *********************************************************/
@@ -36,6 +105,7 @@ public:
 /// This is a read-only cache of particles.
 class EntryTypeGravityParticle : public CkCacheEntryType<KeyType> {
 public:
+  CacheStats stats;
   EntryTypeGravityParticle();
   /// @brief Request a bucket of particles from a TreePiece.
   void * request(CkArrayIndexMax&, KeyType);
@@ -52,6 +122,29 @@ public:
   static void callback(CkArrayID, CkArrayIndexMax&, KeyType, CkCacheUserData &, void*, int);
 };
 
+/// @brief A particle in a compact cache fill (bCompactFill): its
+/// position quantized within the bounding box of its bucket.
+class CompactParticle {
+public:
+  uint32_t position[3];
+  float mass;
+  float soft;
+};
+
+/// @brief The data in a compact particle cache fill, expanded into a
+/// CacheParticle by the receiver.
+class CompactParticleFill {
+public:
+  int begin;			///< as in CacheParticle
+  int end;			///< as in CacheParticle
+  double lesser[3];		///< lower corner of the particles' box
+  double scale[3];		///< width of a quantization step
+  CompactParticle part[1];
+
+  void pack(const GravityParticle *p, int first, int last);
+  void unpack(CacheParticle *data) const;
+};
+
 /*********************************************************
  * Smooth interface: Particles
  *********************************************************/
@@ -73,6 +166,7 @@ public:
 class EntryTypeSmoothParticle : public CkCacheEntryType<KeyType> {
     // N.B. can't have helpful attributes because of the static function.
 public:
+  CacheStats stats;
   EntryTypeSmoothParticle();
   /// @brief Request a bucket of particles from a TreePiece.
   void * request(CkArrayIndexMax&, KeyType);
@@ -92,12 +186,103 @@ public:
  * Gravity interface: Nodes
  *********************************************************/
 
+/// @brief A tree node in a compact cache fill (bCompactFill).
+///
+/// The nodes of a fill follow each other in depth first order, so
+/// their keys are implied by that of the requested node.  Moments
+/// and positions are single precision, positions relative to the
+/// centre of the bounding box, and bounds are rounded outward.
+/// Fields that only have meaning on the owning TreePiece are not
+/// sent, nor are the moment terms above iMultipoleOrder, so that
+/// consecutive nodes are size() bytes apart.
+class CompactNode {
+public:
+  double lesser[3];		///< boundingBox, kept exact
+  double greater[3];
+  float ballLesser[3];		///< bndBoxBall
+  float ballGreater[3];
+  float cm[3];
+  float radius;
+  float soft;
+  float totalMass;
+  float centerSm[3];
+  float sizeSm;
+  float fKeyMax;
+  unsigned int iParticleTypes;
+  int nSPH;
+  int firstParticle;
+  int lastParticle;
+  int remoteIndex;
+  int particleCount;
+  short iRank;
+  char rungs;
+  char type;
+  char children;		///< bit i set if child i follows
+  /// The first momFmomrTerms(iMultipoleOrder) terms of the FMOMR;
+  /// must be the last member.
+  float mom[sizeof(FMOMR)/sizeof(cosmoType)];
+
+  void pack(const Tree::BinaryTreeNode *node, int bChildren);
+  void unpack(Tree::BinaryTreeNode *node) const;
+  /// @brief Bytes of one node in a fill at the run time order.
+  static int size() {
+    return ALIGN_DEFAULT(offsetof(CompactNode, mom)
+                         + momFmomrTerms(iMultipoleOrder)*sizeof(float));
+  }
+  /// @brief The node that follows this one in a fill.
+  CompactNode *next(int n = 1) { return (CompactNode *) ((char *) this + n*size()); }
+  const CompactNode *next(int n = 1) const {
+    return (const CompactNode *) ((const char *) this + n*size());
+  }
+};
+
+/// @brief Requester side model of how deep node fills should be
+/// (bAdaptiveCacheDepth), one per processor.
+///
+/// The nodes at the bottom of the fills received are remembered, and
+/// a miss on a child of one of them shows that the walk went past the
+/// fill.  Every nSample bottom nodes, the depth limit sent with node
+/// requests grows by one level if most of them were continued this
+/// way, and shrinks by one if few were, leaving the shipped levels
+/// below unused.
+class CacheDepthModel {
+  /// Bottom nodes of fills that no walk has gone below yet.
+  Tree::NodeKeyTable<char> bottom;
+  int nBottom;
+  int nContinued;
+public:
+  enum { nSample = 256 };
+  /// Largest fill depth to ask for, 0 until the first sample.
+  int depthMax;
+
+  CacheDepthModel() : nBottom(0), nContinued(0), depthMax(0) {}
+  /// @brief Note a node received with no children in its fill.
+  inline void received(KeyType key) {
+    bottom[key] = 1;
+    if (++nBottom >= nSample) adapt();
+  }
+  /// @brief Note a cache miss on key.
+  inline void missed(KeyType key) {
+    if (!bottom.empty() && bottom.erase(key >> 1) > 0) nContinued++;
+  }
+  void adapt();
+  /// @brief Forget the bottom nodes when the cache is flushed.
+  void flush() { bottom.clear(); }
+};
+
+CkpvExtern(CacheDepthModel *, cacheDepthModel);
+void initCacheDepthModel();
+
 /// @brief Cache interface to the Tree Nodes.
 class EntryTypeGravityNode : public CkCacheEntryType<KeyType> {
   void *vptr; // For saving a copy of the virtual function table.
 	      // It's use will be compiler dependent.
   void unpackSingle(CkCacheFillMsg<KeyType> *, Tree::BinaryTreeNode *, int, CkArrayIndexMax &, bool);
 public:
+  CacheStats stats;
+  /// Smallest node holding the particles of the TreePiece, sent with
+  /// requests for adaptive fill depths (bAdaptiveCacheDepth).
+  Tree::NodeKey requesterKey;
   EntryTypeGravityNode();
   void * request(CkArrayIndexMax&, KeyType);
   void * unpack(CkCacheFillMsg<KeyType> *, int, CkArrayIndexMax &);
@@ -108,6 +293,47 @@ public:
   static void callback(CkArrayID, CkArrayIndexMax&, KeyType, CkCacheUserData &, void*, int);
 };
 
+/// MB per processor for the NodeFillStore when dCacheBudget is not set.
+const double dNodeFillsDefaultMB = 64.0;
+
+/// @brief Remote node fills kept from one tree walk to the next
+/// (bRetainNodes), shared by the processors of an SMP node.
+///
+/// The cache is flushed after each walk, but a fill is still valid
+/// in the later walks on the same tree: gravity, the prefetch and
+/// the smooth passes.  Every tree build follows a drift or an
+/// exchange of particles, so DataManager::combineLocalTrees() drops
+/// all the fills once the new tree is built.  A request for a kept
+/// fill is answered with a copy from this processor instead of going
+/// to the TreePiece that served it.
+///
+/// Walks only ever see copies, so any fill can be dropped.  The fills
+/// least recently retained or looked up are dropped whenever the
+/// store outgrows dCacheBudget, or dNodeFillsDefaultMB if that is
+/// not set, for each processor of the node.  The keys dropped are
+/// remembered to count the fetches this causes.
+class NodeFillStore {
+  struct Fill {
+    CkCacheFillMsg<KeyType> *msg;  ///< fill as it was received
+    int owner;                     ///< TreePiece that served it
+    uint64_t lastUse;              ///< stamp of the last retain or lookup
+  };
+  Tree::NodeKeyTable<Fill> fills;
+  /// Owner of each fill dropped to stay within the budget.
+  Tree::NodeKeyTable<int> dropped;
+  size_t nBytes;                   ///< size of the fills kept
+  uint64_t nUses;
+  CmiNodeLock lock;
+  void release(const Tree::NodeKeyTable<Fill>::iterator &it);
+  void evict();
+public:
+  NodeFillStore() : nBytes(0), nUses(0) { lock = CmiCreateLock(); }
+  ~NodeFillStore() { clear(); CmiDestroyLock(lock); }
+  void retain(CkCacheFillMsg<KeyType> *msg, int owner);
+  CkCacheFillMsg<KeyType> *lookup(KeyType key, int owner, bool &bDropped);
+  void clear();
+};
+
 #endif
 
 
@@ -8,6 +8,7 @@
 #include "State.h"
 #include "Space.h"
 #include "gravity.h"
+#include "InterListRecord.h"
 
 int decodeReqID(int reqID);
 
@@ -26,12 +27,12 @@ void Compute::init(void *buck, int ar, Opt *o){
 }
 
 State *Compute::getNewState(int dim1, int dim2){
-  State *s = new State();
+  State *s = new (stateStorage(sizeof(State))) State();
   // 2 arrays of counters
   // 0. numAdditionalRequests[] - sized numBuckets, init to numChunks
   // 1. remaining Chunk[] - sized numChunks
-  s->counterArrays[0] = new int [dim1];
-  s->counterArrays[1] = new int [dim2];
+  s->counterArrays[0] = newCounters(dim1);
+  s->counterArrays[1] = newCounters(dim2);
   s->currentBucket = 0;
   s->bWalkDonePending = 0;
   
@@ -42,8 +43,8 @@ State *Compute::getNewState(int dim1, int dim2){
 
 State *Compute::getNewState(int dim1){
   // 0. local component of numAdditionalRequests, init to 1
-  State *s = new State();
-  s->counterArrays[0] = new int [dim1];
+  State *s = new (stateStorage(sizeof(State))) State();
+  s->counterArrays[0] = newCounters(dim1);
   s->counterArrays[1] = 0;
   s->currentBucket = 0;
   s->bWalkDonePending = 0;
@@ -61,6 +62,11 @@ State *Compute::getNewState(){
 }
 
 void Compute::freeState(State *s){
+  if(arena != NULL){
+    // The counters and the state itself go with the arena.
+    s->~State();
+    return;
+  }
   if(s->counterArrays[0]){
     delete [] s->counterArrays[0];
     s->counterArrays[0] = 0;
@@ -79,53 +85,58 @@ void ListCompute::freeState(State *s){
   Compute::freeState(s);
 }
 
-/// @brief Free up all the lists.
+/// @brief Free up what is not in the arena: the storage of the
+/// check lists and of the GPU lists.  The lists themselves go with
+/// the arena.
 void ListCompute::freeDoubleWalkState(DoubleWalkState *state){
   for(int i = 0; i < INTERLIST_LEVELS; i++){
-    state->undlists[i].free();
-    state->clists[i].free();
-  }
-  delete [] state->chklists;
-  state->undlists.free();
-  state->clists.free();
-
-  if(state->rplists.length() > 0){
-    for(int i = 0; i < INTERLIST_LEVELS; i++){
-      state->rplists[i].free();
-    }
-    state->rplists.free();
-  }
-  else if(state->lplists.length() > 0){
-    for(int i = 0; i < INTERLIST_LEVELS; i++){
-      state->lplists[i].free();
-    }
-    state->lplists.free();
+    state->chklists[i].~CheckList();
   }
+  state->chklists = 0;
+  state->undlists = 0;
+  state->clists = 0;
+  state->rplists = 0;
+  state->lplists = 0;
 
 #ifdef CUDA
   state->nodeLists.free();
   state->particleLists.free();
 #endif
 
-  if(state->placedRoots){
-    delete [] state->placedRoots;
-    state->placedRoots = 0;
-  }
+  state->placedRoots = 0;
+
+  delete state->soa;
+  state->soa = 0;
+}
 
+/// @brief One list of each level, using arena for their storage.
+template <class T>
+static ArenaList<T> *newLevelLists(Arena *arena){
+  ArenaList<T> *lists = arena->alloc<ArenaList<T> >(INTERLIST_LEVELS);
+  for(int i = 0; i < INTERLIST_LEVELS; i++){
+    new (&lists[i]) ArenaList<T>(arena);
+  }
+  return lists;
 }
 
+/// The state and all its lists are allocated from the arena, which
+/// must be set.
 DoubleWalkState *ListCompute::allocDoubleWalkState(){
-  DoubleWalkState *s = new DoubleWalkState;
+  CkAssert(arena != NULL);
+  DoubleWalkState *s = new (stateStorage(sizeof(DoubleWalkState))) DoubleWalkState;
   s->level = 0;
-  s->chklists = new CheckList[INTERLIST_LEVELS];
-  s->undlists.resize(INTERLIST_LEVELS);
-  s->clists.resize(INTERLIST_LEVELS);
+  s->chklists = arena->alloc<CheckList>(INTERLIST_LEVELS);
+  for(int i = 0; i < INTERLIST_LEVELS; i++){
+    new (&s->chklists[i]) CheckList;
+  }
+  s->undlists = newLevelLists<OffsetNode>(arena);
+  s->clists = newLevelLists<OffsetNode>(arena);
 
   if(getOptType() == Remote){
-    s->rplists.resize(INTERLIST_LEVELS);
+    s->rplists = newLevelLists<RemotePartInfo>(arena);
   }
   else if(getOptType() == Local){
-    s->lplists.resize(INTERLIST_LEVELS);
+    s->lplists = newLevelLists<LocalPartInfo>(arena);
   }
 
   return s;
@@ -134,10 +145,10 @@ DoubleWalkState *ListCompute::allocDoubleWalkState(){
 /// @brief Version that allocates a DoubleWalkState
 State *ListCompute::getNewState(int d1, int d2){
   DoubleWalkState *s = allocDoubleWalkState();
-  s->counterArrays[0] = new int [d1];
-  s->counterArrays[1] = new int [d2];
+  s->counterArrays[0] = newCounters(d1);
+  s->counterArrays[1] = newCounters(d2);
   // one boolean for each chunk
-  s->placedRoots = new bool [d2];
+  s->placedRoots = arena->alloc<bool>(d2);
   s->currentBucket = 0;
   s->bWalkDonePending = 0;
 
@@ -148,10 +159,10 @@ State *ListCompute::getNewState(int d1, int d2){
 /// @brief Version that allocates a DoubleWalkState
 State *ListCompute::getNewState(int d1){
   DoubleWalkState *s = allocDoubleWalkState();
-  s->counterArrays[0] = new int [d1];
+  s->counterArrays[0] = newCounters(d1);
   s->counterArrays[1] = 0;
   // no concept of chunks in local computation
-  s->placedRoots = new bool [1];
+  s->placedRoots = arena->alloc<bool>(1);
   s->currentBucket = 0;
   s->bWalkDonePending = 0;
 
@@ -432,6 +443,10 @@ int GravityCompute::doWork(GenericTreeNode *node, TreeWalk *tw,
 #endif
     return DUMP;
   }
+  // Nothing to compute beyond the TreePM short range cutoff
+  if(pmOutOfRange(node, (GenericTreeNode *)computeEntity,
+                  tp->decodeOffset(reqID)))
+    return DUMP;
   int open;
 
   open = openCriterion(tp, node, reqID, state);
@@ -707,6 +722,248 @@ int PrefetchCompute::doWork(GenericTreeNode *node, TreeWalk *tw, State *state, i
   return -1;
 }
 
+/// @brief Start a cell for node with an empty local expansion.
+static void initFmmCell(FmmCell &cell, GenericTreeNode *node){
+  cell = FmmCell();
+  cell.node = node;
+  cell.v = node->moments.getRadius();
+  // any positive scale will do for a single particle
+  if(cell.v <= 0.0)
+    cell.v = 1.0;
+}
+
+/// @brief Collect the roots of the purely local subtrees beneath node.
+static void findFmmRoots(GenericTreeNode *node, FmmState *state){
+  switch(node->getType()){
+  case Internal:
+  case Bucket:
+    if(node->particleCount > 0){
+      FmmCell cell;
+      initFmmCell(cell, node);
+      state->cells.push_back(cell);
+    }
+    break;
+  case Boundary:
+    for(int i = 0; i < node->numChildren(); i++)
+      findFmmRoots(node->getChildren(i), state);
+    break;
+  default:
+    break;
+  }
+}
+
+/// @brief Append the children of cell iCell, then recurse into them.
+static void buildFmmCells(FmmState *state, int iCell){
+  GenericTreeNode *node = state->cells[iCell].node;
+  if(node->getType() == Bucket)
+    return;
+
+  int iChild = state->cells.size();
+  for(int i = 0; i < node->numChildren(); i++){
+    GenericTreeNode *child = node->getChildren(i);
+    if(child == NULL || child->getType() == Empty || child->particleCount == 0)
+      continue;
+    FmmCell cell;
+    initFmmCell(cell, child);
+    state->cells.push_back(cell);
+  }
+  int nChild = state->cells.size() - iChild;
+  state->cells[iCell].iChild = iChild;
+  state->cells[iCell].nChild = nChild;
+  for(int i = iChild; i < iChild + nChild; i++)
+    buildFmmCells(state, i);
+}
+
+/// @brief Flatten the local part of the tree beneath root into the
+/// cells of a dual tree walk state.
+static void initFmmState(FmmState *s, GenericTreeNode *root){
+  s->cells.clear();
+  findFmmRoots(root, s);
+  s->nRoots = s->cells.size();
+  for(int i = 0; i < s->nRoots; i++)
+    buildFmmCells(s, i);
+  s->nCellInter = 0;
+  s->nPartInter = 0;
+  s->nLocalEval = 0;
+}
+
+static FmmState *newFmmState(){
+  FmmState *s = new FmmState();
+  s->counterArrays[0] = 0;
+  s->counterArrays[1] = 0;
+  s->nRoots = 0;
+  return s;
+}
+
+State *FmmCompute::getNewState(){
+  return newFmmState();
+}
+
+/// @brief Flatten the local part of the tree beneath the
+/// computeEntity and clear all local expansions.
+void FmmCompute::initState(State *state){
+  initFmmState((FmmState *)state, (GenericTreeNode *)computeEntity);
+}
+
+int FmmCompute::openCriterion(TreePiece *ownerTP,
+                          GenericTreeNode *node, int reqID, State *state){
+  FmmState *s = (FmmState *)state;
+  return openCriterionFmm(node, s->cells[s->target].node,
+                          ownerTP->decodeOffset(reqID));
+}
+
+/// @brief Interact the current pair of cells.
+/// @param node is the source node, the node of FmmState::source.
+/// @return KEEP if the pair has to be split, DUMP otherwise.
+int FmmCompute::doWork(GenericTreeNode *node, TreeWalk *tw, State *state, int chunk, int reqID, bool isRoot, bool &didcomp, int awi){
+  FmmState *s = (FmmState *)state;
+  FmmCell &target = s->cells[s->target];
+  FmmCell &source = s->cells[s->source];
+  TreePiece *tp = tw->getOwnerTP();
+  Vector3D<cosmoType> offset = tp->decodeOffset(reqID);
+
+  bool bTargetActive = target.node->rungs >= activeRung;
+  bool bSourceActive = s->bMutual && source.node->rungs >= activeRung;
+  if(!bTargetActive && !bSourceActive)
+    return DUMP;
+
+  if(!openCriterion(tp, node, reqID, state)){
+    didcomp = true;
+    MultipoleMoments &mt = target.node->moments;
+    MultipoleMoments &ms = source.node->moments;
+    if(bTargetActive){
+      cosmoType idt2 = cellCellForce(&target.l, target.v, ms,
+                                     mt.cm - (ms.cm + offset));
+      target.interMass += ms.totalMass;
+      if(idt2 > target.dtGrav)
+        target.dtGrav = idt2;
+      s->nCellInter++;
+    }
+    if(bSourceActive){
+      cosmoType idt2 = cellCellForce(&source.l, source.v, mt,
+                                     ms.cm + offset - mt.cm);
+      source.interMass += mt.totalMass;
+      if(idt2 > source.dtGrav)
+        source.dtGrav = idt2;
+      s->nCellInter++;
+    }
+    return DUMP;
+  }
+
+  if(target.nChild == 0 && source.nChild == 0){
+    didcomp = true;
+    s->nPartInter += bucketBucketForce(target.node, source.node, offset,
+                                       activeRung, s->bMutual);
+    return DUMP;
+  }
+  return KEEP;
+}
+
+/// @brief Shift the local expansion of cell iCell into its children,
+/// and evaluate it at the particles once a bucket is reached.
+void FmmCompute::pushLocal(FmmState *state, int iCell){
+  FmmCell &cell = state->cells[iCell];
+  if(cell.node->rungs < activeRung)
+    return;
+
+  if(cell.nChild == 0){
+    state->nLocalEval += localBucketForce(&cell.l, cell.v, cell.node,
+                                          activeRung, cell.interMass,
+                                          cell.dtGrav);
+    return;
+  }
+
+  for(int i = cell.iChild; i < cell.iChild + cell.nChild; i++){
+    FmmCell &child = state->cells[i];
+    if(child.node->rungs < activeRung)
+      continue;
+    FLOCR l = cell.l;
+    Vector3D<cosmoType> dr = child.node->moments.cm - cell.node->moments.cm;
+    momShiftFlocr(&l, cell.v, dr.x, dr.y, dr.z);
+    momRescaleFlocr(&l, child.v, cell.v);
+    momAddFlocr(&child.l, &l);
+    child.interMass += cell.interMass;
+    if(cell.dtGrav > child.dtGrav)
+      child.dtGrav = cell.dtGrav;
+    pushLocal(state, i);
+  }
+}
+
+void FmmCompute::walkDone(State *state){
+  FmmState *s = (FmmState *)state;
+  for(int i = 0; i < s->nRoots; i++)
+    pushLocal(s, i);
+}
+
+State *MutualCompute::getNewState(){
+  return newFmmState();
+}
+
+/// @brief Flatten the local part of the tree beneath the
+/// computeEntity.
+void MutualCompute::initState(State *state){
+  initFmmState((FmmState *)state, (GenericTreeNode *)computeEntity);
+}
+
+int MutualCompute::openCriterion(TreePiece *ownerTP,
+                          GenericTreeNode *node, int reqID, State *state){
+  FmmState *s = (FmmState *)state;
+  return openCriterionFmm(node, s->cells[s->target].node,
+                          ownerTP->decodeOffset(reqID));
+}
+
+/// @brief Apply the multipole of source to the active buckets beneath
+/// cell iCell.
+/// @return Number of particles evaluated.
+int MutualCompute::cellForce(FmmState *state, int iCell,
+                             GenericTreeNode *source,
+                             Vector3D<cosmoType> offset, TreePiece *tp){
+  FmmCell &cell = state->cells[iCell];
+  if(cell.node->rungs < activeRung)
+    return 0;
+  if(cell.nChild == 0)
+    return nodeBucketForce(source, cell.node, tp->getParticles(), offset,
+                           activeRung);
+  int computed = 0;
+  for(int i = cell.iChild; i < cell.iChild + cell.nChild; i++)
+    computed += cellForce(state, i, source, offset, tp);
+  return computed;
+}
+
+/// @brief Interact the current pair of cells.
+/// @param node is the source node, the node of FmmState::source.
+/// @return KEEP if the pair has to be split, DUMP otherwise.
+int MutualCompute::doWork(GenericTreeNode *node, TreeWalk *tw, State *state, int chunk, int reqID, bool isRoot, bool &didcomp, int awi){
+  FmmState *s = (FmmState *)state;
+  FmmCell &target = s->cells[s->target];
+  FmmCell &source = s->cells[s->source];
+  TreePiece *tp = tw->getOwnerTP();
+  Vector3D<cosmoType> offset = tp->decodeOffset(reqID);
+
+  bool bTargetActive = target.node->rungs >= activeRung;
+  bool bSourceActive = s->bMutual && source.node->rungs >= activeRung;
+  if(!bTargetActive && !bSourceActive)
+    return DUMP;
+
+  if(!openCriterion(tp, node, reqID, state)){
+    didcomp = true;
+    if(bTargetActive)
+      s->nCellInter += cellForce(s, s->target, source.node, offset, tp);
+    // bMutual pairs have no offset.
+    if(bSourceActive)
+      s->nCellInter += cellForce(s, s->source, target.node, offset, tp);
+    return DUMP;
+  }
+
+  if(target.nChild == 0 && source.nChild == 0){
+    didcomp = true;
+    s->nPartInter += bucketBucketForce(target.node, source.node, offset,
+                                       activeRung, s->bMutual);
+    return DUMP;
+  }
+  return KEEP;
+}
+
 #if INTERLIST_VER > 0
 /// @brief Process a node.
 /// @param node is the global node being processed.
@@ -733,6 +990,9 @@ int ListCompute::doWork(GenericTreeNode *node, TreeWalk *tw, State *state, int c
 #endif
     return DUMP;
   }
+  // Nothing to compute beyond the TreePM short range cutoff
+  if(pmOutOfRange(node, (GenericTreeNode *)computeEntity, offset))
+    return DUMP;
   // check opening criterion
   int open;
 
@@ -771,9 +1031,12 @@ int ListCompute::doWork(GenericTreeNode *node, TreeWalk *tw, State *state, int c
     else if(open == INTERSECT)
     {
       GenericTreeNode *localNode = (GenericTreeNode *)computeEntity;
-      if(localNode->getType() == Bucket){
+      if(localNode->getType() == Bucket || isBucketGroup(localNode)){
         // if the local node is a bucket, we shouldn't descend further locally
-        // instead, add the children of the glblnode to its checklist
+        // instead, add the children of the glblnode to its checklist.
+        // A bucket group is treated the same way, so its undecided
+        // list stays empty, the walk stops there and stateReady()
+        // applies the lists to every bucket in the group.
         addChildrenToCheckList(node, reqID, chunk, awi, s, chklist, tp);
         //Vector3D<double> vec = tp->decodeOffset(reqID);
         //CkPrintf("level %d: %d (%f, %f, %f)\n", s->level, node->getKey(), vec.x, vec.y, vec.z);
@@ -942,7 +1205,7 @@ void ListCompute::recvdParticles(ExternalGravityParticle *part,int num,int chunk
   tp->getBucketsBeneathBounds(source, startBucket, end);
 
   // init state
-  bool remoteLists = state->rplists.length() > 0;
+  bool remoteLists = state->rplists != NULL;
 
   int level = source->getLevel(source->getKey());
   for(int i = 0; i <= level; i++){
@@ -1018,9 +1281,20 @@ void ListCompute::recvdParticles(ExternalGravityParticle *part,int num,int chunk
   }
 }
 
+/// @brief Is this local node small enough (nBucketGroup) for its
+/// buckets to share one interaction list?
+bool ListCompute::isBucketGroup(GenericTreeNode *node){
+  return nBucketGroup > 0 && node->getType() == Internal
+    && node->lastParticle - node->firstParticle + 1 <= nBucketGroup;
+}
+
 /// @brief apply node opening criterion to this node.
 int ListCompute::openCriterion(TreePiece *ownerTP,
                           GenericTreeNode *node, int reqID, State *state){
+  // With FMM or mutual gravity the local particles are all done by
+  // the DualTreeWalk, so nodes that are partly local must be opened.
+  if((bFmmGravity || bMutualGravity) && node->getType() == Boundary)
+    return CONTAIN;
   return
     openCriterionNode(node,(GenericTreeNode *)computeEntity, ownerTP->decodeOffset(reqID));
 }
@@ -1296,8 +1570,8 @@ void ListCompute::fillLists(State *state_, TreePiece *tp, int chunk, int start,
   GenericTreeNode *lowestNode = state->lowestNode;
   int maxlevel = lowestNode->getLevel(lowestNode->getKey());
 
-  bool hasRemoteLists = state->rplists.length() > 0 ? true : false;
-  bool hasLocalLists = state->lplists.length() > 0 ? true : false;
+  bool hasRemoteLists = state->rplists != NULL;
+  bool hasLocalLists = state->lplists != NULL;
 
   int numNodes = 0;
   int numLParticles = 0;
@@ -1346,14 +1620,14 @@ void ListCompute::fillLists(State *state_, TreePiece *tp, int chunk, int start,
         filled = true;
         for(int level = 0; level <= maxlevel; level++){
 
-          CkVec<OffsetNode> &clist = state->clists[level];
+          ArenaList<OffsetNode> &clist = state->clists[level];
           for(unsigned int i = 0; i < clist.length(); i++){
             clistforb.insertAtEnd(clist[i]);
           }
 
           // remote particles
           if(hasRemoteLists){
-            CkVec<RemotePartInfo> &rpilist = state->rplists[level];
+            ArenaList<RemotePartInfo> &rpilist = state->rplists[level];
             // for each bunch of particles in list
             for(unsigned int i = 0; i < rpilist.length(); i++){
               RemotePartInfo &rpi = rpilist[i];
@@ -1363,7 +1637,7 @@ void ListCompute::fillLists(State *state_, TreePiece *tp, int chunk, int start,
 
           // local particles
           if(hasLocalLists) {
-            CkVec<LocalPartInfo> &lpilist = state->lplists[level];
+            ArenaList<LocalPartInfo> &lpilist = state->lplists[level];
             for(unsigned int i = 0; i < lpilist.length(); i++) {
               LocalPartInfo &lpi = lpilist[i];
               lplistforb.insertAtEnd(lpi);
@@ -1375,11 +1649,19 @@ void ListCompute::fillLists(State *state_, TreePiece *tp, int chunk, int start,
   }// bucket
 }
 
-template<class type> int calcNodeForces(TreePiece *tp, int b, int activeRung,
-    CkVec<type>& clist) {
+// List is CkVec for the CkLoop lists, ArenaList for those of a state.
+template<class type, template<class> class List>
+int calcNodeForces(TreePiece *tp, int b, int activeRung, List<type>& clist) {
 
   GravityParticle *particles = tp->getParticles();
   int computed = 0;
+  FarFieldTargets farTargets;
+  if(bFarFieldFloat && clist.length() > 0) {
+    GenericTreeNode *bucket = tp->getBucket(b);
+    int nMax = bucket->lastParticle - bucket->firstParticle + 1;
+    farTargets.init(alloca(FarFieldTargets::bytes(nMax)), particles, bucket,
+                    activeRung);
+  }
   for(unsigned int i = 0; i < clist.length(); i++){
 
 #ifdef CHANGA_REFACTOR_WALKCHECK_INTERLIST
@@ -1393,6 +1675,13 @@ template<class type> int calcNodeForces(TreePiece *tp, int b, int activeRung,
       continue;
     }
 #endif
+    if(bFarFieldFloat) {
+      computed += nodeBucketForceFloat(clist[i].node,
+          tp->getBucket(b),
+          particles,
+          tp->decodeOffset(clist[i].offsetID), activeRung, farTargets);
+      continue;
+    }
     computed +=  nodeBucketForce(clist[i].node,
         tp->getBucket(b),
         particles,
@@ -1404,11 +1693,14 @@ template<class type> int calcNodeForces(TreePiece *tp, int b, int activeRung,
     }
 #endif
   }
+  if(bFarFieldFloat && clist.length() > 0)
+    farTargets.store(particles);
   return computed;
 }
 
-template<class type> int calcParticleForces(TreePiece *tp, int b, int activeRung,
-    CkVec<type>& clist) {
+template<class type, template<class> class List>
+int calcParticleForces(TreePiece *tp, int b, int activeRung,
+    List<type>& clist) {
 
   GravityParticle *particles = tp->getParticles();
   int computed = 0;
@@ -1441,6 +1733,185 @@ template<class type> int calcParticleForces(TreePiece *tp, int b, int activeRung
   return computed;
 }
 
+/// @brief Write the lists of state and the active buckets from start
+/// to end that they apply to (iInterListDump).  See
+/// InterListRecord.h for the format.
+void ListCompute::recordLists(DoubleWalkState *state, TreePiece *tp,
+                              int start, int end){
+  FILE *fp = tp->fpInterList;
+  GravityParticle *particles = tp->getParticles();
+  GenericTreeNode *lowestNode = state->lowestNode;
+  int maxlevel = lowestNode->getLevel(lowestNode->getKey());
+  bool hasRemoteLists = state->rplists != NULL;
+  bool hasLocalLists = state->lplists != NULL;
+
+  ILRecord rec;
+  rec.bRemote = (getOptType() == Remote);
+  rec.nBuckets = rec.nNodes = rec.nParticles = 0;
+  for(int b = start; b < end; b++)
+    if(tp->bucketList[b]->rungs >= activeRung)
+      rec.nBuckets++;
+  if(rec.nBuckets == 0)
+    return;
+  for(int level = 0; level <= maxlevel; level++){
+    rec.nNodes += state->clists[level].length();
+    if(hasRemoteLists)
+      for(unsigned int i = 0; i < state->rplists[level].length(); i++)
+        rec.nParticles += state->rplists[level][i].numParticles;
+    if(hasLocalLists)
+      for(unsigned int i = 0; i < state->lplists[level].length(); i++)
+        rec.nParticles += state->lplists[level][i].numParticles;
+  }
+  fwrite(&rec, sizeof(rec), 1, fp);
+
+  for(int b = start; b < end; b++){
+    GenericTreeNode *bucket = tp->bucketList[b];
+    if(bucket->rungs < activeRung)
+      continue;
+    ILBucket ilb;
+    ilb.index = b;
+    ilb.nPart = bucket->lastParticle - bucket->firstParticle + 1;
+    ilb.moments = bucket->moments;
+    ilb.boundingBox = bucket->boundingBox;
+    fwrite(&ilb, sizeof(ilb), 1, fp);
+    for(int j = bucket->firstParticle; j <= bucket->lastParticle; j++){
+      ILTarget t;
+      t.position = particles[j].position;
+      t.mass = particles[j].mass;
+      t.soft = particles[j].soft;
+      t.rung = particles[j].rung;
+      fwrite(&t, sizeof(t), 1, fp);
+    }
+  }
+
+  for(int level = 0; level <= maxlevel; level++){
+    ArenaList<OffsetNode> &clist = state->clists[level];
+    for(unsigned int i = 0; i < clist.length(); i++){
+      ILNode n;
+      n.moments = clist[i].node->moments;
+      n.offset = tp->decodeOffset(clist[i].offsetID);
+      fwrite(&n, sizeof(n), 1, fp);
+    }
+  }
+  for(int level = 0; level <= maxlevel; level++){
+    if(hasRemoteLists){
+      ArenaList<RemotePartInfo> &rpilist = state->rplists[level];
+      for(unsigned int i = 0; i < rpilist.length(); i++){
+        for(int j = 0; j < rpilist[i].numParticles; j++){
+          ILSource s;
+          s.part = rpilist[i].particles[j];
+          s.offset = rpilist[i].offset;
+          s.bLocal = 0;
+          fwrite(&s, sizeof(s), 1, fp);
+        }
+      }
+    }
+    if(hasLocalLists){
+      ArenaList<LocalPartInfo> &lpilist = state->lplists[level];
+      for(unsigned int i = 0; i < lpilist.length(); i++){
+        for(int j = 0; j < lpilist[i].numParticles; j++){
+          ILSource s;
+          s.part = lpilist[i].particles[j];
+          s.offset = lpilist[i].offset;
+          s.bLocal = 1;
+          fwrite(&s, sizeof(s), 1, fp);
+        }
+      }
+    }
+  }
+}
+
+/// @brief Streaming version of stateReady()
+/// The node and particle lists for levels up to state->lowestNode
+/// are the same for every bucket in the range, so they are packed
+/// into structure of arrays form once and then evaluated against
+/// the packed active particles of each bucket.
+void ListCompute::stateReadySoA(DoubleWalkState *state, TreePiece *tp,
+                                int chunk, int start, int end){
+  GravityParticle *particles = tp->getParticles();
+  GenericTreeNode *lowestNode = state->lowestNode;
+  int maxlevel = lowestNode->getLevel(lowestNode->getKey());
+
+  bool hasRemoteLists = state->rplists != NULL;
+  bool hasLocalLists = state->lplists != NULL;
+
+  // The buffers live as long as the walk state, so after the first
+  // few bucket ranges of a walk packing is a sized copy into storage
+  // that is already allocated.
+  if(state->soa == NULL)
+    state->soa = new InteractionListSoA;
+  InteractionListSoA &soa = *state->soa;
+
+  int nNodes = 0;
+  int nLocalParts = 0;
+  int nRemoteParts = 0;
+  for(int level = 0; level <= maxlevel; level++){
+    nNodes += state->clists[level].length();
+    if(hasRemoteLists){
+      ArenaList<RemotePartInfo> &rpilist = state->rplists[level];
+      for(unsigned int i = 0; i < rpilist.length(); i++)
+        nRemoteParts += rpilist[i].numParticles;
+    }
+    if(hasLocalLists){
+      ArenaList<LocalPartInfo> &lpilist = state->lplists[level];
+      for(unsigned int i = 0; i < lpilist.length(); i++)
+        nLocalParts += lpilist[i].numParticles;
+    }
+  }
+  soa.nodes.resize(nNodes);
+  soa.remoteParts.resize(nRemoteParts);
+  soa.localParts.resize(nLocalParts);
+
+  int iNode = 0;
+  int iLocal = 0;
+  int iRemote = 0;
+  for(int level = 0; level <= maxlevel; level++){
+    ArenaList<OffsetNode> &clist = state->clists[level];
+    for(unsigned int i = 0; i < clist.length(); i++){
+      soa.nodes.set(iNode++, clist[i].node->moments,
+                    tp->decodeOffset(clist[i].offsetID));
+    }
+    if(hasRemoteLists){
+      ArenaList<RemotePartInfo> &rpilist = state->rplists[level];
+      for(unsigned int i = 0; i < rpilist.length(); i++){
+        RemotePartInfo &rpi = rpilist[i];
+        for(int j = 0; j < rpi.numParticles; j++)
+          soa.remoteParts.set(iRemote++, rpi.particles[j], rpi.offset);
+      }
+    }
+    if(hasLocalLists){
+      ArenaList<LocalPartInfo> &lpilist = state->lplists[level];
+      for(unsigned int i = 0; i < lpilist.length(); i++){
+        LocalPartInfo &lpi = lpilist[i];
+        for(int j = 0; j < lpi.numParticles; j++)
+          soa.localParts.set(iLocal++, lpi.particles[j], lpi.offset);
+      }
+    }
+  }
+
+  for(int b = start; b < end; b++){
+    if(tp->bucketList[b]->rungs >= activeRung){
+      GenericTreeNode *bucket = tp->getBucket(b);
+      soa.targets.load(particles, bucket, activeRung);
+
+      int computed = nodeBucketForceSoA(soa.nodes, bucket, soa.targets);
+      if(getOptType() == Remote){
+        tp->addToNodeInterRemote(chunk, computed);
+      } else if(getOptType() == Local){
+        tp->addToNodeInterLocal(computed);
+      }
+      if(nRemoteParts > 0){
+        computed = partBucketForceSoA(soa.remoteParts, soa.targets);
+        tp->addToParticleInterRemote(chunk, computed);
+      }
+      if(nLocalParts > 0){
+        computed = partBucketForceSoA(soa.localParts, soa.targets);
+        tp->addToParticleInterLocal(computed);
+      }
+      soa.targets.store();
+    }// active
+  }// bucket
+}
 
 /// @brief Check for computation
 /// Computation can be done on buckets indexed from start to end
@@ -1470,8 +1941,8 @@ void ListCompute::stateReady(State *state_, TreePiece *tp, int chunk, int start,
   GenericTreeNode *lowestNode = state->lowestNode;
   int maxlevel = lowestNode->getLevel(lowestNode->getKey());
 
-  bool hasRemoteLists = state->rplists.length() > 0 ? true : false;
-  bool hasLocalLists = state->lplists.length() > 0 ? true : false;
+  bool hasRemoteLists = state->rplists != NULL;
+  bool hasLocalLists = state->lplists != NULL;
 
 #if defined CUDA && COSMO_PRINT_BK > 1
   CkPrintf("[%d]: stateReady(%d-%d) %s, resume: %d\n",  tp->getIndex(), start, end, getOptType() == Remote ? "Remote" : "Local", state->resume);
@@ -1482,12 +1953,18 @@ void ListCompute::stateReady(State *state_, TreePiece *tp, int chunk, int start,
     CmiMemoryCheck();
 #endif
 #ifndef CUDA
+  if(tp->fpInterList != NULL)
+    recordLists(state, tp, start, end);
+  if(bSoAGravity && !bFarFieldFloat){
+    stateReadySoA(state, tp, chunk, start, end);
+    return;
+  }
   for(int b = start; b < end; b++){
     if(tp->bucketList[b]->rungs >= activeRung){
 
       for(int level = 0; level <= maxlevel; level++){
 
-        CkVec<OffsetNode> &clist = state->clists[level];
+        ArenaList<OffsetNode> &clist = state->clists[level];
         int computed;
         computed = calcNodeForces(tp, b, activeRung, clist);
         if(getOptType() == Remote){
@@ -1498,7 +1975,7 @@ void ListCompute::stateReady(State *state_, TreePiece *tp, int chunk, int start,
 
         // remote particles
         if(hasRemoteLists){
-          CkVec<RemotePartInfo> &rpilist = state->rplists[level];
+          ArenaList<RemotePartInfo> &rpilist = state->rplists[level];
           computed = calcParticleForces(tp, b, activeRung, rpilist);
           if(getOptType() == Remote){// don't really have to perform this check
             tp->addToParticleInterRemote(chunk, computed);
@@ -1507,7 +1984,7 @@ void ListCompute::stateReady(State *state_, TreePiece *tp, int chunk, int start,
 
         // local particles
         if(hasLocalLists){
-          CkVec<LocalPartInfo> &lpilist = state->lplists[level];
+          ArenaList<LocalPartInfo> &lpilist = state->lplists[level];
           computed = calcParticleForces(tp, b, activeRung, lpilist);
           tp->addToParticleInterLocal(computed);
         }
@@ -1563,7 +2040,7 @@ void ListCompute::stateReady(State *state_, TreePiece *tp, int chunk, int start,
 
       for(int level = 0; level <= maxlevel; level++){
 
-        CkVec<OffsetNode> &clist = state->clists[level];
+        ArenaList<OffsetNode> &clist = state->clists[level];
         for(int i = 0; i < clist.length(); i++){
           //tmp--;
           GenericTreeNode *node = clist[i].node;
@@ -1591,7 +2068,6 @@ void ListCompute::stateReady(State *state_, TreePiece *tp, int chunk, int start,
           
 #endif
 
-#ifdef HEXADECAPOLE
           GenericTreeNode *bucketNode = tp->bucketList[b];
           if (openSoftening(node, bucketNode,
                             tp->decodeOffset(clist[i].offsetID))) {
@@ -1606,7 +2082,6 @@ void ListCompute::stateReady(State *state_, TreePiece *tp, int chunk, int start,
                             tp->decodeOffset(clist[i].offsetID), activeRung);
             continue;
           }
-#endif
           DoubleWalkState *rrState;
           if(state->resume || (!state->resume && index < 0)){
             CkAssert(getOptType() == Remote);
@@ -1658,7 +2133,7 @@ void ListCompute::stateReady(State *state_, TreePiece *tp, int chunk, int start,
     if(hasRemoteLists){
       for(int level = 0; level <= maxlevel; level++){
         // remote particles
-        CkVec<RemotePartInfo> &rpilist = state->rplists[level];
+        ArenaList<RemotePartInfo> &rpilist = state->rplists[level];
         // for each bunch of particles in list
         for(int i = 0; i < rpilist.length(); i++){
 
@@ -1732,7 +2207,7 @@ void ListCompute::stateReady(State *state_, TreePiece *tp, int chunk, int start,
       if(hasLocalLists){
         if(tp->largePhase()){
           for(int level = 0; level <= maxlevel; level++){
-            CkVec<LocalPartInfo> &lpilist = state->lplists[level];
+            ArenaList<LocalPartInfo> &lpilist = state->lplists[level];
             for(int i = 0; i < lpilist.length(); i++){
               LocalPartInfo &lpi = lpilist[i];
 #if defined CHANGA_REFACTOR_WALKCHECK_INTERLIST || defined CHANGA_REFACTOR_PRINT_INTERACTIONS
@@ -1771,7 +2246,7 @@ void ListCompute::stateReady(State *state_, TreePiece *tp, int chunk, int start,
         }
         else{ // small phase, need to attach particle data to state->particles
           for(int level = 0; level <= maxlevel; level++){
-            CkVec<LocalPartInfo> &lpilist = state->lplists[level];
+            ArenaList<LocalPartInfo> &lpilist = state->lplists[level];
             for(int i = 0; i < lpilist.length(); i++){
               LocalPartInfo &lpi = lpilist[i];
 #if defined CHANGA_REFACTOR_WALKCHECK_INTERLIST || defined CHANGA_REFACTOR_PRINT_INTERACTIONS
@@ -2248,7 +2723,7 @@ void ListCompute::addChildrenToCheckList(GenericTreeNode *node, int reqID, int c
 void printClist(DoubleWalkState *state, int level, TreePiece *tp){
 
   {
-    CkVec<OffsetNode> &list = state->clists[level];
+    ArenaList<OffsetNode> &list = state->clists[level];
     Vector3D<cosmoType> vec;
     for(int i = 0; i < list.length(); i++){
       vec = tp->decodeOffset(list[i].offsetID);
@@ -2256,12 +2731,12 @@ void printClist(DoubleWalkState *state, int level, TreePiece *tp){
     }
   }
 
-  bool hasRemoteLists = state->rplists.length() > 0 ? true : false;
-  bool hasLocalLists = state->lplists.length() > 0 ? true : false;
+  bool hasRemoteLists = state->rplists != NULL;
+  bool hasLocalLists = state->lplists != NULL;
 
   if(hasLocalLists){
     CkPrintf("----------------\n");
-    CkVec<LocalPartInfo> &list = state->lplists[level];
+    ArenaList<LocalPartInfo> &list = state->lplists[level];
     Vector3D<cosmoType> vec;
     for(int i = 0; i < list.length(); i++){
       vec = list[i].offset;
@@ -2271,7 +2746,7 @@ void printClist(DoubleWalkState *state, int level, TreePiece *tp){
 
   if(hasRemoteLists){
     CkPrintf("----------------\n");
-    CkVec<RemotePartInfo> &list = state->rplists[level];
+    ArenaList<RemotePartInfo> &list = state->rplists[level];
     Vector3D<cosmoType> vec;
     for(int i = 0; i < list.length()-1; i++){
       vec = list[i].offset;
@@ -2282,7 +2757,7 @@ void printClist(DoubleWalkState *state, int level, TreePiece *tp){
 
 void printUndlist(DoubleWalkState *state, int level, TreePiece *tp){
     CkPrintf("----------------\n");
-    CkVec<OffsetNode> &list = state->undlists[level];
+    ArenaList<OffsetNode> &list = state->undlists[level];
     Vector3D<cosmoType> vec;
     for(int i = 0; i < list.length()-1; i++){
       vec = tp->decodeOffset(list[i].offsetID);
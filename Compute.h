@@ -5,6 +5,7 @@
 #include "ParallelGravity.h"
 class State;
 class DoubleWalkState;
+class FmmState;
 
 /** @file Compute.h
  * Defines classes for objects that encapsulate computation
@@ -34,8 +35,19 @@ class Compute{
   void *computeEntity;
   int activeRung;
   ComputeType type;
+  /// Where the states are allocated, or NULL for the heap.
+  Arena *arena;
 
-  Compute(ComputeType t) : type(t) /*state(0)*/{}
+  Compute(ComputeType t) : type(t), arena(NULL) /*state(0)*/{}
+
+  /// @brief Uninitialized storage of size bytes for a state.
+  void *stateStorage(size_t size) {
+    return arena != NULL ? arena->allocBytes(size) : ::operator new(size);
+  }
+  /// @brief An array of n counters for a state.
+  int *newCounters(int n) {
+    return arena != NULL ? arena->alloc<int>(n) : new int[n];
+  }
 
   public:
   int nActive;  // accumulate total number of active particles.
@@ -96,6 +108,9 @@ class Compute{
     return computeEntity;
   }
 
+  /// @brief Allocate the states from arena, which the owner of the
+  /// states resets once they are all freed.
+  void setArena(Arena *_arena) { arena = _arena; }
   virtual State *getNewState(int d1, int d2);
   virtual State *getNewState(int d1);
   virtual State *getNewState();
@@ -194,8 +209,12 @@ class ListCompute : public Compute{
 
   void addChildrenToCheckList(GenericTreeNode *node, int reqID, int chunk, int awi, State *s, CheckList &chklist, TreePiece *tp);
   void addNodeToInt(GenericTreeNode *node, int offsetID, DoubleWalkState *s);
+  bool isBucketGroup(GenericTreeNode *node);
 
   DoubleWalkState *allocDoubleWalkState();
+  void stateReadySoA(DoubleWalkState *state, TreePiece *tp, int chunk,
+                     int start, int end);
+  void recordLists(DoubleWalkState *state, TreePiece *tp, int start, int end);
 
 #if defined CHANGA_REFACTOR_PRINT_INTERACTIONS || defined CHANGA_REFACTOR_WALKCHECK_INTERLIST || defined CUDA
   void addRemoteParticlesToInt(ExternalGravityParticle *parts, int n,
@@ -251,6 +270,52 @@ class DummyPrefetchCompute : public PrefetchCompute {
   }
 };
 
+/// @brief Compute for FMM-style cell-cell gravity on the local tree.
+///
+/// The DualTreeWalk presents pairs of local cells (FmmState::target
+/// and FmmState::source).  Well separated pairs add each other's
+/// multipole to their local expansions, pairs of buckets are summed
+/// directly and everything else is split further.  walkDone() pushes
+/// the expansions down the tree and evaluates them at the particles.
+/// The computeEntity is the root of the local tree.
+class FmmCompute : public Compute{
+
+  void pushLocal(FmmState *state, int iCell);
+
+  public:
+  FmmCompute() : Compute(Fmm) {}
+
+  int doWork(GenericTreeNode *, TreeWalk *tw, State *state, int chunk, int reqID, bool isRoot, bool &didcomp, int awi);
+  int openCriterion(TreePiece *ownerTP, GenericTreeNode *node, int reqID, State *state);
+
+  void initState(State *state);
+  void walkDone(State *state);
+  State *getNewState();
+};
+
+/// @brief Compute for mutual gravity on the local tree
+/// (bMutualGravity).
+///
+/// Walked by a DualTreeWalk like FmmCompute, but well separated pairs
+/// of cells apply each other's multipole directly to the particles
+/// beneath them, so no local expansions are needed.  Each pair of
+/// close buckets is summed once with equal and opposite forces,
+/// rather than once from each side as in the bucket walk.
+class MutualCompute : public Compute{
+
+  int cellForce(FmmState *state, int iCell, GenericTreeNode *source,
+                Vector3D<cosmoType> offset, TreePiece *tp);
+
+  public:
+  MutualCompute() : Compute(Mutual) {}
+
+  int doWork(GenericTreeNode *, TreeWalk *tw, State *state, int chunk, int reqID, bool isRoot, bool &didcomp, int awi);
+  int openCriterion(TreePiece *ownerTP, GenericTreeNode *node, int reqID, State *state);
+
+  void initState(State *state);
+  State *getNewState();
+};
+
 /// @brief distingish between the walks that could be running.
 
 enum WalkIndices {
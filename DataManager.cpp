@@ -36,6 +36,7 @@ DataManager::DataManager(CkMigrateMessage *m) : CBase_DataManager(m) {
 
 void DataManager::init() {
   root = NULL;
+  ewaldTable = NULL;
   oldNumChunks = 0;
   chunkRoots = NULL;
 #ifdef CUDA
@@ -55,6 +56,7 @@ void DataManager::init() {
   Cool = CoolInit();
   starLog = new StarLog();
   lockStarLog = CmiCreateLock();
+  nodeFills = new NodeFillStore;
 }
 
 /**
@@ -142,6 +144,23 @@ void DataManager::pup(PUP::er& p) {
     p | treePieces;
 }
 
+const EwaldTable *DataManager::getEwaldTable(int nGrid, double dPeriod,
+                                             int nReplicas, double fEwCut,
+                                             double dEwhCut) {
+  CmiLock(__nodelock);
+  if(ewaldTable == NULL
+     || !ewaldTable->matches(nGrid, dPeriod, nReplicas, fEwCut, dEwhCut)) {
+    delete ewaldTable;
+    double startTime = CkWallTimer();
+    ewaldTable = new EwaldTable(nGrid, dPeriod, nReplicas, fEwCut, dEwhCut);
+    if(verbosity > 1)
+      CkPrintf("[%d] Ewald table of %d^3 built in %g sec\n", CkMyNode(),
+               nGrid + 1, CkWallTimer() - startTime);
+  }
+  CmiUnlock(__nodelock);
+  return ewaldTable;
+}
+
 void DataManager::notifyPresence(Tree::GenericTreeNode *root, TreePiece *tp) {
   CmiLock(__nodelock);
   registeredTreePieces.push_back(TreePieceDescriptor(tp, root));
@@ -252,6 +271,9 @@ void DataManager::combineLocalTrees(CkReductionMsg *msg) {
 #ifdef CUDA
   gpuFree = true;
 #endif
+  // The fills kept were served from the old trees.
+  if (bRetainNodes)
+    nodeFills->clear();
   contribute(*(CkCallback*)msg->getData());
   delete msg;
 }
@@ -454,6 +476,60 @@ void DataManager::resetReadOnly(Parameters param, const CkCallback &cb)
      * Insert any variables that can change due to a restart.
      */
     _cacheLineDepth = param.cacheLineDepth;
+    bSoAGravity = param.bSoAGravity;
+    bFarFieldFloat = param.bFarFieldFloat;
+#if INTERLIST_VER > 0 && !defined(CUDA)
+    bFmmGravity = param.bFmmGravity;
+#else
+    bFmmGravity = 0;
+#endif
+#if INTERLIST_VER > 0 && !defined(CUDA)
+    bMutualGravity = param.bMutualGravity;
+#else
+    bMutualGravity = 0;
+#endif
+    bDepthFirstTree = param.bDepthFirstTree;
+    bRadixSort = param.bRadixSort;
+    bCompactFill = param.bCompactFill;
+#ifndef PUSH_GRAVITY
+    bRetainNodes = param.bRetainNodes;
+#else
+    bRetainNodes = 0;
+#endif
+    dCacheBudget = param.dCacheBudget;
+    bAdaptiveCacheDepth = param.bAdaptiveCacheDepth;
+    if(useTree == Binary_ORB || _cacheLineDepth == 0)
+        bAdaptiveCacheDepth = 0;
+    bHistoryPrefetch = param.bHistoryPrefetch;
+    if(param.dRefitTol <= 0.0 || !_prefetch)
+        bHistoryPrefetch = 0;
+    if(param.iOrder >= 2 && param.iOrder <= 4)
+        iMultipoleOrder = param.iOrder;
+    else
+        iMultipoleOrder = 4;
+#if INTERLIST_VER > 0
+    nBucketGroup = param.nBucketGroup;
+#else
+    nBucketGroup = 0;
+#endif
+    dAccErrTol = param.dAccErrTol;
+#if INTERLIST_VER > 0 && !defined(CUDA)
+    iInterListDump = param.iInterListDump;
+#else
+    iInterListDump = 0;
+#endif
+    nEwaldTable = (param.nEwaldTable > 0 ? param.nEwaldTable : 0);
+    // nPMSlabs is the size of the PMSlab array, so it is kept.
+    nPMGrid = param.nPMGrid;
+    iPMAssign = param.iPMAssign;
+    if(nPMGrid > 0) {
+        dPMSplit = param.dPMAsmth*param.vPeriod.x/nPMGrid;
+        dPMCut = param.dPMRcut*dPMSplit;
+        }
+    else {
+        dPMSplit = 0.0;
+        dPMCut = 0.0;
+        }
     verbosity = param.iVerbosity;
     dExtraStore = param.dExtraStore;
     dMaxBalance = param.dMaxBalance;
@@ -18,6 +18,9 @@
 #endif
 
 
+class EwaldTable;
+class NodeFillStore;
+
 /// @brief Information about TreePieces on an SMP node.
 struct TreePieceDescriptor{
 	TreePiece *treePiece;
@@ -146,6 +149,10 @@ protected:
         /// Lookup table for the chunkRoots
         Tree::NodeLookupType chunkRootTable;
 
+	/// Tabulated Ewald correction shared by the TreePieces of this
+	/// node (see nEwaldTable).
+	EwaldTable *ewaldTable;
+
 public:
 
 	/* 
@@ -159,6 +166,8 @@ public:
 	StarLog *starLog;
 	/// @brief Lock for accessing starlog from TreePieces
 	CmiNodeLock lockStarLog;
+	/// @brief Remote node fills kept across tree walks (bRetainNodes)
+	NodeFillStore *nodeFills;
 
 	DataManager(const CkArrayID& treePieceID);
 	DataManager(CkMigrateMessage *);
@@ -198,9 +207,11 @@ public:
     		}
     	    nodeTable.clear();
 
+	    delete ewaldTable;
 	    CoolFinalize(Cool);
 	    delete starLog;
 	    CmiDestroyLock(lockStarLog);
+	    delete nodeFills;
 	    }
 
 	/// Called by ORB Sorter, save the list of which TreePiece is
@@ -217,6 +228,11 @@ public:
 	/// @param bins number of particles in each interval.
 	void acceptFinalKeys(const SFC::Key* keys, const int* responsible, uint64_t* bins, const int n, const CkCallback& cb);
 	void pup(PUP::er& p);
+	/// @brief Get the tabulated Ewald correction for this node,
+	/// building it on first use or if the box has changed.
+	const EwaldTable *getEwaldTable(int nGrid, double dPeriod,
+					int nReplicas, double fEwCut,
+					double dEwhCut);
 
 #ifdef CUDA
         /*
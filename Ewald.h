@@ -0,0 +1,585 @@
+/** @file Ewald.h
+ * Per particle evaluation of the Ewald summation, shared by
+ * TreePiece::BucketEwald() and the gravity kernel benchmark.
+ * First implemented by Thomas Quinn and Joachim Stadel in PKDGRAV.
+ */
+
+#ifndef EWALD_H
+#define EWALD_H
+
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+#include "MultipoleMoments.h"
+
+/* IBM brain damage */
+#undef hz
+/// @brief Coefficients for the Fourier space part of the Ewald sum.
+typedef struct ewaldTable {
+  double hx,hy,hz;
+  double hCfac,hSfac;
+  int ihx,ihy,ihz;	///< integer wave vector, for EwaldSum::evalBatch()
+} EWT;
+
+/// Particles per call of the Fourier space loop in EwaldSum::evalBatch().
+const int EWALD_BATCH = 16;
+/// Largest wave vector component evalBatch() tabulates phases for;
+/// tables with larger ones (dEwhCut > EWALD_HMAX) use sin() and cos().
+const int EWALD_HMAX = 8;
+
+/// @brief Moments of a multipole expansion contracted with
+/// (dx,dy,dz); used to set up the Fourier space table.
+inline
+void QEVAL(const MOMC &mom, double gam[], double dx, double dy,
+		  double dz, double &ax, double &ay, double &az, double &fPot)
+{
+    double Qmirx,Qmiry,Qmirz,Qmir,Qta;
+    Qta = 0.0;
+    Qmirx = (1.0/6.0)*(mom.xzzz*dz*dz*dz + 3*mom.xyzz*dy*dz*dz + 3*mom.xyyz*dy*dy*dz + mom.xyyy*dy*dy*dy + 3*mom.xxzz*dx*dz*dz + 6*mom.xxyz*dx*dy*dz + 3*mom.xxyy*dx*dy*dy + 3*mom.xxxz*dx*dx*dz + 3*mom.xxxy*dx*dx*dy + mom.xxxx*dx*dx*dx);
+    Qmiry = (1.0/6.0)*(mom.yzzz*dz*dz*dz + 3*mom.xyzz*dx*dz*dz + 3*mom.xxyz*dx*dx*dz + mom.xxxy*dx*dx*dx + 3*mom.yyzz*dy*dz*dz + 6*mom.xyyz*dx*dy*dz + 3*mom.xxyy*dx*dx*dy + 3*mom.yyyz*dy*dy*dz + 3*mom.xyyy*dx*dy*dy + mom.yyyy*dy*dy*dy);
+    Qmirz = (1.0/6.0)*(mom.yyyz*dy*dy*dy + 3*mom.xyyz*dx*dy*dy + 3*mom.xxyz*dx*dx*dy + mom.xxxz*dx*dx*dx + 3*mom.yyzz*dy*dy*dz + 6*mom.xyzz*dx*dy*dz + 3*mom.xxzz*dx*dx*dz + 3*mom.yzzz*dy*dz*dz + 3*mom.xzzz*dx*dz*dz + mom.zzzz*dz*dz*dz);
+    Qmir = (1.0/4.0)*(Qmirx*dx + Qmiry*dy + Qmirz*dz);
+    fPot -= gam[4]*Qmir;
+    Qta += gam[5]*Qmir;
+    ax += gam[4]*Qmirx;
+    ay += gam[4]*Qmiry;
+    az += gam[4]*Qmirz;
+    Qmirx = (1.0/2.0)*(mom.xzz*dz*dz + 2*mom.xyz*dy*dz + mom.xyy*dy*dy + 2*mom.xxz*dx*dz + 2*mom.xxy*dx*dy + mom.xxx*dx*dx);
+    Qmiry = (1.0/2.0)*(mom.yzz*dz*dz + 2*mom.xyz*dx*dz + mom.xxy*dx*dx + 2*mom.yyz*dy*dz + 2*mom.xyy*dx*dy + mom.yyy*dy*dy);
+    Qmirz = (1.0/2.0)*(mom.yyz*dy*dy + 2*mom.xyz*dx*dy + mom.xxz*dx*dx + 2*mom.yzz*dy*dz + 2*mom.xzz*dx*dz + mom.zzz*dz*dz);
+    Qmir = (1.0/3.0)*(Qmirx*dx + Qmiry*dy + Qmirz*dz);
+    fPot -= gam[3]*Qmir;
+    Qta += gam[4]*Qmir;
+    ax += gam[3]*Qmirx;
+    ay += gam[3]*Qmiry;
+    az += gam[3]*Qmirz;
+    Qmirx = (1.0/1.0)*(mom.xz*dz + mom.xy*dy + mom.xx*dx);
+    Qmiry = (1.0/1.0)*(mom.yz*dz + mom.xy*dx + mom.yy*dy);
+    Qmirz = (1.0/1.0)*(mom.yz*dy + mom.xz*dx + mom.zz*dz);
+    Qmir = (1.0/2.0)*(Qmirx*dx + Qmiry*dy + Qmirz*dz);
+    fPot -= gam[2]*Qmir;
+    Qta += gam[3]*Qmir;
+    ax += gam[2]*Qmirx;
+    ay += gam[2]*Qmiry;
+    az += gam[2]*Qmirz;
+    fPot -= gam[0]*mom.m;
+    Qta += gam[1]*mom.m;
+    ax -= dx*Qta;
+    ay -= dy*Qta;
+    az -= dz*Qta;
+}
+
+/// @brief Root moments and constants of the Ewald sum, set up once
+/// per bucket.
+class EwaldSum {
+ public:
+    MOMC mom;			///< complete moments of the root
+    double Q4xx,Q4xy,Q4xz,Q4yy,Q4yz,Q4zz,Q4,Q3x,Q3y,Q3z;
+    double totalMass;
+    Vector3D<cosmoType> cm;
+    double Q2;
+    double L,fEwCut2,fInner2,alpha,alpha2,k1,ka;
+    int nReps,nEwReps;
+
+    /// @param momc Complete moments of the root
+    /// @param root Moments of the root
+    /// @param dPeriod Box size
+    /// @param nReplicas Number of replicas done by the tree walk
+    /// @param fEwCut Real space cutoff in box sizes
+    EwaldSum(const MOMC &momc, const MultipoleMoments &root, double dPeriod,
+	     int nReplicas, double fEwCut) : mom(momc) {
+	totalMass = root.totalMass;
+	cm = root.cm;
+	/*
+	 ** Set up traces of the complete multipole moments.
+	 */
+        Q4xx = 0.5*(mom.xxxx + mom.xxyy + mom.xxzz);
+        Q4xy = 0.5*(mom.xxxy + mom.xyyy + mom.xyzz);
+        Q4xz = 0.5*(mom.xxxz + mom.xyyz + mom.xzzz);
+        Q4yy = 0.5*(mom.xxyy + mom.yyyy + mom.yyzz);
+        Q4yz = 0.5*(mom.xxyz + mom.yyyz + mom.yzzz);
+        Q4zz = 0.5*(mom.xxzz + mom.yyzz + mom.zzzz);
+        Q4 = 0.25*(Q4xx + Q4yy + Q4zz);
+        Q3x = 0.5*(mom.xxx + mom.xyy + mom.xzz);
+        Q3y = 0.5*(mom.xxy + mom.yyy + mom.yzz);
+        Q3z = 0.5*(mom.xxz + mom.yyz + mom.zzz);
+	Q2 = 0.5*(mom.xx + mom.yy + mom.zz);
+
+	nReps = nReplicas;
+	nEwReps = (int) ceil(fEwCut);
+	L = dPeriod;
+	fEwCut2 = fEwCut*fEwCut*L*L;
+	fInner2 = 1.2e-3*L*L;
+	nEwReps = nEwReps > nReps ? nEwReps : nReps;
+	alpha = 2.0/L;
+	alpha2 = alpha*alpha;
+	k1 = M_PI/(alpha2*L*L*L);
+	ka = 2.0*alpha/sqrt(M_PI);
+	}
+
+    /// @brief Ewald correction for a particle at pos.
+    /// @param ewt Fourier space table, nEwhLoop entries
+    /// @return number of real space terms evaluated
+    inline int evalParticle(const Vector3D<cosmoType> &pos, const EWT *ewt,
+			    int nEwhLoop, double &fPot, double &ax,
+			    double &ay, double &az) const;
+    /// @brief Ewald correction for n <= EWALD_BATCH particles at
+    /// (x,y,z).  The Fourier space loop runs over the particles for
+    /// each wave vector, with the phases built from one sincos per
+    /// particle and dimension by angle addition.
+    /// @return number of real space terms evaluated
+    inline int evalBatch(int n, const double *x, const double *y,
+			 const double *z, const EWT *ewt, int nEwhLoop,
+			 double *fPot, double *ax, double *ay,
+			 double *az) const;
+    /// @brief Real space part of the correction at separation
+    /// (dx,dy,dz) from the root's center of mass.
+    /// @return number of terms evaluated
+    inline int evalReal(double dx, double dy, double dz, double &fPot,
+			double &ax, double &ay, double &az) const;
+    /// @brief Fill the Fourier space table for wave vectors out to
+    /// dEwhCut.  ewt is grown (doubling nMaxEwhLoop) as needed.
+    /// @return number of entries (nEwhLoop)
+    inline int fillTable(double dEwhCut, EWT *&ewt, int &nMaxEwhLoop) const;
+};
+
+inline int EwaldSum::evalParticle(const Vector3D<cosmoType> &pos,
+				  const EWT *ewt, int nEwhLoop, double &fPot,
+				  double &ax, double &ay, double &az) const
+{
+	double dx,dy,dz,hdotx,s,c;
+	int i,nLoop;
+
+	dx = pos.x - cm.x;
+	dy = pos.y - cm.y;
+	dz = pos.z - cm.z;
+	nLoop = evalReal(dx, dy, dz, fPot, ax, ay, az);
+	/*
+	 ** Scoring for the h-loop (+,*)
+	 ** 	Without trig = (10,14)
+	 **	    Trig est.	 = 2*(6,11)  same as 1/sqrt scoring.
+	 **		Total        = (22,36)
+	 **					 = 58
+	 */
+	for (i=0;i<nEwhLoop;++i) {
+		hdotx = ewt[i].hx*dx + ewt[i].hy*dy + ewt[i].hz*dz;
+		c = cos(hdotx);
+		s = sin(hdotx);
+		fPot += ewt[i].hCfac*c + ewt[i].hSfac*s;
+		ax += ewt[i].hx*(ewt[i].hCfac*s - ewt[i].hSfac*c);
+		ay += ewt[i].hy*(ewt[i].hCfac*s - ewt[i].hSfac*c);
+		az += ewt[i].hz*(ewt[i].hCfac*s - ewt[i].hSfac*c);
+		}
+	return nLoop;
+}
+
+inline int EwaldSum::evalBatch(int n, const double *px, const double *py,
+			       const double *pz, const EWT *ewt,
+			       int nEwhLoop, double *fPot, double *ax,
+			       double *ay, double *az) const
+{
+	/* phases exp(i*h*2pi/L*d) for h = -hMax..hMax, by particle */
+	double ec[3][2*EWALD_HMAX+1][EWALD_BATCH];
+	double es[3][2*EWALD_HMAX+1][EWALD_BATCH];
+	double d[3][EWALD_BATCH];
+	int i,j,h,k,hMax,nLoop;
+
+	nLoop = 0;
+	for (j=0;j<n;++j) {
+		d[0][j] = px[j] - cm.x;
+		d[1][j] = py[j] - cm.y;
+		d[2][j] = pz[j] - cm.z;
+		nLoop += evalReal(d[0][j], d[1][j], d[2][j], fPot[j],
+				  ax[j], ay[j], az[j]);
+		}
+	hMax = 0;
+	for (i=0;i<nEwhLoop;++i) {
+		hMax = std::max(hMax, abs(ewt[i].ihx));
+		hMax = std::max(hMax, abs(ewt[i].ihy));
+		hMax = std::max(hMax, abs(ewt[i].ihz));
+		}
+	if (hMax > EWALD_HMAX) {
+		for (j=0;j<n;++j) {
+			for (i=0;i<nEwhLoop;++i) {
+				double hdotx = ewt[i].hx*d[0][j]
+				    + ewt[i].hy*d[1][j] + ewt[i].hz*d[2][j];
+				double c = cos(hdotx);
+				double s = sin(hdotx);
+				double t = ewt[i].hCfac*s - ewt[i].hSfac*c;
+				fPot[j] += ewt[i].hCfac*c + ewt[i].hSfac*s;
+				ax[j] += ewt[i].hx*t;
+				ay[j] += ewt[i].hy*t;
+				az[j] += ewt[i].hz*t;
+				}
+			}
+		return nLoop;
+		}
+	/*
+	 ** Angle addition: exp(i*(h+1)*t) = exp(i*h*t)*exp(i*t), and
+	 ** exp(-i*h*t) is the conjugate.
+	 */
+	for (k=0;k<3;++k) {
+		double *c0 = ec[k][hMax];
+		double *s0 = es[k][hMax];
+		for (j=0;j<n;++j) {
+			c0[j] = 1.0;
+			s0[j] = 0.0;
+			}
+		if (hMax == 0) continue;
+		double *c1 = ec[k][hMax+1];
+		double *s1 = es[k][hMax+1];
+		for (j=0;j<n;++j) {
+			double t = 2*M_PI/L*d[k][j];
+			c1[j] = cos(t);
+			s1[j] = sin(t);
+			}
+		for (h=2;h<=hMax;++h) {
+			const double *cp = ec[k][hMax+h-1];
+			const double *sp = es[k][hMax+h-1];
+			double *ch = ec[k][hMax+h];
+			double *sh = es[k][hMax+h];
+			for (j=0;j<n;++j) {
+				ch[j] = cp[j]*c1[j] - sp[j]*s1[j];
+				sh[j] = sp[j]*c1[j] + cp[j]*s1[j];
+				}
+			}
+		for (h=1;h<=hMax;++h) {
+			for (j=0;j<n;++j) {
+				ec[k][hMax-h][j] = ec[k][hMax+h][j];
+				es[k][hMax-h][j] = -es[k][hMax+h][j];
+				}
+			}
+		}
+	/*
+	 ** The inner loop is over particles with unit stride, so it
+	 ** vectorizes.
+	 */
+	for (i=0;i<nEwhLoop;++i) {
+		const double *cx = ec[0][hMax+ewt[i].ihx];
+		const double *sx = es[0][hMax+ewt[i].ihx];
+		const double *cy = ec[1][hMax+ewt[i].ihy];
+		const double *sy = es[1][hMax+ewt[i].ihy];
+		const double *cz = ec[2][hMax+ewt[i].ihz];
+		const double *sz = es[2][hMax+ewt[i].ihz];
+		const double hx = ewt[i].hx;
+		const double hy = ewt[i].hy;
+		const double hz = ewt[i].hz;
+		const double hCfac = ewt[i].hCfac;
+		const double hSfac = ewt[i].hSfac;
+		for (j=0;j<n;++j) {
+			double cxy = cx[j]*cy[j] - sx[j]*sy[j];
+			double sxy = sx[j]*cy[j] + cx[j]*sy[j];
+			double c = cxy*cz[j] - sxy*sz[j];
+			double s = sxy*cz[j] + cxy*sz[j];
+			double t = hCfac*s - hSfac*c;
+			fPot[j] += hCfac*c + hSfac*s;
+			ax[j] += hx*t;
+			ay[j] += hy*t;
+			az[j] += hz*t;
+			}
+		}
+	return nLoop;
+}
+
+inline int EwaldSum::evalReal(double dx, double dy, double dz, double &fPot,
+			      double &ax, double &ay, double &az) const
+{
+	double xx,xxx,xxy,xxz,yy,yyy,yyz,xyy,zz,zzz,xzz,yzz,xy,xyz,xz,yz;
+	double Q4mirx,Q4miry,Q4mirz,Q4mir,Q4x,Q4y,Q4z;
+	double Q3mirx,Q3miry,Q3mirz,Q3mir;
+	const double onethird = 1.0/3.0;
+	double alphan;
+	double x,y,z,r2,dir,dir2,a;
+	double Q2mirx,Q2miry,Q2mirz,Q2mir,Qta;
+	double g0,g1,g2,g3,g4,g5;
+	int ix,iy,iz,bInHole,bInHolex,bInHolexy;
+	int nLoop = 0;
+
+	fPot = totalMass*k1;
+	ax = 0.0;
+	ay = 0.0;
+	az = 0.0;
+	for (ix=-nEwReps;ix<=nEwReps;++ix) {
+		bInHolex = (ix >= -nReps && ix <= nReps);
+		x = dx + ix*L;
+		for(iy=-nEwReps;iy<=nEwReps;++iy) {
+			bInHolexy = (bInHolex && iy >= -nReps && iy <= nReps);
+			y = dy + iy*L;
+			for(iz=-nEwReps;iz<=nEwReps;++iz) {
+				bInHole = (bInHolexy && iz >= -nReps && iz <= nReps);
+				/*
+				 ** Scoring for Ewald inner stuff = (+,*)
+				 **		Visible ops 		= (104,161)
+				 **		sqrt, 1/sqrt est. 	= (6,11)
+				 **     division            = (6,11)  same as sqrt.
+				 **		exp est.			= (6,11)  same as sqrt.
+				 **		erf/erfc est.		= (12,22) twice a sqrt.
+				 **		Total			= (128,205) = 333
+				 **     Old scoring				    = 447
+				 */
+				z = dz + iz*L;
+				r2 = x*x + y*y + z*z;
+				if (r2 > fEwCut2 && !bInHole) continue;
+				if (r2 < fInner2) {
+					/*
+					 * For small r, series expand about
+					 * the origin to avoid errors caused
+					 * by cancellation of large terms.
+					 */
+					alphan = ka;
+					r2 *= alpha2;
+					g0 = alphan*((1.0/3.0)*r2 - 1.0);
+					alphan *= 2*alpha2;
+					g1 = alphan*((1.0/5.0)*r2 - (1.0/3.0));
+					alphan *= 2*alpha2;
+					g2 = alphan*((1.0/7.0)*r2 - (1.0/5.0));
+					alphan *= 2*alpha2;
+					g3 = alphan*((1.0/9.0)*r2 - (1.0/7.0));
+					alphan *= 2*alpha2;
+					g4 = alphan*((1.0/11.0)*r2 - (1.0/9.0));
+					alphan *= 2*alpha2;
+					g5 = alphan*((1.0/13.0)*r2 - (1.0/11.0));
+					}
+				else {
+				    dir = 1/sqrt(r2);
+				    dir2 = dir*dir;
+				    a = exp(-r2*alpha2);
+				    a *= ka*dir2;
+				    if (bInHole) g0 = -erf(alpha/dir);
+				    else g0 = erfc(alpha/dir);
+				    g0 *= dir;
+				    g1 = g0*dir2 + a;
+				    alphan = 2*alpha2;
+				    g2 = 3*g1*dir2 + alphan*a;
+				    alphan *= 2*alpha2;
+				    g3 = 5*g2*dir2 + alphan*a;
+				    alphan *= 2*alpha2;
+					g4 = 7*g3*dir2 + alphan*a;
+				    alphan *= 2*alpha2;
+				    g5 = 9*g4*dir2 + alphan*a;
+				    }
+				xx = 0.5*x*x;
+				xxx = onethird*xx*x;
+				xxy = xx*y;
+				xxz = xx*z;
+				yy = 0.5*y*y;
+				yyy = onethird*yy*y;
+				xyy = yy*x;
+				yyz = yy*z;
+				zz = 0.5*z*z;
+				zzz = onethird*zz*z;
+				xzz = zz*x;
+				yzz = zz*y;
+				xy = x*y;
+				xyz = xy*z;
+				xz = x*z;
+				yz = y*z;
+				Q2mirx = mom.xx*x + mom.xy*y + mom.xz*z;
+				Q2miry = mom.xy*x + mom.yy*y + mom.yz*z;
+				Q2mirz = mom.xz*x + mom.yz*y + mom.zz*z;
+				Q3mirx = mom.xxx*xx + mom.xxy*xy + mom.xxz*xz + mom.xyy*yy + mom.xyz*yz + mom.xzz*zz;
+				Q3miry = mom.xxy*xx + mom.xyy*xy + mom.xyz*xz + mom.yyy*yy + mom.yyz*yz + mom.yzz*zz;
+				Q3mirz = mom.xxz*xx + mom.xyz*xy + mom.xzz*xz + mom.yyz*yy + mom.yzz*yz + mom.zzz*zz;
+				Q4mirx = mom.xxxx*xxx + mom.xxxy*xxy + mom.xxxz*xxz + mom.xxyy*xyy + mom.xxyz*xyz +
+					mom.xxzz*xzz + mom.xyyy*yyy + mom.xyyz*yyz + mom.xyzz*yzz + mom.xzzz*zzz;
+				Q4miry = mom.xxxy*xxx + mom.xxyy*xxy + mom.xxyz*xxz + mom.xyyy*xyy + mom.xyyz*xyz +
+					mom.xyzz*xzz + mom.yyyy*yyy + mom.yyyz*yyz + mom.yyzz*yzz + mom.yzzz*zzz;
+				Q4mirz = mom.xxxz*xxx + mom.xxyz*xxy + mom.xxzz*xxz + mom.xyyz*xyy + mom.xyzz*xyz +
+					mom.xzzz*xzz + mom.yyyz*yyy + mom.yyzz*yyz + mom.yzzz*yzz + mom.zzzz*zzz;
+				Q4x = Q4xx*x + Q4xy*y + Q4xz*z;
+				Q4y = Q4xy*x + Q4yy*y + Q4yz*z;
+				Q4z = Q4xz*x + Q4yz*y + Q4zz*z;
+				Q2mir = 0.5*(Q2mirx*x + Q2miry*y + Q2mirz*z) - (Q3x*x + Q3y*y + Q3z*z) + Q4;
+				Q3mir = onethird*(Q3mirx*x + Q3miry*y + Q3mirz*z) - 0.5*(Q4x*x + Q4y*y + Q4z*z);
+				Q4mir = 0.25*(Q4mirx*x + Q4miry*y + Q4mirz*z);
+				Qta = g1*mom.m - g2*Q2 + g3*Q2mir + g4*Q3mir + g5*Q4mir;
+				fPot -= g0*mom.m - g1*Q2 + g2*Q2mir + g3*Q3mir + g4*Q4mir;
+				ax += g2*(Q2mirx - Q3x) + g3*(Q3mirx - Q4x) + g4*Q4mirx - x*Qta;
+				ay += g2*(Q2miry - Q3y) + g3*(Q3miry - Q4y) + g4*Q4miry - y*Qta;
+				az += g2*(Q2mirz - Q3z) + g3*(Q3mirz - Q4z) + g4*Q4mirz - z*Qta;
+				++nLoop;
+				}
+			}
+		}
+	return nLoop;
+}
+
+inline int EwaldSum::fillTable(double dEwhCut, EWT *&ewt,
+			       int &nMaxEwhLoop) const
+{
+	int i,hReps,hx,hy,hz,h2;
+	double k4;
+	double gam[6],mfacc,mfacs;
+	double ax,ay,az;
+
+	hReps = (int) ceil(dEwhCut);
+	k4 = M_PI*M_PI/(alpha2*L*L);
+	i = 0;
+	for (hx=-hReps;hx<=hReps;++hx) {
+		for (hy=-hReps;hy<=hReps;++hy) {
+			for (hz=-hReps;hz<=hReps;++hz) {
+				h2 = hx*hx + hy*hy + hz*hz;
+				if (h2 == 0) continue;
+				if (h2 > dEwhCut*dEwhCut) continue;
+				if (i == nMaxEwhLoop) {
+				    nMaxEwhLoop *= 2;
+				    /* avoid realloc() */
+				    EWT *ewtTmp = new EWT[nMaxEwhLoop];
+				    assert(ewtTmp != NULL);
+				    for(int j = 0; j < i; j++) {
+					ewtTmp[j] = ewt[j];
+					}
+				    delete[] ewt;
+				    ewt = ewtTmp;
+				    }
+				gam[0] = exp(-k4*h2)/(M_PI*h2*L);
+				gam[1] = 2*M_PI/L*gam[0];
+				gam[2] = -2*M_PI/L*gam[1];
+				gam[3] = 2*M_PI/L*gam[2];
+				gam[4] = -2*M_PI/L*gam[3];
+				gam[5] = 2*M_PI/L*gam[4];
+				gam[1] = 0.0;
+				gam[3] = 0.0;
+				gam[5] = 0.0;
+				ax = 0.0;
+				ay = 0.0;
+				az = 0.0;
+				mfacc = 0.0;
+				QEVAL(mom, gam, hx, hy, hz,
+				      ax, ay, az, mfacc);
+				gam[0] = exp(-k4*h2)/(M_PI*h2*L);
+				gam[1] = 2*M_PI/L*gam[0];
+				gam[2] = -2*M_PI/L*gam[1];
+				gam[3] = 2*M_PI/L*gam[2];
+				gam[4] = -2*M_PI/L*gam[3];
+				gam[5] = 2*M_PI/L*gam[4];
+				gam[0] = 0.0;
+				gam[2] = 0.0;
+				gam[4] = 0.0;
+				ax = 0.0;
+				ay = 0.0;
+				az = 0.0;
+				mfacs = 0.0;
+				QEVAL(mom, gam,hx,hy,hz,
+				      ax,ay,az,mfacs);
+				ewt[i].hx = 2*M_PI/L*hx;
+				ewt[i].hy = 2*M_PI/L*hy;
+				ewt[i].hz = 2*M_PI/L*hz;
+				ewt[i].hCfac = mfacc;
+				ewt[i].hSfac = mfacs;
+				ewt[i].ihx = hx;
+				ewt[i].ihy = hy;
+				ewt[i].ihz = hz;
+				++i;
+				}
+			}
+		}
+	return i;
+}
+
+/// @brief Ewald correction of a unit point mass, tabulated on a grid
+/// (as in GADGET) so that BucketEwald() can interpolate it instead of
+/// doing the real and Fourier space sums for every particle.
+///
+/// The correction of a point mass is even in each coordinate of the
+/// separation and its force is odd, so only separations from 0 to
+/// one box length in each coordinate are stored.  Only the monopole
+/// of the root is used with the table; the higher moments of the
+/// replicas beyond nReps are dropped.
+class EwaldTable {
+    int nGrid;			///< grid intervals per dimension
+    double dDelta;		///< grid spacing
+    double dPeriod;		///< parameters the table was built with
+    int nReplicas;
+    double fEwCut;
+    double dEwhCut;
+    std::vector<double> pot, fx, fy, fz;
+
+    int index(int i, int j, int k) const {
+	return (i*(nGrid + 1) + j)*(nGrid + 1) + k;
+	}
+ public:
+    /// @param n Grid intervals per dimension
+    /// @param dPeriod Box size
+    /// @param nReplicas Number of replicas done by the tree walk
+    /// @param fEwCut Real space cutoff in box sizes
+    /// @param dEwhCut Fourier space cutoff
+    EwaldTable(int n, double dPeriod, int nReplicas, double fEwCut,
+	       double dEwhCut) : nGrid(n), dDelta(dPeriod/n), dPeriod(dPeriod),
+	nReplicas(nReplicas), fEwCut(fEwCut), dEwhCut(dEwhCut) {
+	MultipoleMoments unit;
+	unit.totalMass = 1.0;
+	MOMC momc;
+	momMakeMomc(&momc, 1.0, 0.0, 0.0, 0.0);
+	EwaldSum ew(momc, unit, dPeriod, nReplicas, fEwCut);
+	int nMaxEwhLoop = 100;
+	EWT *ewt = new EWT[nMaxEwhLoop];
+	int nEwhLoop = ew.fillTable(dEwhCut, ewt, nMaxEwhLoop);
+
+	int nTot = (nGrid + 1)*(nGrid + 1)*(nGrid + 1);
+	pot.resize(nTot);
+	fx.resize(nTot);
+	fy.resize(nTot);
+	fz.resize(nTot);
+	for(int i = 0; i <= nGrid; i++)
+	    for(int j = 0; j <= nGrid; j++)
+		for(int k = 0; k <= nGrid; k++) {
+		    Vector3D<cosmoType> pos(i*dDelta, j*dDelta, k*dDelta);
+		    int l = index(i, j, k);
+		    ew.evalParticle(pos, ewt, nEwhLoop, pot[l], fx[l], fy[l],
+				    fz[l]);
+		    }
+	delete[] ewt;
+	}
+
+    /// @brief Was the table built with these parameters?
+    bool matches(int n, double dPer, int nReps, double fCut,
+		 double dHCut) const {
+	return n == nGrid && dPer == dPeriod && nReps == nReplicas
+	    && fCut == fEwCut && dHCut == dEwhCut;
+	}
+    /// @brief Interpolated correction at a particle displaced by dx
+    /// from a unit mass.
+    inline void eval(const Vector3D<cosmoType> &dx, double &fPot,
+		     double &ax, double &ay, double &az) const;
+};
+
+inline void EwaldTable::eval(const Vector3D<cosmoType> &dx, double &fPot,
+			     double &ax, double &ay, double &az) const
+{
+    double x = fabs(dx.x)/dDelta;
+    double y = fabs(dx.y)/dDelta;
+    double z = fabs(dx.z)/dDelta;
+    int i = (int) x;
+    int j = (int) y;
+    int k = (int) z;
+    if(i >= nGrid) i = nGrid - 1;
+    if(j >= nGrid) j = nGrid - 1;
+    if(k >= nGrid) k = nGrid - 1;
+    double u = x - i;
+    double v = y - j;
+    double w = z - k;
+    double w000 = (1-u)*(1-v)*(1-w), w001 = (1-u)*(1-v)*w;
+    double w010 = (1-u)*v*(1-w), w011 = (1-u)*v*w;
+    double w100 = u*(1-v)*(1-w), w101 = u*(1-v)*w;
+    double w110 = u*v*(1-w), w111 = u*v*w;
+    int l000 = index(i, j, k);
+    int l010 = index(i, j + 1, k);
+    int l100 = index(i + 1, j, k);
+    int l110 = index(i + 1, j + 1, k);
+
+#define EWTAB_INTERP(a) (w000*a[l000] + w001*a[l000+1] + w010*a[l010] \
+			 + w011*a[l010+1] + w100*a[l100] + w101*a[l100+1] \
+			 + w110*a[l110] + w111*a[l110+1])
+    fPot = EWTAB_INTERP(pot);
+    ax = EWTAB_INTERP(fx);
+    ay = EWTAB_INTERP(fy);
+    az = EWTAB_INTERP(fz);
+#undef EWTAB_INTERP
+    if(dx.x < 0.0) ax = -ax;
+    if(dx.y < 0.0) ay = -ay;
+    if(dx.z < 0.0) az = -az;
+}
+
+#endif
@@ -35,9 +35,6 @@ typedef struct {
 /** @brief CUDA version of complete MultipoleMoments for Ewald
  */
 typedef struct {
-#ifndef HEXADECAPOLE
-  cudatype xx, xy, xz, yy, yz, zz; 
-#endif
   cudatype totalMass; 
   cudatype cmx, cmy, cmz; 
 
@@ -18,6 +18,8 @@
 #include "OrientedBox.h"
 #include "MultipoleMoments.h"
 #include "keytype.h"
+#include "NodeKeyTable.h"
+#include "Arena.h"
 #include "GravityParticle.h"
 
 namespace Tree {
@@ -71,6 +73,7 @@ class NodePool;
 #if COSMO_STATS > 0
       used = false;
 #endif
+      accOldMin = 0;
 #if INTERLIST_VER > 0
       numBucketsBeneath=0;
       startBucket=-1;
@@ -120,6 +123,12 @@ class NodePool;
     /// means faster). This information is limited to the nodes in the current
     /// TreePiece, and do not consider non-local data.
     int rungs;
+    /// Smallest |treeAcceleration| from the previous step of the
+    /// active particles in this node, for the relative opening
+    /// criterion (dAccErrTol).  Zero if not known, FLT_MAX if the node
+    /// has no active particles.  Like rungs, this is only set for
+    /// nodes of the current TreePiece.
+    cosmoType accOldMin;
 
 #if INTERLIST_VER > 0
     /// @brief Number of buckets in this node
@@ -148,6 +157,7 @@ class NodePool;
     /// @param last  Last particle index
     /// @param p Parent node
     GenericTreeNode(NodeKey k, NodeType type, int first, int last, GenericTreeNode *p) : myType(type), key(k), parent(p), firstParticle(first), lastParticle(last), remoteIndex(0) {
+      accOldMin = 0;
 #if INTERLIST_VER > 0
       numBucketsBeneath=0;
       startBucket=-1;
@@ -245,6 +255,8 @@ class NodePool;
       if(particleCount > 1)
 	  calculateRadiusFarthestParticle(moments, &part[firstParticle],
 					  &part[lastParticle+1]);
+      else
+	  moments.makeFloat();
     }
 
     /// @brief initialize an empty node
@@ -321,13 +333,21 @@ class NodePool;
 class BinaryTreeNode;
 
 /// Utility to pool allocations of tree nodes
+///
+/// The blocks come from the heap, or from an Arena if one is given,
+/// in which case they are released with the Arena rather than with
+/// the pool.
 class NodePool {
     int next;
     int szPool;
-    /// list of allocated pool blocks.
+    /// block nodes are given out from
+    BinaryTreeNode *block;
+    /// list of pool blocks allocated from the heap.
     std::list<BinaryTreeNode *> pools;
+    Arena *arena;
+    BinaryTreeNode *alloc_raw(int n);
 public:
-    NodePool() {
+    NodePool(Arena *_arena = NULL) : block(NULL), arena(_arena) {
         next = szPool = 128;  // Determines the size of the pools
     }
     ~NodePool();
@@ -335,13 +355,19 @@ public:
     BinaryTreeNode *alloc_one();
     BinaryTreeNode *alloc_one(NodeKey k, NodeType type, int first,
 			      int nextlast, BinaryTreeNode *p);
+    /// give out n contiguous nodes in a block of their own.
+    BinaryTreeNode *alloc_block(int n);
+    /// take over the heap blocks of another pool, leaving it empty.
+    void adopt(NodePool &other) {
+        pools.splice(pools.end(), other.pools);
+        other.next = other.szPool;
+    }
 
     };
 
   /** A table of the nodes in my tree, indexed by their keys.
-      @todo XXX: Make this lookup a hash table, so we get O(1) behavior instead of O(log N).
   */
-  typedef std::map<NodeKey, GenericTreeNode *> NodeLookupType;
+  typedef NodeKeyTable<GenericTreeNode *> NodeLookupType;
 
   /** @brief A TreeNode with two children */
   class BinaryTreeNode : public GenericTreeNode {
@@ -858,14 +884,35 @@ NodePool::~NodePool() {
             }
         }
 
+/// storage for n nodes; the arena's nodes are constructed on use.
+inline BinaryTreeNode *
+NodePool::alloc_raw(int n) {
+        if(arena != NULL)
+            return arena->alloc<BinaryTreeNode>(n);
+        BinaryTreeNode *nodes = new BinaryTreeNode[n];
+        pools.push_back(nodes);
+        return nodes;
+        }
+
 inline BinaryTreeNode *
 NodePool::alloc_one() {
         if(next >= szPool) { // need new pool block
-            BinaryTreeNode *nodes = new BinaryTreeNode[szPool];
+            block = alloc_raw(szPool);
             next = 0;
-            pools.push_front(nodes);
             }
-        return &pools.front()[next++];
+        BinaryTreeNode *one = &block[next++];
+        if(arena != NULL)
+            new (one) BinaryTreeNode();
+        return one;
+        }
+
+inline BinaryTreeNode *
+NodePool::alloc_block(int n) {
+        BinaryTreeNode *nodes = alloc_raw(n);
+        if(arena != NULL)
+            for(int i = 0; i < n; i++)
+                new (&nodes[i]) BinaryTreeNode();
+        return nodes;
         }
 
 inline BinaryTreeNode *
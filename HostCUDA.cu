@@ -18,9 +18,7 @@
 #include <assert.h>
 
 #include "CudaFunctions.h"
-#ifdef HEXADECAPOLE
 # include "CUDAMoments.cu"
-#endif
 #include "HostCUDA.h"
 #include "EwaldCUDA.h"
 
@@ -1446,7 +1444,6 @@ __device__ __forceinline__ void ldg_moments(CudaMultipoleMoments &m, CudaMultipo
   m.cm.x   = __ldg(&(ptr->cm.x));
   m.cm.y   = __ldg(&(ptr->cm.y));
   m.cm.z   = __ldg(&(ptr->cm.z));
-#ifdef HEXADECAPOLE
   m.xx   = __ldg(&(ptr->xx));
   m.xy   = __ldg(&(ptr->xy));
   m.xz   = __ldg(&(ptr->xz));
@@ -1470,14 +1467,6 @@ __device__ __forceinline__ void ldg_moments(CudaMultipoleMoments &m, CudaMultipo
   m.xxyy   = __ldg(&(ptr->xxyy));        
   m.xxyz   = __ldg(&(ptr->xxyz));        
   m.xyyz   = __ldg(&(ptr->xyyz));  
-#else
-  m.xx   = __ldg(&(ptr->xx));
-  m.xy   = __ldg(&(ptr->xy));
-  m.xz   = __ldg(&(ptr->xz));
-  m.yy   = __ldg(&(ptr->yy));
-  m.yz   = __ldg(&(ptr->yz));
-  m.zz   = __ldg(&(ptr->zz));
-#endif  
 }
 
 // we want to limit register usage to be 72 (by observing nvcc output)
@@ -1581,65 +1570,12 @@ __global__ void nodeGravityComputation(
         if(rsq != 0){
           cudatype dir = rsqrt(rsq);
 
-#if defined(HEXADECAPOLE)
           // CUDA_momEvalFmomrcm(&m[tidx], &r, dir, &acc[TRANSLATE(tidx, tidy)], &pot[TRANSLATE(tidx, tidy)]);
           // idt2[TRANSLATE(tidx, tidy)] = fmax(idt2[TRANSLATE(tidx, tidy)],
           //                                (shared_particle_cores[tidy].mass + m[tidx].totalMass)*dir*dir*dir);
           CUDA_momEvalFmomrcm(&m[tidx], &r, dir, &acc, &pot);
           idt2 = fmax(idt2,
                       (shared_particle_cores[tidy].mass + m[tidx].totalMass)*dir*dir*dir);
-#else
-          cudatype a, b, c, d;
-          cudatype
-            twoh = m[tidx].soft + shared_particle_cores[tidy].soft;
-
-          // SPLINEQ(dir, rsq, twoh, a, b, c, d);
-          // expansion of function below:
-          cudatype u,dih;
-          if (rsq < twoh*twoh) {
-            dih = 2.0/twoh;
-            u = dih/dir;
-            if (u < 1.0) {
-              a = dih*(7.0/5.0 - 2.0/3.0*u*u + 3.0/10.0*u*u*u*u
-                  - 1.0/10.0*u*u*u*u*u);
-              b = dih*dih*dih*(4.0/3.0 - 6.0/5.0*u*u + 1.0/2.0*u*u*u);
-              c = dih*dih*dih*dih*dih*(12.0/5.0 - 3.0/2.0*u);
-              d = 3.0/2.0*dih*dih*dih*dih*dih*dih*dir;
-            }
-            else {
-              a = -1.0/15.0*dir + dih*(8.0/5.0 - 4.0/3.0*u*u + u*u*u
-                  - 3.0/10.0*u*u*u*u + 1.0/30.0*u*u*u*u*u);
-              b = -1.0/15.0*dir*dir*dir + dih*dih*dih*(8.0/3.0 - 3.0*u
-                  + 6.0/5.0*u*u - 1.0/6.0*u*u*u);
-              c = -1.0/5.0*dir*dir*dir*dir*dir + 3.0*dih*dih*dih*dih*dir
-                + dih*dih*dih*dih*dih*(-12.0/5.0 + 1.0/2.0*u);
-              d = -dir*dir*dir*dir*dir*dir*dir
-                + 3.0*dih*dih*dih*dih*dir*dir*dir
-                - 1.0/2.0*dih*dih*dih*dih*dih*dih*dir;
-            }
-          }
-          else {
-            a = dir;
-            b = a*a*a;
-            c = 3.0*b*a*a;
-            d = 5.0*c*a*a;
-          }
-
-          cudatype
-            qirx = m[tidx].xx*r.x + m[tidx].xy*r.y + m[tidx].xz*r.z,
-            qiry = m[tidx].xy*r.x + m[tidx].yy*r.y + m[tidx].yz*r.z,
-            qirz = m[tidx].xz*r.x + m[tidx].yz*r.y + m[tidx].zz*r.z,
-            qir = 0.5*(qirx*r.x + qiry*r.y + qirz*r.z),
-            tr = 0.5*(m[tidx].xx + m[tidx].yy + m[tidx].zz),
-            qir3 = b*m[tidx].totalMass + d*qir - c*tr;
-
-          pot -= m[tidx].totalMass * a + c*qir - b*tr;
-          acc.x -= qir3*r.x - c*qirx;
-          acc.y -= qir3*r.y - c*qiry;
-          acc.z -= qir3*r.z - c*qirz;
-          idt2 = fmax(idt2, (shared_particle_cores[tidy].mass + m[tidx].totalMass)*b);
-
-#endif
         }// end if rsq != 0
       }// end INTERACT
     }// end for each NODE group
@@ -2531,7 +2467,6 @@ __global__ void EwaldKernel(CompactPartData *particleCores,
   cudatype Q2, Q2mirx, Q2miry, Q2mirz, Q2mir, Qta; 
   int ix, iy, iz, bInHole, bInHolex, bInHolexy;
 
-#ifdef HEXADECAPOLE
   MomcData *mom = &(cachedData->momcRoot);
   MultipoleMomentsData *momQuad = &(cachedData->mm);
   cudatype xx,xxx,xxy,xxz,yy,yyy,yyz,xyy,zz,zzz,xzz,yzz,xy,xyz,xz,yz;
@@ -2539,12 +2474,7 @@ __global__ void EwaldKernel(CompactPartData *particleCores,
   cudatype Q4xx,Q4xy,Q4xz,Q4yy,Q4yz,Q4zz,Q4,Q3x,Q3y,Q3z;
   cudatype Q3mirx,Q3miry,Q3mirz,Q3mir;
   const cudatype onethird = 1.0/3.0;
-#else
-  MultipoleMomentsData *mom;
-  mom = &(cachedData->mm);
-#endif
 
-#ifdef HEXADECAPOLE
   Q4xx = 0.5*(mom->xxxx + mom->xxyy + mom->xxzz);
   Q4xy = 0.5*(mom->xxxy + mom->xyyy + mom->xyzz);
   Q4xz = 0.5*(mom->xxxz + mom->xyyz + mom->xzzz);
@@ -2555,7 +2485,6 @@ __global__ void EwaldKernel(CompactPartData *particleCores,
   Q3x = 0.5*(mom->xxx + mom->xyy + mom->xzz);
   Q3y = 0.5*(mom->xxy + mom->yyy + mom->yzz);
   Q3z = 0.5*(mom->xxz + mom->yyz + mom->zzz);
-#endif
 
   Q2 = 0.5 * (mom->xx + mom->yy + mom->zz);
 
@@ -2573,17 +2502,10 @@ __global__ void EwaldKernel(CompactPartData *particleCores,
   ay = 0.0f;
   az = 0.0f;
 
-#ifdef HEXADECAPOLE
   xdif = p->position.x - momQuad->cmx; 
   ydif = p->position.y - momQuad->cmy; 
   zdif = p->position.z - momQuad->cmz;
   fPot = momQuad->totalMass*cachedData->k1;
-#else
-  xdif = p->position.x - mom->cmx; 
-  ydif = p->position.y - mom->cmy; 
-  zdif = p->position.z - mom->cmz;
-  fPot = mom->totalMass*cachedData->k1;
-#endif
   for (ix=-(cachedData->nEwReps);ix<=(cachedData->nEwReps);++ix) {  
     bInHolex = (ix >= -cachedData->nReps && ix <= cachedData->nReps);
     x = xdif + ix * cachedData->L;
@@ -2638,7 +2560,6 @@ __global__ void EwaldKernel(CompactPartData *particleCores,
 	  alphan *= 2*cachedData->alpha2;
 	  g5 = 9*g4*dir2 + alphan*a;
         }
-#ifdef HEXADECAPOLE
 	xx = 0.5*x*x;
 	xxx = onethird*xx*x;
 	xxy = xx*y;
@@ -2678,19 +2599,6 @@ __global__ void EwaldKernel(CompactPartData *particleCores,
 	ax += g2*(Q2mirx - Q3x) + g3*(Q3mirx - Q4x) + g4*Q4mirx - x*Qta;
 	ay += g2*(Q2miry - Q3y) + g3*(Q3miry - Q4y) + g4*Q4miry - y*Qta;
 	az += g2*(Q2mirz - Q3z) + g3*(Q3mirz - Q4z) + g4*Q4mirz - z*Qta;
-#else
-        Q2mirx = mom->xx*x + mom->xy*y + mom->xz*z;
-        Q2miry = mom->xy*x + mom->yy*y + mom->yz*z;
-        Q2mirz = mom->xz*x + mom->yz*y + mom->zz*z;
-        Q2mir = 0.5*(Q2mirx*x + Q2miry*y + Q2mirz*z);
-        Qta = g1*mom->totalMass - g2*Q2 + g3*Q2mir;
-        fPot -= g0*mom->totalMass - g1*Q2 + g2*Q2mir;
-
-        ax += g2*(Q2mirx) - x*Qta;
-        ay += g2*(Q2miry) - y*Qta;
-        az += g2*(Q2mirz) - z*Qta;
-
-#endif
       }
     }
   }
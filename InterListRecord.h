@@ -0,0 +1,86 @@
+/** @file InterListRecord.h
+ * Binary layout of the interaction lists recorded with the
+ * iInterListDump parameter (see ListCompute::recordLists()) and
+ * replayed by "gravbench -replay".
+ *
+ * A file starts with an ILHeader and holds one ILRecord for every
+ * call of ListCompute::stateReady().  Each record is followed by its
+ * ILBucket entries, each of them followed by the ILTarget particles
+ * of that bucket, then by its ILNode entries and finally by its
+ * ILSource particles.  The structures are written as they are in
+ * memory, so the reader must be built with the same configuration;
+ * the header allows this to be checked.
+ */
+
+#ifndef INTERLISTRECORD_H
+#define INTERLISTRECORD_H
+
+#include "MultipoleMoments.h"
+#include "GravityParticle.h"
+
+const int IL_MAGIC = 0x494c5354;
+const int IL_VERSION = 1;
+
+/// @brief Start of an interaction list file.
+struct ILHeader {
+    int magic;
+    int version;
+    int sizeofCosmoType;	///< sizeof(cosmoType) of the writer
+    int sizeofMoments;		///< sizeof(MultipoleMoments) of the writer
+    int iTreePiece;		///< TreePiece that wrote the file
+    int activeRung;		///< rung of the gravity calculation
+
+    void init(int iPiece, int iRung) {
+	magic = IL_MAGIC;
+	version = IL_VERSION;
+	sizeofCosmoType = sizeof(cosmoType);
+	sizeofMoments = sizeof(MultipoleMoments);
+	iTreePiece = iPiece;
+	activeRung = iRung;
+    }
+    /// @brief Was the file written by a build like this one?
+    bool compatible() const {
+	return magic == IL_MAGIC && version == IL_VERSION
+	    && sizeofCosmoType == sizeof(cosmoType)
+	    && sizeofMoments == sizeof(MultipoleMoments);
+    }
+};
+
+/// @brief One set of lists and the number of entries that follow.
+struct ILRecord {
+    int bRemote;		///< lists from the remote walk
+    int nBuckets;		///< active buckets the lists apply to
+    int nNodes;			///< cell interactions
+    int nParticles;		///< particle interactions
+};
+
+/// @brief A target bucket; nPart ILTarget entries follow.
+struct ILBucket {
+    int index;			///< bucket number in the TreePiece
+    int nPart;
+    MultipoleMoments moments;
+    OrientedBox<cosmoType> boundingBox;
+};
+
+/// @brief A particle of a target bucket.
+struct ILTarget {
+    Vector3D<cosmoType> position;
+    cosmoType mass;
+    cosmoType soft;
+    int rung;
+};
+
+/// @brief A cell interaction.
+struct ILNode {
+    MultipoleMoments moments;
+    Vector3D<cosmoType> offset;	///< periodic offset of the cell
+};
+
+/// @brief A particle interaction.
+struct ILSource {
+    ExternalGravityParticle part;
+    Vector3D<cosmoType> offset;	///< periodic offset of the particle
+    int bLocal;			///< from this TreePiece
+};
+
+#endif
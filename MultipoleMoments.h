@@ -14,13 +14,178 @@
 
 #include <OrientedBox.h>
 #include <Vector3D.h>
-#ifdef HEXADECAPOLE
 #include "moments.h"
-#endif
 
 #include "SSEdefs.h"
 
-#if CMK_SSE && defined(HEXADECAPOLE) 
+extern int iMultipoleOrder;
+
+/*
+ ** Order templated version of momEvalFmomrcm().  ORDER is the highest
+ ** moment used: 2 (quadrupole), 3 (octopole) or 4 (hexadecapole).
+ ** The reduced moments are always stored to hexadecapole order; the
+ ** terms above ORDER are dropped at compile time so that each
+ ** instantiation is straight line code.  MOM is FMOMR or FMOMRF and T
+ ** is a scalar or SSE type.  ORDER 4 is the same arithmetic as
+ ** momEvalFmomrcm().
+ **
+ ** If fShort is given, the order l radial derivative of the kernel is
+ ** scaled by fShort[l] (see pmShortFactors() in gravity.h), e.g. for
+ ** the short range TreePM force.  The reduced moments carry no traces,
+ ** which only vanish for the Newtonian kernel, so for a cell of size b
+ ** this is accurate to (b/r_s)^2 rather than to ORDER.
+ */
+template <int ORDER, typename MOM, typename T>
+inline
+void momEvalFmomrcmOrder(const MOM *m,T u,T dir,T x,T y,T z,
+			 T *fPot,T *ax,T *ay,T *az,T *magai,
+			 const T *fShort = NULL) {
+    const T onethird = 1.0f/3.0f;
+    T xx,xy,xz,yy,yz,zz;
+    T xxx,xxy,xxz,xyy,yyy,yyz,xyz;
+    T tx,ty,tz,g0,g2,g3,g4;
+
+    u *= dir;
+    g0 = dir;
+    g2 = 3.0f*dir*u*u;
+    if(ORDER >= 3) g3 = 5.0f*g2*u;
+    if(ORDER >= 4) g4 = 7.0f*g3*u;
+    /*
+     ** Calculate the trace-free distance terms.
+     */
+    x *= dir;
+    y *= dir;
+    z *= dir;
+    xx = 0.5f*x*x;
+    xy = x*y;
+    xz = x*z;
+    yy = 0.5f*y*y;
+    yz = y*z;
+    zz = 0.5f*z*z;
+    if(ORDER >= 4) {
+	xxx = x*(onethird*xx - zz);
+	xxz = z*(xx - onethird*zz);
+	yyy = y*(onethird*yy - zz);
+	yyz = z*(yy - onethird*zz);
+	}
+    xx -= zz;
+    yy -= zz;
+    if(ORDER >= 4) {
+	xxy = y*xx;
+	xyy = x*yy;
+	xyz = xy*z;
+	/*
+	 ** Hexadecapole
+	 */
+	tx = T(m->xxxx)*xxx;
+	tx = fmadd(T(m->xyyy), yyy, tx);
+	tx = fmadd(T(m->xxxy), xxy, tx);
+	tx = fmadd(T(m->xxxz), xxz, tx);
+	tx = fmadd(T(m->xxyy), xyy, tx);
+	tx = fmadd(T(m->xxyz), xyz, tx);
+	tx = g4*fmadd(T(m->xyyz), yyz, tx);
+	ty = T(m->xyyy)*xyy;
+	ty = fmadd(T(m->xxxy), xxx, ty);
+	ty = fmadd(T(m->yyyy), yyy, ty);
+	ty = fmadd(T(m->yyyz), yyz, ty);
+	ty = fmadd(T(m->xxyy), xxy, ty);
+	ty = fmadd(T(m->xxyz), xxz, ty);
+	ty = g4*fmadd(T(m->xyyz), xyz, ty);
+	tz = T(m->xxxz)*xxx;
+	tz = fnmadd(T(m->xxxx), xxz, tz);
+	tz = fnmadd(T(m->xyyy + m->xxxy), xyz, tz);
+	tz = fnmadd(T(m->yyyy), yyz, tz);
+	tz = fmadd(T(m->yyyz), yyy, tz);
+	tz = fnmadd(T(m->xxyy), xxz + yyz, tz);
+	tz = fmadd(T(m->xxyz), xxy, tz);
+	tz = g4*fmadd(T(m->xyyz), xyy, tz);
+	g4 = 0.25f*fmadd(tx, x, fmadd(ty, y, tz*z));
+	}
+    if(ORDER >= 3) {
+	/*
+	 ** Octopole
+	 */
+	xxx = T(m->xxx)*xx;
+	xxx = fmadd(T(m->xyy), yy, xxx);
+	xxx = fmadd(T(m->xxy), xy, xxx);
+	xxx = fmadd(T(m->xxz), xz, xxx);
+	xxx = g3*fmadd(T(m->xyz), yz, xxx);
+	xxy = T(m->xyy)*xy;
+	xxy = fmadd(T(m->xxy), xx, xxy);
+	xxy = fmadd(T(m->yyy), yy, xxy);
+	xxy = fmadd(T(m->yyz), yz, xxy);
+	xxy = g3*fmadd(T(m->xyz), xz, xxy);
+	xxz = T(m->xxz)*xx;
+	xxz = fnmadd(T(m->xxx + m->xyy), xz, xxz);
+	xxz = fnmadd(T(m->xxy + m->yyy), yz, xxz);
+	xxz = fmadd(T(m->yyz), yy, xxz);
+	xxz = g3*fmadd(T(m->xyz), xy, xxz);
+	g3 = onethird*fmadd(xxx, x, fmadd(xxy, y, xxz*z));
+	}
+    /*
+     ** Quadrupole
+     */
+    xx = g2*fmadd(T(m->xx), x, fmadd(T(m->xy), y, T(m->xz)*z));
+    xy = g2*fmadd(T(m->yy), y, fmadd(T(m->xy), x, T(m->yz)*z));
+    xz = g2*fnmadd(T(m->xx + m->yy), z, fmadd(T(m->xz), x, T(m->yz)*y));
+    g2 = 0.5f*fmadd(xx, x, fmadd(xy, y, xz*z));
+    g0 *= m->m;
+    if(fShort != NULL) {
+	/*
+	 ** The order l terms of the potential and the tangential force
+	 ** take fShort[l]; their radial force takes fShort[l+1].
+	 */
+	T gPot = fShort[0]*g0 + fShort[2]*g2;
+	T gr = fShort[1]*g0 + 5.0f*fShort[3]*g2;
+	xx *= fShort[2];
+	xy *= fShort[2];
+	xz *= fShort[2];
+	if(ORDER >= 3) {
+	    gPot += fShort[3]*g3;
+	    gr += 7.0f*fShort[4]*g3;
+	    xx += fShort[3]*xxx;
+	    xy += fShort[3]*xxy;
+	    xz += fShort[3]*xxz;
+	    }
+	if(ORDER >= 4) {
+	    gPot += fShort[4]*g4;
+	    gr += 9.0f*fShort[5]*g4;
+	    xx += fShort[4]*tx;
+	    xy += fShort[4]*ty;
+	    xz += fShort[4]*tz;
+	    }
+	*fPot += -gPot;
+	*ax += dir*(xx - x*gr);
+	*ay += dir*(xy - y*gr);
+	*az += dir*(xz - z*gr);
+	*magai = gr*dir;
+	return;
+	}
+    if(ORDER >= 4) {
+	*fPot += -(g0 + g2 + g3 + g4);
+	g0 += fmadd(T(5.0f), g2, fmadd(T(7.0f), g3, 9.0f*g4));
+	*ax = fmadd(dir, fnmadd(x, g0, xx + xxx + tx), *ax);
+	*ay = fmadd(dir, fnmadd(y, g0, xy + xxy + ty), *ay);
+	*az = fmadd(dir, fnmadd(z, g0, xz + xxz + tz), *az);
+	}
+    else if(ORDER == 3) {
+	*fPot += -(g0 + g2 + g3);
+	g0 += fmadd(T(5.0f), g2, 7.0f*g3);
+	*ax = fmadd(dir, fnmadd(x, g0, xx + xxx), *ax);
+	*ay = fmadd(dir, fnmadd(y, g0, xy + xxy), *ay);
+	*az = fmadd(dir, fnmadd(z, g0, xz + xxz), *az);
+	}
+    else {
+	*fPot += -(g0 + g2);
+	g0 = fmadd(T(5.0f), g2, g0);
+	*ax = fmadd(dir, fnmadd(x, g0, xx), *ax);
+	*ay = fmadd(dir, fnmadd(y, g0, xy), *ay);
+	*az = fmadd(dir, fnmadd(z, g0, xz), *az);
+	}
+    *magai = g0*dir;
+    }
+
+#if CMK_SSE
 /*
  ** This is a new fast version of QEVAL which evaluates
  ** the interaction due to the reduced moment 'm'.
@@ -70,10 +235,22 @@ void momEvalMomr(MOMR *m,SSEcosmoType dir0,SSEcosmoType x,SSEcosmoType y,
 	ty = g4*(m->xyyy*xyy + m->xxxy*xxx + m->yyyy*yyy + m->yyyz*yyz + m->xxyy*xxy + m->xxyz*xxz + m->xyyz*xyz);
 	tz = g4*(-m->xxxx*xxz - (m->xyyy + m->xxxy)*xyz - m->yyyy*yyz + m->xxxz*xxx + m->yyyz*yyy - m->xxyy*(xxz + yyz) + m->xxyz*xxy + m->xyyz*xyy);
 	g4 = 0.25*(tx*x + ty*y + tz*z);
-	xxx = g3*(m->xxx*xx + m->xyy*yy + m->xxy*xy + m->xxz*xz + m->xyz*yz);
-	xxy = g3*(m->xyy*xy + m->xxy*xx + m->yyy*yy + m->yyz*yz + m->xyz*xz);
-	xxz = g3*(-(m->xxx + m->xyy)*xz - (m->xxy + m->yyy)*yz + m->xxz*xx + m->yyz*yy + m->xyz*xy);
-	g3 = onethird*(xxx*x + xxy*y + xxz*z);
+	xxx = SSEcosmoType(m->xxx)*xx;
+	xxx = fmadd(SSEcosmoType(m->xyy), yy, xxx);
+	xxx = fmadd(SSEcosmoType(m->xxy), xy, xxx);
+	xxx = fmadd(SSEcosmoType(m->xxz), xz, xxx);
+	xxx = g3*fmadd(SSEcosmoType(m->xyz), yz, xxx);
+	xxy = SSEcosmoType(m->xyy)*xy;
+	xxy = fmadd(SSEcosmoType(m->xxy), xx, xxy);
+	xxy = fmadd(SSEcosmoType(m->yyy), yy, xxy);
+	xxy = fmadd(SSEcosmoType(m->yyz), yz, xxy);
+	xxy = g3*fmadd(SSEcosmoType(m->xyz), xz, xxy);
+	xxz = SSEcosmoType(m->xxz)*xx;
+	xxz = fnmadd(SSEcosmoType(m->xxx + m->xyy), xz, xxz);
+	xxz = fnmadd(SSEcosmoType(m->xxy + m->yyy), yz, xxz);
+	xxz = fmadd(SSEcosmoType(m->yyz), yy, xxz);
+	xxz = g3*fmadd(SSEcosmoType(m->xyz), xy, xxz);
+	g3 = onethird*fmadd(xxx, x, fmadd(xxy, y, xxz*z));
 	xx = g2*(m->xx*x + m->xy*y + m->xz*z);
 	xy = g2*(m->yy*y + m->xy*x + m->yz*z);
 	xz = g2*(-(m->xx + m->yy)*z + m->xz*x + m->yz*y);
@@ -85,79 +262,282 @@ void momEvalMomr(MOMR *m,SSEcosmoType dir0,SSEcosmoType x,SSEcosmoType y,
 	*ay += xy + xxy + ty + y*dir2;
 	*az += xz + xxz + tz + z*dir2;
 	}
+#endif
+
 /*
- ** This is a new fast version of QEVAL which evaluates
- ** the interaction due to the reduced moment 'm'.
- ** This version is nearly two times as fast as a naive
- ** implementation.
- **
- ** March 23, 2007: This function now uses unit vectors
- ** which reduces the required precision in the exponent
- ** since the highest power of r is now 5 (g4 ~ r^(-5)).
- **
- ** OpCount = (*,+) = (106,72) = 178 - 8 = 170
- **
+ ** Single precision copy of the reduced moments, used by the mixed
+ ** precision far field (bFarFieldFloat).
  */
+typedef struct fmomReducedFloat {
+    float m;
+    float xx, yy, xy, xz, yz;
+    float xxx, xyy, xxy, yyy, xxz, yyz, xyz;
+    float xxxx, xyyy, xxxy, yyyy, xxxz, yyyz, xxyy, xxyz, xyyz;
+    } FMOMRF;
+
 inline
-void momEvalFmomrcm(FMOMR *m,SSEcosmoType u,SSEcosmoType dir,SSEcosmoType x,
-		    SSEcosmoType y,SSEcosmoType z,
-		    SSEcosmoType *fPot,SSEcosmoType *ax,SSEcosmoType *ay,
-		    SSEcosmoType *az,SSEcosmoType *magai) {
-    const SSEcosmoType onethird = 1.0f/3.0f;
-    SSEcosmoType xx,xy,xz,yy,yz,zz;
-    SSEcosmoType xxx,xxy,xxz,xyy,yyy,yyz,xyz;
-    SSEcosmoType tx,ty,tz,g0,g2,g3,g4;
+void momFmomr2Fmomrf(const FMOMR *ma, FMOMRF *mf)
+{
+    mf->m = ma->m;
+    mf->xx = ma->xx;
+    mf->yy = ma->yy;
+    mf->xy = ma->xy;
+    mf->xz = ma->xz;
+    mf->yz = ma->yz;
+    mf->xxx = ma->xxx;
+    mf->xyy = ma->xyy;
+    mf->xxy = ma->xxy;
+    mf->yyy = ma->yyy;
+    mf->xxz = ma->xxz;
+    mf->yyz = ma->yyz;
+    mf->xyz = ma->xyz;
+    mf->xxxx = ma->xxxx;
+    mf->xyyy = ma->xyyy;
+    mf->xxxy = ma->xxxy;
+    mf->yyyy = ma->yyyy;
+    mf->xxxz = ma->xxxz;
+    mf->yyyz = ma->yyyz;
+    mf->xxyy = ma->xxyy;
+    mf->xxyz = ma->xxyz;
+    mf->xyyz = ma->xyyz;
+    }
+/*
+ ** Order templated versions of the moment construction functions of
+ ** moments.c, used to build the tree moments.  Only the terms up to
+ ** ORDER (see momEvalFmomrcmOrder()) are computed; momMakeFmomrOrder()
+ ** zeroes the ones above it and the others leave them alone, so a
+ ** tree built at a lower order carries zeros there and neither builds
+ ** nor shifts the higher moments.  ORDER 4 is the same arithmetic as
+ ** the moments.c versions.
+ */
+template <int ORDER>
+inline
+cosmoType momMakeFmomrOrder(FMOMR *mr, cosmoType m, cosmoType u, cosmoType x,
+			    cosmoType y, cosmoType z) {
+    cosmoType tx, ty, t, dx, dy;
+    cosmoType x2;
+    cosmoType y2;
+    cosmoType d2, iu;
 
-    u *= dir;
-    g0 = dir;
-    g2 = 3*dir*u*u;
-    g3 = 5*g2*u;
-    g4 = 7*g3*u;
+    assert(u > 0.0);
+    iu = 1.0f/u;
+    x *= iu;
+    y *= iu;
+    z *= iu;
+    x2 = x*x;
+    y2 = y*y;
+    d2 = x2 + y2 + z*z;
+
+    mr->m = m;
+    tx = m*x;
+    ty = m*y;
     /*
-     ** Calculate the trace-free distance terms.
+     ** Calculate the Quadrupole Moment.
      */
-    x *= dir;
-    y *= dir;
-    z *= dir;
-    xx = 0.5*x*x;
-    xy = x*y;
-    xz = x*z;
-    yy = 0.5*y*y;
-    yz = y*z;
-    zz = 0.5*z*z;
-    xxx = x*(onethird*xx - zz);
-    xxz = z*(xx - onethird*zz);
-    yyy = y*(onethird*yy - zz);
-    yyz = z*(yy - onethird*zz);
-    xx -= zz;
-    yy -= zz;
-    xxy = y*xx;
-    xyy = x*yy;
-    xyz = xy*z;
+    mr->xy = tx*y;
+    mr->xz = tx*z;
+    mr->yz = ty*z;
+    tx *= x;
+    ty *= y;
+    m *= d2;
+    t = (1.0f/3.0f)*m;
+    mr->xx = tx - t;
+    mr->yy = ty - t;
+    if(ORDER >= 3) {
+	/*
+	 ** Calculate the Octopole Moment.
+	 */
+	t = 0.2f*m;
+	dx = tx - t;
+	dy = ty - t;
+	mr->xxy = dx*y;
+	mr->xxz = dx*z;
+	mr->yyz = dy*z;
+	mr->xyy = dy*x;
+	mr->xyz = mr->xy*z;
+	t *= 3.0f;
+	mr->xxx = (tx - t)*x;
+	mr->yyy = (ty - t)*y;
+	}
+    else {
+	mr->xxx = mr->xyy = mr->xxy = mr->yyy = 0;
+	mr->xxz = mr->yyz = mr->xyz = 0;
+	}
+    if(ORDER >= 4) {
+	/*
+	 ** Calculate the Hexadecapole Moment.
+	 */
+	t = (1.0f/7.0f)*m;
+	mr->xxyz = (tx - t)*y*z;
+	mr->xyyz = (ty - t)*x*z;
+	dx = (tx - 3.0f*t)*x;
+	dy = (ty - 3.0f*t)*y;
+	mr->xxxy = dx*y;
+	mr->xxxz = dx*z;
+	mr->xyyy = dy*x;
+	mr->yyyz = dy*z;
+	dx = t*(x2 - 0.1f*d2);
+	dy = t*(y2 - 0.1f*d2);
+	mr->xxxx = tx*x2 - 6.0f*dx;
+	mr->yyyy = ty*y2 - 6.0f*dy;
+	mr->xxyy = tx*y2 - dx - dy;
+	}
+    else {
+	mr->xxxx = mr->xyyy = mr->xxxy = mr->yyyy = mr->xxxz = 0;
+	mr->yyyz = mr->xxyy = mr->xxyz = mr->xyyz = 0;
+	}
+    return(d2);
+    }
+
+/*
+ ** mr += m*ma, with ma rescaled from scale ua to the scale ur of mr.
+ */
+template <int ORDER>
+inline
+void momMulAddFmomrOrder(FMOMR *mr, cosmoType ur, cosmoType m,
+			 const FMOMR *ma, cosmoType ua) {
+    cosmoType f;
+    assert(ua > 0.0 && ur > 0.0);
+    f = ua/ur;
+    mr->m += m*ma->m;
+    m *= f;
+    m *= f;
+    mr->xx += m*ma->xx;
+    mr->yy += m*ma->yy;
+    mr->xy += m*ma->xy;
+    mr->xz += m*ma->xz;
+    mr->yz += m*ma->yz;
+    if(ORDER >= 3) {
+	m *= f;
+	mr->xxx += m*ma->xxx;
+	mr->xyy += m*ma->xyy;
+	mr->xxy += m*ma->xxy;
+	mr->yyy += m*ma->yyy;
+	mr->xxz += m*ma->xxz;
+	mr->yyz += m*ma->yyz;
+	mr->xyz += m*ma->xyz;
+	}
+    if(ORDER >= 4) {
+	m *= f;
+	mr->xxxx += m*ma->xxxx;
+	mr->xyyy += m*ma->xyyy;
+	mr->xxxy += m*ma->xxxy;
+	mr->yyyy += m*ma->yyyy;
+	mr->xxxz += m*ma->xxxz;
+	mr->yyyz += m*ma->yyyz;
+	mr->xxyy += m*ma->xxyy;
+	mr->xxyz += m*ma->xxyz;
+	mr->xyyz += m*ma->xyyz;
+	}
+    }
+
+template <int ORDER>
+inline
+void momRescaleFmomrOrder(FMOMR *mr, cosmoType unew, cosmoType uold) {
+    cosmoType f, s;
+    assert(unew > 0.0);
+    f = uold/unew;
+    s = f*f;
+    mr->xx *= s;
+    mr->yy *= s;
+    mr->xy *= s;
+    mr->xz *= s;
+    mr->yz *= s;
+    if(ORDER >= 3) {
+	s *= f;
+	mr->xxx *= s;
+	mr->xyy *= s;
+	mr->xxy *= s;
+	mr->yyy *= s;
+	mr->xxz *= s;
+	mr->yyz *= s;
+	mr->xyz *= s;
+	}
+    if(ORDER >= 4) {
+	s *= f;
+	mr->xxxx *= s;
+	mr->xyyy *= s;
+	mr->xxxy *= s;
+	mr->yyyy *= s;
+	mr->xxxz *= s;
+	mr->yyyz *= s;
+	mr->xxyy *= s;
+	mr->xxyz *= s;
+	mr->xyyz *= s;
+	}
+    }
+
+/*
+ ** Number of leading FMOMR terms, the mass included, that can be non
+ ** zero at expansion order iOrder.
+ */
+inline
+int momFmomrTerms(int iOrder) {
+    return (iOrder <= 2 ? 6 : (iOrder == 3 ? 13 : 22));
+    }
+
+/*
+ ** Shift the expansion center of m by -<x,y,z>; see momShiftFmomr().
+ */
+template <int ORDER>
+inline
+void momShiftFmomrOrder(FMOMR *m, cosmoType u, cosmoType x, cosmoType y,
+			cosmoType z) {
+    FMOMR f;
+    cosmoType t, tx, ty, tz, txx, tyy, txy, tyz, txz, iu;
+    const cosmoType twosevenths = 2.0f / 7.0f;
+
+    momMakeFmomrOrder<ORDER>(&f,1.0f,u,x,y,z);
+    iu = 1.0f/u;
+    x *= iu;
+    y *= iu;
+    z *= iu;
+    if(ORDER >= 3) {
+	/*
+	 ** Calculate the correction terms.
+	 */
+	tx = 0.4f*(m->xx*x + m->xy*y + m->xz*z);
+	ty = 0.4f*(m->xy*x + m->yy*y + m->yz*z);
+	tz = 0.4f*(m->xz*x + m->yz*y - (m->xx + m->yy)*z);
+	}
+    if(ORDER >= 4) {
+	t = tx*x + ty*y + tz*z;
+	txx = twosevenths*(m->xxx*x + m->xxy*y + m->xxz*z + 2.0f*(m->xx*f.xx + m->xy*f.xy + m->xz*f.xz) - 0.5f*t);
+	tyy = twosevenths*(m->xyy*x + m->yyy*y + m->yyz*z + 2.0f*(m->xy*f.xy + m->yy*f.yy + m->yz*f.yz) - 0.5f*t);
+	txy = twosevenths*(m->xxy*x + m->xyy*y + m->xyz*z + m->xy*(f.xx + f.yy) + (m->xx + m->yy)*f.xy + m->yz*f.xz + m->xz*f.yz);
+	tyz = twosevenths*(m->xyz*x + m->yyz*y - (m->xxy + m->yyy)*z - m->yz*f.xx - m->xx*f.yz + m->xz*f.xy + m->xy*f.xz);
+	txz = twosevenths*(m->xxz*x + m->xyz*y - (m->xxx + m->xyy)*z - m->xz*f.yy - m->yy*f.xz + m->yz*f.xy + m->xy*f.yz);
+	/*
+	 ** Shift the Hexadecapole.
+	 */
+	m->xxxx += 4.0f*m->xxx*x + 6.0f*(m->xx*f.xx - txx);
+	m->yyyy += 4.0f*m->yyy*y + 6.0f*(m->yy*f.yy - tyy);
+	m->xyyy += m->yyy*x + 3.0f*(m->xyy*y + m->yy*f.xy + m->xy*f.yy - txy);
+	m->xxxy += m->xxx*y + 3.0f*(m->xxy*x + m->xx*f.xy + m->xy*f.xx - txy);
+	m->xxxz += m->xxx*z + 3.0f*(m->xxz*x + m->xx*f.xz + m->xz*f.xx - txz);
+	m->yyyz += m->yyy*z + 3.0f*(m->yyz*y + m->yy*f.yz + m->yz*f.yy - tyz);
+	m->xxyy += 2.0f*(m->xxy*y + m->xyy*x) + m->xx*f.yy + m->yy*f.xx + 4.0f*m->xy*f.xy - txx - tyy;
+	m->xxyz += m->xxy*z + m->xxz*y + m->xx*f.yz + m->yz*f.xx + 2.0f*(m->xyz*x + m->xy*f.xz + m->xz*f.xy) - tyz;
+	m->xyyz += m->xyy*z + m->yyz*x + m->yy*f.xz + m->xz*f.yy + 2.0f*(m->xyz*y + m->xy*f.yz + m->yz*f.xy) - txz;
+	}
+    if(ORDER >= 3) {
+	/*
+	 ** Now shift the Octopole.
+	 */
+	m->xxx += 3.0f*(m->xx*x - tx);
+	m->xyy += 2.0f*m->xy*y + m->yy*x - tx;
+	m->yyy += 3.0f*(m->yy*y - ty);
+	m->xxy += 2.0f*m->xy*x + m->xx*y - ty;
+	m->xxz += 2.0f*m->xz*x + m->xx*z - tz;
+	m->yyz += 2.0f*m->yz*y + m->yy*z - tz;
+	m->xyz += m->xy*z + m->xz*y + m->yz*x;
+	}
     /*
-     ** Now calculate the interaction up to Hexadecapole order.
+     ** Now deal with the monopole terms.
      */
-    tx = g4*(m->xxxx*xxx + m->xyyy*yyy + m->xxxy*xxy + m->xxxz*xxz + m->xxyy*xyy + m->xxyz*xyz + m->xyyz*yyz);
-    ty = g4*(m->xyyy*xyy + m->xxxy*xxx + m->yyyy*yyy + m->yyyz*yyz + m->xxyy*xxy + m->xxyz*xxz + m->xyyz*xyz);
-    tz = g4*(-m->xxxx*xxz - (m->xyyy + m->xxxy)*xyz - m->yyyy*yyz + m->xxxz*xxx + m->yyyz*yyy - m->xxyy*(xxz + yyz) + m->xxyz*xxy + m->xyyz*xyy);
-    g4 = 0.25*(tx*x + ty*y + tz*z);
-    xxx = g3*(m->xxx*xx + m->xyy*yy + m->xxy*xy + m->xxz*xz + m->xyz*yz);
-    xxy = g3*(m->xyy*xy + m->xxy*xx + m->yyy*yy + m->yyz*yz + m->xyz*xz);
-    xxz = g3*(-(m->xxx + m->xyy)*xz - (m->xxy + m->yyy)*yz + m->xxz*xx + m->yyz*yy + m->xyz*xy);
-    g3 = onethird*(xxx*x + xxy*y + xxz*z);
-    xx = g2*(m->xx*x + m->xy*y + m->xz*z);
-    xy = g2*(m->yy*y + m->xy*x + m->yz*z);
-    xz = g2*(-(m->xx + m->yy)*z + m->xz*x + m->yz*y);
-    g2 = 0.5*(xx*x + xy*y + xz*z);
-    g0 *= m->m;
-    *fPot += -(g0 + g2 + g3 + g4);
-    g0 += 5*g2 + 7*g3 + 9*g4;
-    *ax += dir*(xx + xxx + tx - x*g0);
-    *ay += dir*(xy + xxy + ty - y*g0);
-    *az += dir*(xz + xxz + tz - z*g0);
-    *magai = g0*dir;
+    f.m = 0;
+    momMulAddFmomrOrder<ORDER>(m,1.0,m->m,&f,1.0);
     }
-#endif
 
 /// A representation of a multipole expansion.
 class MultipoleMoments {
@@ -165,6 +545,45 @@ class MultipoleMoments {
 	/// A physical size for this multipole expansion, calculated
 	/// by an external function using some other information
 	cosmoType radius;
+
+	template <int ORDER>
+	void addMoments(const MultipoleMoments& m,
+			const Vector3D<cosmoType>& cm1) {
+		Vector3D<cosmoType> dr = cm1 - cm;
+		momShiftFmomrOrder<ORDER>(&mom, radius, dr.x, dr.y, dr.z);
+		FMOMR mom2 = m.mom;
+		dr = m.cm - cm;
+		momShiftFmomrOrder<ORDER>(&mom2, m.radius, dr.x, dr.y, dr.z);
+		momMulAddFmomrOrder<ORDER>(&mom, radius, 1.0, &mom2, m.radius);
+	}
+	template <int ORDER, typename ParticleType>
+	void addParticle(const ParticleType& p,
+			 const Vector3D<cosmoType>& cm1) {
+		// XXX this isn't the most efficient way, but it
+		// retains the semantics of this function.  It would
+		// be better to do this many particles at a time, then
+		// you could first determine the center of mass, then
+		// do a momMakeMomr(); momAddMomr() for each particle.
+		Vector3D<cosmoType> dr = cm1 - cm;
+		momShiftFmomrOrder<ORDER>(&mom, radius, dr.x, dr.y, dr.z);
+		dr = p.position - cm;
+		FMOMR momPart;
+		momMakeFmomrOrder<ORDER>(&momPart, p.mass, radius,
+					 dr.x, dr.y, dr.z);
+		momMulAddFmomrOrder<ORDER>(&mom, 1.0, 1.0, &momPart, 1.0);
+	}
+	template <int ORDER>
+	void subMoments(const MultipoleMoments& m,
+			MultipoleMoments& newMoments) {
+		Vector3D<cosmoType> dr = cm - newMoments.cm;
+		newMoments.mom = mom;
+		momShiftFmomrOrder<ORDER>(&mom, radius, dr.x, dr.y, dr.z);
+		FMOMR mom2 = m.mom;
+		dr = m.cm - newMoments.cm;
+		momShiftFmomrOrder<ORDER>(&mom2, m.radius, dr.x, dr.y, dr.z);
+		momMulAddFmomrOrder<ORDER>(&newMoments.mom, radius, -1.0,
+					   &mom2, m.radius);
+	}
 public:
 	cosmoType soft;		/* Effective softening */
 
@@ -172,22 +591,18 @@ public:
 	cosmoType totalMass;
 	/// The center of mass (zeroth order multipole)
 	Vector3D<cosmoType> cm;
-#ifdef HEXADECAPOLE
+	/// Reduced moments, scaled by radius.  Terms above the run time
+	/// order (iMultipoleOrder) are zero.
 	FMOMR mom;
-#else						\
-	//Tensor for higher order moments goes here
-	double xx, xy, xz, yy, yz, zz;
-#endif
+	/// Single precision copy of mom read by nodeBucketForceFloat();
+	/// brought up to date by makeFloat() when the radius is set.
+	FMOMRF momf;
 	
 	MultipoleMoments() : radius(0), totalMass(0) { 
 	    soft = 0;
 		cm.x = cm.y = cm.z = 0;
-		//clear higher order components here
-#ifdef HEXADECAPOLE
 		momClearFmomr(&mom);
-#else
-		xx = xy = xz = yy = yz = zz = 0;
-#endif
+		makeFloat();
 	    }
 	
 	/// Add two expansions together, using parallel axis theorem
@@ -209,30 +624,16 @@ public:
 		soft = (m1*soft + m.totalMass*m.soft)/totalMass;
 		Vector3D<cosmoType> cm1 = cm;
 		cm = (m1*cm + m.totalMass*m.cm)/totalMass;
-#ifdef HEXADECAPOLE
-		Vector3D<cosmoType> dr = cm1 - cm;
-		momShiftFmomr(&mom, radius, dr.x, dr.y, dr.z);
-		FMOMR mom2 = m.mom;
-		dr = m.cm - cm;
-		momShiftFmomr(&mom2, m.radius, dr.x, dr.y, dr.z);
-		momScaledAddFmomr(&mom, radius, &mom2, m.radius);
-#else
-		//add higher order components here
-		Vector3D<double> dr = cm1 - cm;
-		xx += m1*dr[0]*dr[0];
-		yy += m1*dr[1]*dr[1];
-		zz += m1*dr[2]*dr[2];
-		xy += m1*dr[0]*dr[1];
-		xz += m1*dr[0]*dr[2];
-		yz += m1*dr[1]*dr[2];
-		dr = m.cm - cm;
-		xx += m.xx + m.totalMass*dr[0]*dr[0];
-		yy += m.yy + m.totalMass*dr[1]*dr[1];
-		zz += m.zz + m.totalMass*dr[2]*dr[2];
-		xy += m.xy + m.totalMass*dr[0]*dr[1];
-		xz += m.xz + m.totalMass*dr[0]*dr[2];
-		yz += m.yz + m.totalMass*dr[1]*dr[2];
-#endif
+		switch(iMultipoleOrder) {
+		case 2:
+		    addMoments<2>(m, cm1);
+		    break;
+		case 3:
+		    addMoments<3>(m, cm1);
+		    break;
+		default:
+		    addMoments<4>(m, cm1);
+		    }
 		return *this;
 	}
 	
@@ -249,39 +650,16 @@ public:
 		soft = (m1*soft + p.mass*p.soft)/totalMass;
 		Vector3D<cosmoType> cm1 = cm;
 		cm = (m1*cm + p.mass * p.position)/totalMass;
-#ifdef HEXADECAPOLE
-		// XXX this isn't the most efficient way, but it
-		// retains the semantics of this function.  It would
-		// be better to do this many particles at a time, then
-		// you could first determine the center of mass, then
-		// do a momMakeMomr(); momAddMomr() for each particle.
-		Vector3D<cosmoType> dr = cm1 - cm;
-		momShiftFmomr(&mom, radius, dr.x, dr.y, dr.z);
-		dr = p.position - cm;
-		FMOMR momPart;
-		momMakeFmomr(&momPart, p.mass, radius, dr.x, dr.y, dr.z);
-		momAddFmomr(&mom, &momPart);
-#else
-		//add higher order components here
-		Vector3D<double> dr = cm1 - cm;
-
-		xx += m1*dr[0]*dr[0];
-		yy += m1*dr[1]*dr[1];
-		zz += m1*dr[2]*dr[2];
-		xy += m1*dr[0]*dr[1];
-		xz += m1*dr[0]*dr[2];
-		yz += m1*dr[1]*dr[2];
-		
-		dr = p.position - cm;
-		
-		xx += p.mass*dr[0]*dr[0];
-		yy += p.mass*dr[1]*dr[1];
-		zz += p.mass*dr[2]*dr[2];
-		xy += p.mass*dr[0]*dr[1];
-		xz += p.mass*dr[0]*dr[2];
-		yz += p.mass*dr[1]*dr[2];
-#endif
-		
+		switch(iMultipoleOrder) {
+		case 2:
+		    addParticle<2>(p, cm1);
+		    break;
+		case 3:
+		    addParticle<3>(p, cm1);
+		    break;
+		default:
+		    addParticle<4>(p, cm1);
+		    }
 		return *this;
 	}
 	
@@ -298,31 +676,16 @@ public:
 		    /newMoments.totalMass;
 		newMoments.cm = (totalMass*cm - m.totalMass*m.cm)
 		    /newMoments.totalMass;
-#ifdef HEXADECAPOLE
-		Vector3D<cosmoType> dr = cm - newMoments.cm;
-		newMoments.mom = mom;
-		momShiftFmomr(&mom, radius, dr.x, dr.y, dr.z);
-		FMOMR mom2 = m.mom;
-		dr = m.cm - newMoments.cm;
-		momShiftFmomr(&mom2, m.radius, dr.x, dr.y, dr.z);
-		momScaledSubFmomr(&newMoments.mom, radius, &mom2, m.radius);
-#else
-		//subtract off higher order components here
-		Vector3D<double> dr = cm - newMoments.cm;
-		newMoments.xx = xx + totalMass*dr[0]*dr[0];
-		newMoments.yy = yy + totalMass*dr[1]*dr[1];
-		newMoments.zz = zz + totalMass*dr[2]*dr[2];
-		newMoments.xy = xy + totalMass*dr[0]*dr[1];
-		newMoments.xz = xz + totalMass*dr[0]*dr[2];
-		newMoments.yz = yz + totalMass*dr[1]*dr[2];
-		dr = m.cm - newMoments.cm;
-		newMoments.xx -= m.xx + m.totalMass*dr[0]*dr[0];
-		newMoments.yy -= m.yy + m.totalMass*dr[1]*dr[1];
-		newMoments.zz -= m.zz + m.totalMass*dr[2]*dr[2];
-		newMoments.xy -= m.xy + m.totalMass*dr[0]*dr[1];
-		newMoments.xz -= m.xz + m.totalMass*dr[0]*dr[2];
-		newMoments.yz -= m.yz + m.totalMass*dr[1]*dr[2];
-#endif
+		switch(iMultipoleOrder) {
+		case 2:
+		    subMoments<2>(m, newMoments);
+		    break;
+		case 3:
+		    subMoments<3>(m, newMoments);
+		    break;
+		default:
+		    subMoments<4>(m, newMoments);
+		    }
 		return newMoments;
 	}
 	
@@ -332,14 +695,29 @@ public:
 		radius = 0;
 		totalMass = 0;
 		cm.x = cm.y = cm.z = 0;
-		//clear higher order components here
-#ifdef HEXADECAPOLE
 		momClearFmomr(&mom);
-#else
-		xx = xy = xz = yy = yz = zz = 0;
-#endif
+		makeFloat();
 	}
 	inline cosmoType getRadius() const {return radius;}
+	/// Copy mom into momf.
+	void makeFloat() {
+		momFmomr2Fmomrf(&mom, &momf);
+	}
+	/// Change the scale of mom to newradius and make it the radius.
+	void rescale(cosmoType newradius) {
+		switch(iMultipoleOrder) {
+		case 2:
+		    momRescaleFmomrOrder<2>(&mom, newradius, radius);
+		    break;
+		case 3:
+		    momRescaleFmomrOrder<3>(&mom, newradius, radius);
+		    break;
+		default:
+		    momRescaleFmomrOrder<4>(&mom, newradius, radius);
+		    }
+		radius = newradius;
+	}
+	friend class CompactNode;
 	friend void operator|(PUP::er& p, MultipoleMoments& m);
 	friend void calculateRadiusFarthestCorner(MultipoleMoments& m,
 					      const OrientedBox<double>& box);
@@ -360,16 +738,9 @@ inline void operator|(PUP::er& p, MultipoleMoments& m) {
 	p | m.totalMass;
 	p | m.soft;
 	p | m.cm;
-#ifdef HEXADECAPOLE
 	p((char *) &m.mom, sizeof(m.mom)); /* PUPs as bytes */
-#else
-	p | m.xx;
-	p | m.xy;
-	p | m.xz;
-	p | m.yy;
-	p | m.yz;
-	p | m.zz;
-#endif
+	if(p.isUnpacking())
+	    m.makeFloat();
 }
 
 #endif //__CHARMC__
@@ -383,11 +754,8 @@ inline void calculateRadiusFarthestCorner(MultipoleMoments& m, const OrientedBox
 	delta1.x = (delta1.x > delta2.x ? delta1.x : delta2.x);
 	delta1.y = (delta1.y > delta2.y ? delta1.y : delta2.y);
 	delta1.z = (delta1.z > delta2.z ? delta1.z : delta2.z);
-	cosmoType newradius = delta1.length();
-#ifdef HEXADECAPOLE
-	momRescaleFmomr(&m.mom, newradius, m.radius);
-#endif
-	m.radius = newradius;
+	m.rescale(delta1.length());
+	m.makeFloat();
 }
 
 /// Given an enclosing box, set the multipole expansion size to the
@@ -396,11 +764,11 @@ inline void calculateRadiusBox(MultipoleMoments& m,
 			       const OrientedBox<double>& box) {
 	Vector3D<cosmoType> delta = box.greater_corner - box.lesser_corner;
 	cosmoType newradius = 0.5*delta.length();
-#ifdef HEXADECAPOLE
 	if(m.totalMass > 0.0)
-	    momRescaleFmomr(&m.mom, newradius, m.radius);
-#endif
-	m.radius = newradius;
+	    m.rescale(newradius);
+	else
+	    m.radius = newradius;
+	m.makeFloat();
 }
 
 /// Given the positions that make up a multipole expansion, set the distance to the farthest particle from the center of mass
@@ -414,13 +782,9 @@ inline void calculateRadiusFarthestParticle(MultipoleMoments& m, const ParticleT
 		if(d > newradius)
 			newradius = d;
             }
-        if(newradius > 0.0) {
-            newradius = sqrt(newradius);
-#ifdef HEXADECAPOLE
-            momRescaleFmomr(&m.mom, newradius, m.radius);
-#endif
-            m.radius = newradius;
-            }
+        if(newradius > 0.0)
+            m.rescale(sqrt(newradius));
+        m.makeFloat();
 }
 
 #endif //MULTIPOLEMOMENTS_H
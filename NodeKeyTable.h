@@ -0,0 +1,167 @@
+/** @file NodeKeyTable.h
+ * Hash table indexed by tree node keys.
+ *
+ * The key to node tables of the tree are searched for every remote
+ * request, cache fill and moment exchange, so they are kept in a
+ * flat open addressing table with linear probing instead of a
+ * balanced tree.  Key 0 is never a valid node key (see NodeKey) and
+ * marks the empty slots.  Deletion shifts the following entries of
+ * the probe sequence back, so there are no tombstones, and the table
+ * is kept at most half full.
+ *
+ * The interface is the subset of std::map used by the tree code.
+ * Iteration order is arbitrary, and an insertion or deletion
+ * invalidates all iterators.
+ */
+
+#ifndef NODEKEYTABLE_H
+#define NODEKEYTABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+#include "keytype.h"
+
+namespace Tree {
+
+template <class V>
+class NodeKeyTable {
+ public:
+  typedef KeyType key_type;
+  typedef V mapped_type;
+  typedef std::pair<KeyType, V> value_type;
+
+  /// @brief Forward iterator over the occupied slots.
+  class iterator {
+    friend class NodeKeyTable;
+    value_type *slot;
+    value_type *last;
+    void skipEmpty() {
+      while(slot != last && slot->first == 0) ++slot;
+    }
+   public:
+    iterator() : slot(NULL), last(NULL) {}
+    iterator(value_type *s, value_type *l) : slot(s), last(l) {}
+    value_type &operator*() const { return *slot; }
+    value_type *operator->() const { return slot; }
+    iterator &operator++() { ++slot; skipEmpty(); return *this; }
+    bool operator==(const iterator &it) const { return slot == it.slot; }
+    bool operator!=(const iterator &it) const { return slot != it.slot; }
+  };
+
+ private:
+  std::vector<value_type> slots;
+  size_t nUsed;
+  size_t mask;			///< capacity - 1
+  int shift;			///< 64 - log2(capacity)
+
+  /// Fibonacci hashing of the key folded to 64 bits: the top bits
+  /// of the product depend on all the path bits of the key.
+  inline size_t home(KeyType k) const {
+    uint64_t h = (uint64_t) k
+        ^ (uint64_t) ((k >> (4*sizeof(KeyType))) >> (4*sizeof(KeyType)));
+    return (size_t) ((h*0x9E3779B97F4A7C15ULL) >> shift);
+  }
+
+  inline value_type *slotBegin() { return slots.empty() ? NULL : &slots[0]; }
+  inline value_type *slotEnd() { return slotBegin() + slots.size(); }
+
+  /// Index of the slot holding k, or of the empty slot ending its
+  /// probe sequence.
+  inline size_t probe(KeyType k) const {
+    size_t i = home(k);
+    while(slots[i].first != 0 && slots[i].first != k)
+      i = (i + 1) & mask;
+    return i;
+  }
+
+  void rehash(size_t capacity) {
+    std::vector<value_type> old;
+    old.swap(slots);
+    slots.resize(capacity);
+    mask = capacity - 1;
+    shift = 64;
+    for(size_t c = capacity; c > 1; c >>= 1) shift--;
+    for(size_t i = 0; i < old.size(); i++)
+      if(old[i].first != 0) slots[probe(old[i].first)] = old[i];
+  }
+
+ public:
+  NodeKeyTable() : nUsed(0), mask(0), shift(64) {}
+
+  size_t size() const { return nUsed; }
+  bool empty() const { return nUsed == 0; }
+
+  iterator begin() {
+    iterator it(slotBegin(), slotEnd());
+    it.skipEmpty();
+    return it;
+  }
+  iterator end() { return iterator(slotEnd(), slotEnd()); }
+
+  iterator find(KeyType k) {
+    if(nUsed == 0) return end();
+    size_t i = probe(k);
+    if(slots[i].first == 0) return end();
+    return iterator(&slots[i], slotEnd());
+  }
+
+  /// @brief Insert v unless its key is present.
+  /// @return The entry with the key, and whether it was inserted.
+  std::pair<iterator, bool> insert(const value_type &v) {
+    CkAssert(v.first != 0);
+    if(2*(nUsed + 1) > slots.size())
+      rehash(slots.empty() ? 16 : 2*slots.size());
+    size_t i = probe(v.first);
+    bool bNew = (slots[i].first == 0);
+    if(bNew) {
+      slots[i] = v;
+      nUsed++;
+    }
+    return std::make_pair(iterator(&slots[i], slotEnd()), bNew);
+  }
+
+  V &operator[](KeyType k) {
+    return insert(value_type(k, V())).first->second;
+  }
+
+  /// @brief Remove the entry at it, moving back the entries probed
+  /// after it that would otherwise no longer be found.
+  void erase(const iterator &it) {
+    size_t i = it.slot - slotBegin();
+    size_t j = i;
+    while(true) {
+      j = (j + 1) & mask;
+      if(slots[j].first == 0) break;
+      size_t h = home(slots[j].first);
+      // Move j into the hole at i unless its home lies cyclically
+      // in (i, j].
+      if(i <= j ? (i < h && h <= j) : (i < h || h <= j)) continue;
+      slots[i] = slots[j];
+      i = j;
+    }
+    slots[i] = value_type();
+    nUsed--;
+  }
+
+  size_t erase(KeyType k) {
+    iterator it = find(k);
+    if(it == end()) return 0;
+    erase(it);
+    return 1;
+  }
+
+  /// @brief Remove all entries, keeping the capacity for the next
+  /// tree of similar size.
+  void clear() {
+    if(nUsed == 0) return;
+    for(size_t i = 0; i < slots.size(); i++)
+      if(slots[i].first != 0) slots[i] = value_type();
+    nUsed = 0;
+  }
+};
+
+}
+
+#endif
@@ -24,6 +24,7 @@ class Opt{
     return action_array[openDecision][node->getType()];
   }
   OptType getSelfType() {return type;}
+  virtual ~Opt() {}
 };
 
 /// Class for optimizing remote gravity walk actions.
@@ -82,6 +83,16 @@ class RemoteOpt : public Opt{
 
 };
 
+/// Remote gravity walk actions when the FMM walk replaces the local
+/// walk: unopened NonLocalBucket nodes, which the local walk would
+/// have computed, are computed here instead.
+class FmmRemoteOpt : public RemoteOpt{
+  public:
+  FmmRemoteOpt() : RemoteOpt(){
+    action_array[0][NonLocalBucket] = COMPUTE;
+  }
+};
+
 /// Class for optimizing local gravity walk actions.
 class LocalOpt : public Opt{
   public:
@@ -51,7 +51,7 @@ void PETreeMerger::mergeWalk(CkVec<GenericTreeNode*> &mergeList, CkVec<TreePiece
   }
 
   if(numClients > 0){
-    std::map<NodeKey,NonLocalMomentsClientList>::iterator it;
+    NonLocalMomentsClientTable::iterator it;
     it = pickedTreePiece->createTreeBuildMomentsEntry(pickedNode);
     for(int i = 0; i < mergeList.length(); i++){
       NodeType type = mergeList[i]->getType();
@@ -0,0 +1,465 @@
+/*
+ * Particle-mesh long range gravity (TreePM); see PM.h.
+ */
+
+#include <algorithm>
+#include "ParallelGravity.h"
+#include "PM.h"
+
+/// Most cells a particle is assigned to (TSC)
+const int PM_MAXCELLS = 27;
+
+/// @brief In place radix-2 FFT of the n points a[0], a[stride], ...
+/// @param sign -1 for the forward, +1 for the (unnormalized) inverse
+/// transform.
+static void pmFFT(std::complex<double> *a, int n, int stride, int sign)
+{
+    for(int i = 1, j = 0; i < n; i++) {
+	int bit = n >> 1;
+	for(; j & bit; bit >>= 1)
+	    j ^= bit;
+	j ^= bit;
+	if(i < j)
+	    std::swap(a[i*stride], a[j*stride]);
+	}
+    for(int len = 2; len <= n; len <<= 1) {
+	double ang = sign*2.0*M_PI/len;
+	std::complex<double> wLen(cos(ang), sin(ang));
+	for(int i = 0; i < n; i += len) {
+	    std::complex<double> w(1.0, 0.0);
+	    for(int j = 0; j < len/2; j++) {
+		std::complex<double> u = a[(i + j)*stride];
+		std::complex<double> v = a[(i + j + len/2)*stride]*w;
+		a[(i + j)*stride] = u + v;
+		a[(i + j + len/2)*stride] = u - v;
+		w *= wLen;
+		}
+	    }
+	}
+}
+
+/// @brief Cells and weights of the assignment kernel (iPMAssign) along
+/// one axis at mesh coordinate u.
+/// @return Number of cells.
+static int pmWeights(double u, int *idx, double *w)
+{
+    int n;
+    if(iPMAssign == 1) {	// CIC
+	double f = floor(u);
+	double d = u - f;
+	idx[0] = (int) f;
+	idx[1] = idx[0] + 1;
+	w[0] = 1.0 - d;
+	w[1] = d;
+	n = 2;
+	}
+    else {			// TSC
+	double f = floor(u + 0.5);
+	double d = u - f;
+	idx[1] = (int) f;
+	idx[0] = idx[1] - 1;
+	idx[2] = idx[1] + 1;
+	w[0] = 0.5*(0.5 - d)*(0.5 - d);
+	w[1] = 0.75 - d*d;
+	w[2] = 0.5*(0.5 + d)*(0.5 + d);
+	n = 3;
+	}
+    for(int i = 0; i < n; i++)
+	idx[i] = ((idx[i] % nPMGrid) + nPMGrid) % nPMGrid;
+    return n;
+}
+
+/// @brief Mesh cells a particle at pos is assigned to, with their
+/// weights.
+/// @return Number of cells, at most PM_MAXCELLS.
+static int pmAssign(const Vector3D<cosmoType> &pos, double dPeriod,
+		    int64_t *cells, double *w)
+{
+    int idx[3][3];
+    double wt[3][3];
+    int n = 0;
+    for(int k = 0; k < 3; k++)
+	n = pmWeights(pos[k]/dPeriod*nPMGrid, idx[k], wt[k]);
+    int m = 0;
+    for(int a = 0; a < n; a++)
+	for(int b = 0; b < n; b++)
+	    for(int c = 0; c < n; c++) {
+		cells[m] = ((int64_t)idx[0][a]*nPMGrid + idx[1][b])*nPMGrid
+		    + idx[2][c];
+		w[m] = wt[0][a]*wt[1][b]*wt[2][c];
+		m++;
+		}
+    return m;
+}
+
+///
+/// @brief Add the PM long range force to the active particles.
+///
+/// Called once the tree walk, which only summed the short range
+/// force, is done.
+///
+void
+Main::pmGravity(int activeRung)
+{
+    double startTime = CkWallTimer();
+    if(verbosity)
+	CkPrintf("Calculating PM gravity (%d^3 mesh) ... ", nPMGrid);
+    CkCallback cbDone(CkCallback::resumeThread);
+    CkReductionMsg *msgCounts;
+    treeProxy.pmDeposit(activeRung, CkCallbackResumeThread((void*&)msgCounts),
+			cbDone);
+    pmProxy.solve(nPMSlabs, (int *)msgCounts->getData(), param.vPeriod.x);
+    delete msgCounts;
+    CkFreeMsg(cbDone.thread_delay());
+    if(verbosity)
+	CkPrintf("took %g seconds.\n", CkWallTimer() - startTime);
+}
+
+///
+/// @brief Assign my particles to the PM mesh.
+///
+/// The merged cell masses are sent to the PMSlabs holding them.
+/// cbCounts gets, for every PMSlab, the number of TreePieces that sent
+/// it a deposit; cbDone is called once pmForces() has updated the
+/// particles of activeRung.
+///
+void TreePiece::pmDeposit(int activeRung, const CkCallback &cbCounts,
+			  const CkCallback &cbDone)
+{
+    int64_t cells[PM_MAXCELLS];
+    double w[PM_MAXCELLS];
+    std::vector<std::pair<int64_t, double> > deposits;
+    deposits.reserve(myNumParticles*PM_MAXCELLS);
+    for(unsigned int i = 1; i <= myNumParticles; ++i) {
+	int n = pmAssign(myParticles[i].position, fPeriod.x, cells, w);
+	for(int j = 0; j < n; j++)
+	    deposits.push_back(std::make_pair(cells[j],
+					      myParticles[i].mass*w[j]));
+	}
+    std::sort(deposits.begin(), deposits.end());
+    pmCells.clear();
+    std::vector<double> mass;
+    for(size_t i = 0; i < deposits.size(); i++) {
+	if(!pmCells.empty() && pmCells.back() == deposits[i].first)
+	    mass.back() += deposits[i].second;
+	else {
+	    pmCells.push_back(deposits[i].first);
+	    mass.push_back(deposits[i].second);
+	    }
+	}
+
+    std::vector<int> counts(nPMSlabs, 0);
+    int64_t nPlane = (int64_t)nPMGrid*nPMGrid;
+    pmSlabOffset.resize(nPMSlabs + 1);
+    nPMPending = 0;
+    size_t i = 0;
+    for(int s = 0; s < nPMSlabs; s++) {
+	pmSlabOffset[s] = i;
+	int ixEnd = pmSlabStart(s + 1);
+	while(i < pmCells.size() && pmCells[i]/nPlane < ixEnd)
+	    i++;
+	int n = i - pmSlabOffset[s];
+	if(n > 0) {
+	    pmProxy[s].deposit(thisIndex, n, &pmCells[pmSlabOffset[s]],
+			       &mass[pmSlabOffset[s]]);
+	    counts[s] = 1;
+	    nPMPending++;
+	    }
+	}
+    pmSlabOffset[nPMSlabs] = i;
+    pmField.assign(4*pmCells.size(), 0.0);
+    pmActiveRung = activeRung;
+    cbPMDone = cbDone;
+    contribute(nPMSlabs*sizeof(int), &counts[0], CkReduction::sum_int,
+	       cbCounts);
+    if(nPMPending == 0)
+	contribute(cbPMDone);
+}
+
+///
+/// @brief Potential and accelerations at the cells deposited to slab
+/// iSlab, 4 values per cell.
+///
+/// Once all slabs have answered, they are interpolated to the active
+/// particles.
+///
+void TreePiece::pmForces(int iSlab, int n, double *values)
+{
+    CkAssert(n == pmSlabOffset[iSlab + 1] - pmSlabOffset[iSlab]);
+    std::copy(values, values + 4*n, pmField.begin() + 4*pmSlabOffset[iSlab]);
+    if(--nPMPending > 0)
+	return;
+
+    // Potential of the uniform background, as in the Ewald sum
+    double dPeriod = fPeriod.x;
+    double dPotBg = 4.0*M_PI*dPMSplit*dPMSplit*root->moments.totalMass
+	/(dPeriod*dPeriod*dPeriod);
+    int64_t cells[PM_MAXCELLS];
+    double w[PM_MAXCELLS];
+    for(unsigned int i = 1; i <= myNumParticles; ++i) {
+	GravityParticle *p = &myParticles[i];
+	if(p->rung < pmActiveRung)
+	    continue;
+	int nCells = pmAssign(p->position, dPeriod, cells, w);
+	double field[4] = {0.0, 0.0, 0.0, 0.0};
+	for(int j = 0; j < nCells; j++) {
+	    size_t k = std::lower_bound(pmCells.begin(), pmCells.end(), cells[j])
+		- pmCells.begin();
+	    CkAssert(k < pmCells.size() && pmCells[k] == cells[j]);
+	    for(int f = 0; f < 4; f++)
+		field[f] += w[j]*pmField[4*k + f];
+	    }
+	p->potential += field[0] + dPotBg;
+	p->treeAcceleration.x += field[1];
+	p->treeAcceleration.y += field[2];
+	p->treeAcceleration.z += field[3];
+	}
+    std::vector<int64_t>().swap(pmCells);
+    std::vector<double>().swap(pmField);
+    contribute(cbPMDone);
+}
+
+PMSlab::PMSlab()
+{
+    int64_t nPlane = (int64_t)nPMGrid*nPMGrid;
+    nx = pmSlabStart(thisIndex + 1) - pmSlabStart(thisIndex);
+    ny = nx;			// y planes are split like the x planes
+    xSlab.assign(4*nx*nPlane, Complex(0.0, 0.0));
+    ySlab.assign(4*ny*nPlane, Complex(0.0, 0.0));
+    nDeposits = 0;
+    nExpected = -1;
+    nTransposed[0] = nTransposed[1] = 0;
+    dPeriod = 0.0;
+}
+
+/// The mesh only holds data during a force calculation, so it is
+/// just reallocated after a migration.
+void PMSlab::pup(PUP::er &p)
+{
+    CBase_PMSlab::pup(p);
+    p|nx;
+    p|ny;
+    p|dPeriod;
+    if(p.isUnpacking()) {
+	int64_t nPlane = (int64_t)nPMGrid*nPMGrid;
+	xSlab.assign(4*nx*nPlane, Complex(0.0, 0.0));
+	ySlab.assign(4*ny*nPlane, Complex(0.0, 0.0));
+	nDeposits = 0;
+	nExpected = -1;
+	nTransposed[0] = nTransposed[1] = 0;
+	}
+}
+
+/// @brief Add the cell masses of TreePiece iPiece to my density.
+void PMSlab::deposit(int iPiece, int n, int64_t *cells, double *mass)
+{
+    int64_t iFirst = (int64_t)pmSlabStart(thisIndex)*nPMGrid*nPMGrid;
+    for(int j = 0; j < n; j++)
+	xSlab[cells[j] - iFirst] += mass[j];
+    requests.push_back(Request());
+    requests.back().iPiece = iPiece;
+    requests.back().cells.assign(cells, cells + n);
+    if(++nDeposits == nExpected)
+	start();
+}
+
+/// @brief Solve for the potential once the counts[thisIndex] deposits
+/// have arrived.
+void PMSlab::solve(int nSlabs, int *counts, double dPeriod)
+{
+    CkAssert(nSlabs == nPMSlabs);
+    this->dPeriod = dPeriod;
+    nExpected = counts[thisIndex];
+    if(nDeposits == nExpected)
+	start();
+}
+
+/// @brief Transform my x planes and send their y ranges to the other
+/// slabs.
+void PMSlab::start()
+{
+    int N = nPMGrid;
+    double dCell = dPeriod/N;
+    double dDenFac = 1.0/(dCell*dCell*dCell);
+    for(int ix = 0; ix < nx; ix++) {
+	Complex *plane = &xSlab[(size_t)ix*N*N];
+	for(int i = 0; i < N*N; i++)
+	    plane[i] *= dDenFac;
+	for(int iy = 0; iy < N; iy++)
+	    pmFFT(plane + iy*N, N, 1, -1);
+	for(int iz = 0; iz < N; iz++)
+	    pmFFT(plane + iz, N, N, -1);
+	}
+    for(int t = 0; t < nPMSlabs; t++) {
+	int iy0 = pmSlabStart(t);
+	int nyt = pmSlabStart(t + 1) - iy0;
+	std::vector<double> buf(2*(size_t)nx*nyt*N);
+	size_t k = 0;
+	for(int ix = 0; ix < nx; ix++)
+	    for(int iy = iy0; iy < iy0 + nyt; iy++)
+		for(int iz = 0; iz < N; iz++) {
+		    const Complex &c = xSlab[((size_t)ix*N + iy)*N + iz];
+		    buf[k++] = c.real();
+		    buf[k++] = c.imag();
+		    }
+	thisProxy[t].transpose(0, thisIndex, buf.size(), &buf[0]);
+	}
+}
+
+/// @brief Receive the part of slab "from" that I hold after the
+/// forward (phase 0) or backward (phase 1) transpose.
+void PMSlab::transpose(int phase, int from, int n, double *data)
+{
+    int N = nPMGrid;
+    size_t k = 0;
+    if(phase == 0) {
+	int ix0 = pmSlabStart(from);
+	int nxf = pmSlabStart(from + 1) - ix0;
+	CkAssert(n == 2*nxf*ny*N);
+	for(int ix = ix0; ix < ix0 + nxf; ix++)
+	    for(int iy = 0; iy < ny; iy++)
+		for(int iz = 0; iz < N; iz++) {
+		    ySlab[((size_t)iy*N + ix)*N + iz] = Complex(data[k],
+								data[k + 1]);
+		    k += 2;
+		    }
+	}
+    else {
+	int iy0 = pmSlabStart(from);
+	int nyf = pmSlabStart(from + 1) - iy0;
+	CkAssert(n == 8*nyf*nx*N);
+	for(int f = 0; f < 4; f++)
+	    for(int iy = iy0; iy < iy0 + nyf; iy++)
+		for(int ix = 0; ix < nx; ix++)
+		    for(int iz = 0; iz < N; iz++) {
+			xSlab[(((size_t)f*nx + ix)*N + iy)*N + iz]
+			    = Complex(data[k], data[k + 1]);
+			k += 2;
+			}
+	}
+    if(++nTransposed[phase] == nPMSlabs) {
+	nTransposed[phase] = 0;
+	finishTranspose(phase);
+	}
+}
+
+/// @brief Continue the solve once a transpose is complete.
+///
+/// After the forward transpose the x transform is done, the Green's
+/// function applied and the four fields sent back; after the backward
+/// one the y and z transforms are inverted and the cells answered.
+void PMSlab::finishTranspose(int phase)
+{
+    int N = nPMGrid;
+    if(phase == 0) {
+	for(int iy = 0; iy < ny; iy++)
+	    for(int iz = 0; iz < N; iz++)
+		pmFFT(&ySlab[(size_t)iy*N*N + iz], N, N, -1);
+	applyGreen();
+	for(int f = 0; f < 4; f++)
+	    for(int iy = 0; iy < ny; iy++)
+		for(int iz = 0; iz < N; iz++)
+		    pmFFT(&ySlab[((size_t)f*ny + iy)*N*N + iz], N, N, 1);
+	for(int t = 0; t < nPMSlabs; t++) {
+	    int ix0 = pmSlabStart(t);
+	    int nxt = pmSlabStart(t + 1) - ix0;
+	    std::vector<double> buf(8*(size_t)ny*nxt*N);
+	    size_t k = 0;
+	    for(int f = 0; f < 4; f++)
+		for(int iy = 0; iy < ny; iy++)
+		    for(int ix = ix0; ix < ix0 + nxt; ix++)
+			for(int iz = 0; iz < N; iz++) {
+			    const Complex &c
+				= ySlab[(((size_t)f*ny + iy)*N + ix)*N + iz];
+			    buf[k++] = c.real();
+			    buf[k++] = c.imag();
+			    }
+	    thisProxy[t].transpose(1, thisIndex, buf.size(), &buf[0]);
+	    }
+	}
+    else {
+	for(int f = 0; f < 4; f++)
+	    for(int ix = 0; ix < nx; ix++) {
+		Complex *plane = &xSlab[((size_t)f*nx + ix)*N*N];
+		for(int iz = 0; iz < N; iz++)
+		    pmFFT(plane + iz, N, N, 1);
+		for(int iy = 0; iy < N; iy++)
+		    pmFFT(plane + iy*N, N, 1, 1);
+		}
+	reply();
+	}
+}
+
+/// @brief Turn the transformed density on my y planes into the
+/// transformed long range potential and accelerations.
+///
+/// The Green's function is -4 pi/k^2 exp(-k^2 r_s^2), deconvolved
+/// with the assignment window of both the deposit and the
+/// interpolation; the accelerations are its spectral gradient.
+void PMSlab::applyGreen()
+{
+    int N = nPMGrid;
+    int iy0 = pmSlabStart(thisIndex);
+    int nPow = 2*(iPMAssign + 1);
+    double dk = 2.0*M_PI/dPeriod;
+    double rs2 = dPMSplit*dPMSplit;
+    size_t nField = (size_t)ny*N*N;
+    for(int iy = 0; iy < ny; iy++)
+	for(int ix = 0; ix < N; ix++)
+	    for(int iz = 0; iz < N; iz++) {
+		int nk[3] = {ix, iy0 + iy, iz};
+		double kv[3];
+		double k2 = 0.0;
+		double win = 1.0;
+		for(int d = 0; d < 3; d++) {
+		    if(nk[d] > N/2)
+			nk[d] -= N;
+		    kv[d] = dk*nk[d];
+		    k2 += kv[d]*kv[d];
+		    if(nk[d] != 0) {
+			double u = M_PI*nk[d]/N;
+			win *= sin(u)/u;
+			}
+		    }
+		size_t i = ((size_t)iy*N + ix)*N + iz;
+		if(k2 == 0.0) {
+		    for(int f = 0; f < 4; f++)
+			ySlab[f*nField + i] = 0.0;
+		    continue;
+		    }
+		double green = -4.0*M_PI/k2*exp(-k2*rs2)/pow(win, nPow);
+		Complex phi = green*ySlab[i];
+		ySlab[i] = phi;
+		for(int d = 0; d < 3; d++) {
+		    // a = -grad phi; the Nyquist mode has no gradient
+		    if(nk[d] == N/2)
+			ySlab[(d + 1)*nField + i] = 0.0;
+		    else
+			ySlab[(d + 1)*nField + i] = Complex(0.0, -kv[d])*phi;
+		    }
+		}
+}
+
+/// @brief Send every TreePiece that deposited to me the fields at its
+/// cells, and clear the mesh for the next step.
+void PMSlab::reply()
+{
+    int N = nPMGrid;
+    int64_t iFirst = (int64_t)pmSlabStart(thisIndex)*N*N;
+    size_t nField = (size_t)nx*N*N;
+    double norm = 1.0/((double)N*N*N);
+    for(size_t r = 0; r < requests.size(); r++) {
+	const std::vector<int64_t> &cells = requests[r].cells;
+	int n = cells.size();
+	std::vector<double> values(4*n);
+	for(int j = 0; j < n; j++)
+	    for(int f = 0; f < 4; f++)
+		values[4*j + f]
+		    = norm*xSlab[f*nField + (cells[j] - iFirst)].real();
+	treeProxy[requests[r].iPiece].pmForces(thisIndex, n, &values[0]);
+	}
+    requests.clear();
+    nDeposits = 0;
+    nExpected = -1;
+    std::fill(xSlab.begin(), xSlab.end(), Complex(0.0, 0.0));
+}
@@ -0,0 +1,75 @@
+/** @file PM.h
+ * Particle-mesh long range force for periodic runs (TreePM).
+ *
+ * With nPMGrid set the gravitational force is split at the scale
+ * dPMSplit: the tree walk only sums the erfc truncated short range
+ * kernel (see pmShortFactors() in gravity.h) out to dPMCut, and the
+ * long range remainder comes from a mesh of nPMGrid^3 cells.  The
+ * TreePieces assign their particles to the mesh (CIC or TSC), the
+ * PMSlab array solves Poisson's equation with a slab decomposed FFT
+ * and sends back the potential and accelerations at the cells the
+ * TreePieces deposited to, which then interpolate them to the
+ * particles with the same assignment weights.
+ */
+
+#ifndef PM_H
+#define PM_H
+
+#include <complex>
+#include "ParallelGravity.h"
+
+/// @brief First x plane of the mesh held by a PMSlab.
+inline int pmSlabStart(int iSlab)
+{
+    return (int)((int64_t)iSlab*nPMGrid/nPMSlabs);
+}
+
+/// @brief PMSlab holding the x plane ix of the mesh.
+inline int pmSlabOf(int ix)
+{
+    return (int)(((int64_t)(ix + 1)*nPMSlabs + nPMGrid - 1)/nPMGrid) - 1;
+}
+
+/// @brief One slab of the PM mesh.
+///
+/// Slab s holds the x planes [pmSlabStart(s), pmSlabStart(s+1)) of
+/// the density and, between the two transposes of the FFT, the same
+/// range of y planes of its transform.
+class PMSlab : public CBase_PMSlab {
+    typedef std::complex<double> Complex;
+
+    int nx;			///< x planes held
+    int ny;			///< y planes held after the transpose
+    /// Density and, after the solve, potential and acceleration
+    /// (4 fields) on my x planes, indexed ((f*nx + ix)*N + iy)*N + iz.
+    std::vector<Complex> xSlab;
+    /// Transformed fields on my y planes, ((f*ny + iy)*N + ix)*N + iz.
+    std::vector<Complex> ySlab;
+
+    /// @brief Cells deposited to by one TreePiece, to be answered.
+    struct Request {
+	int iPiece;
+	std::vector<int64_t> cells;
+    };
+    std::vector<Request> requests;
+    int nDeposits;		///< deposits received this step
+    int nExpected;		///< deposits to wait for; -1 before solve()
+    int nTransposed[2];		///< transpose messages received per phase
+    double dPeriod;
+
+    void start();
+    void finishTranspose(int phase);
+    void applyGreen();
+    void reply();
+
+public:
+    PMSlab();
+    PMSlab(CkMigrateMessage *m) : CBase_PMSlab(m) {}
+    void pup(PUP::er &p);
+
+    void deposit(int iPiece, int n, int64_t *cells, double *mass);
+    void solve(int nSlabs, int *counts, double dPeriod);
+    void transpose(int phase, int from, int n, double *data);
+};
+
+#endif
@@ -44,6 +44,7 @@
 #include "externalGravity.h"
 
 #include "PETreeMerger.h"
+#include "PM.h"
 
 #ifdef CUDA
 // for default per-list parameters
@@ -83,6 +84,7 @@ CProxy_IntraNodeLBManager nodeLBMgrProxy;
 CProxy_DumpFrameData dfDataProxy;
 /// @brief Proxy for the PETreeMerger group.
 CProxy_PETreeMerger peTreeMergerProxy;
+CProxy_PMSlab pmProxy;
 
 
 
@@ -124,6 +126,57 @@ int _randChunks;                ///< Randomize the chunks for the
 unsigned int bucketSize;        ///< Maximum number of particles in a bucket.
 /// @brief Use Ckloop for node parallelization.
 int bUseCkLoopPar;
+/// @brief Evaluate gravity interaction lists with the streaming
+/// (structure of arrays) kernels.
+int bSoAGravity;
+/// @brief Evaluate well separated cell interactions in single precision.
+int bFarFieldFloat;
+/// @brief Use cell-cell (FMM) interactions for the local tree.
+int bFmmGravity;
+/// @brief Compute each pair of close local buckets once, with equal
+/// and opposite forces.  bFmmGravity, which does so too, takes precedence.
+int bMutualGravity;
+/// @brief Reorder each local tree into one depth first block of nodes.
+int bDepthFirstTree;
+/// @brief Sort particles by key with a radix sort instead of std::sort.
+int bRadixSort;
+/// @brief Send cache fills of nodes and particles in a compact,
+/// single precision format.
+int bCompactFill;
+/// @brief Keep remote node fills from one tree walk to the next
+/// on the same tree.
+int bRetainNodes;
+/// @brief Memory in MB per processor for the node fills kept with
+/// bRetainNodes (dNodeFillsDefaultMB if 0); the least recently used
+/// are dropped beyond it.
+double dCacheBudget;
+/// @brief Let the owner of a node pick the depth of each cache fill
+/// from the distance to the requester, up to 2*nCacheDepth.
+int bAdaptiveCacheDepth;
+/// @brief Prefetch the remote nodes requested by the last gravity
+/// walk at the same rung instead of walking the prefetch boxes, as
+/// long as the tree has only been refitted since.
+int bHistoryPrefetch;
+/// @brief Expansion order used for cell interactions (iOrder).
+int iMultipoleOrder;
+/// @brief Largest local node whose buckets share one interaction list.
+int nBucketGroup;
+/// @brief Tolerance of the relative opening criterion (0 = geometric).
+double dAccErrTol;
+/// @brief Gravity calculation whose interaction lists are recorded.
+int iInterListDump;
+/// @brief Grid size of the tabulated Ewald correction (0 = exact sum).
+int nEwaldTable;
+/// @brief Cells per dimension of the TreePM mesh (0 = no TreePM).
+int nPMGrid;
+/// @brief Number of PMSlab chares the mesh is split over.
+int nPMSlabs;
+/// @brief PM mass assignment: 1 = CIC, 2 = TSC.
+int iPMAssign;
+/// @brief TreePM force split scale r_s (0 = no TreePM).
+double dPMSplit;
+/// @brief Range of the TreePM short range (tree) force.
+double dPMCut;
 
 //jetley
 /// GPU related settings.
@@ -370,13 +423,10 @@ Main::Main(CkArgMsg* m) {
 	prmAddParam(prm,"daSwitchTheta",paramDouble,&param.daSwitchTheta,
 		    sizeof(double),"aSwitchTheta",
 		    "<a to switch theta at> = 1./3.");
-#ifdef HEXADECAPOLE
 	param.iOrder = 4;
-#else
-	param.iOrder = 2;
-#endif
 	prmAddParam(prm, "iOrder", paramInt, &param.iOrder,
-		    sizeof(int), "or", "Multipole expansion order(IGNORED)");
+		    sizeof(int), "or",
+		    "Multipole expansion order: 2, 3 or 4");
 	//
 	// Cosmology parameters
 	//
@@ -410,6 +460,26 @@ Main::Main(CkArgMsg* m) {
 	param.dEwhCut = 2.8;
 	prmAddParam(prm,"dEwhCut", paramDouble, &param.dEwhCut, sizeof(double),
 		    "ewh", "<dEwhCut> = 2.8");
+	param.nEwaldTable = 0;
+	prmAddParam(prm, "nEwaldTable", paramInt, &param.nEwaldTable,
+		    sizeof(int), "ewtable",
+		    "<grid intervals per dimension of the tabulated (monopole) Ewald correction> = 0 (exact)");
+	param.nPMGrid = 0;
+	prmAddParam(prm, "nPMGrid", paramInt, &param.nPMGrid,
+		    sizeof(int), "pmgrid",
+		    "<cells per dimension of the TreePM mesh, a power of two> = 0 (tree and Ewald)");
+	param.dPMAsmth = 1.25;
+	prmAddParam(prm, "dPMAsmth", paramDouble, &param.dPMAsmth,
+		    sizeof(double), "pmasmth",
+		    "<TreePM force split scale in mesh cells> = 1.25");
+	param.dPMRcut = 4.5;
+	prmAddParam(prm, "dPMRcut", paramDouble, &param.dPMRcut,
+		    sizeof(double), "pmrcut",
+		    "<TreePM short range cutoff in units of the split scale> = 4.5");
+	param.iPMAssign = 2;
+	prmAddParam(prm, "iPMAssign", paramInt, &param.iPMAssign,
+		    sizeof(int), "pmassign",
+		    "<TreePM mass assignment: 1 = CIC, 2 = TSC> = 2");
 	param.csm->bComove = 0;
 	prmAddParam(prm, "bComove", paramBool, &param.csm->bComove,
 		    sizeof(int),"cm", "Comoving coordinates");
@@ -669,6 +739,62 @@ Main::Main(CkArgMsg* m) {
 	param.bUseCkLoopPar = 0;
 	prmAddParam(prm, "bUseCkLoopPar", paramBool,&param.bUseCkLoopPar, sizeof(int),
 		    "useckloop", "enable CkLoop to parallelize within node");
+	param.bSoAGravity = 0;
+	prmAddParam(prm, "bSoAGravity", paramBool, &param.bSoAGravity,
+		    sizeof(int), "soagrav",
+		    "pack interaction lists for streaming gravity kernels");
+	param.bFarFieldFloat = 0;
+	prmAddParam(prm, "bFarFieldFloat", paramBool, &param.bFarFieldFloat,
+		    sizeof(int), "farfloat",
+		    "single precision for unsoftened cell interactions");
+	param.bFmmGravity = 0;
+	prmAddParam(prm, "bFmmGravity", paramBool, &param.bFmmGravity,
+		    sizeof(int), "fmm",
+		    "cell-cell (FMM) gravity within each TreePiece");
+	param.bMutualGravity = 0;
+	prmAddParam(prm, "bMutualGravity", paramBool, &param.bMutualGravity,
+		    sizeof(int), "mutual",
+		    "mutual particle-particle gravity within each TreePiece");
+	param.bDepthFirstTree = 0;
+	prmAddParam(prm, "bDepthFirstTree", paramBool, &param.bDepthFirstTree,
+		    sizeof(int), "dftree",
+		    "reorder each local tree into one block in depth first order");
+	param.bRadixSort = 0;
+	prmAddParam(prm, "bRadixSort", paramBool, &param.bRadixSort,
+		    sizeof(int), "radixsort",
+		    "sort particles by key with a radix sort");
+	param.bCompactFill = 0;
+	prmAddParam(prm, "bCompactFill", paramBool, &param.bCompactFill,
+		    sizeof(int), "compactfill",
+		    "compact single precision node and particle cache fills");
+	param.bRetainNodes = 0;
+	prmAddParam(prm, "bRetainNodes", paramBool, &param.bRetainNodes,
+		    sizeof(int), "retainnodes",
+		    "keep remote node fills across the tree walks on one tree");
+	param.dCacheBudget = 0.0;
+	prmAddParam(prm, "dCacheBudget", paramDouble, &param.dCacheBudget,
+		    sizeof(double), "cachebudget",
+		    "<MB per processor for the node fills kept with bRetainNodes> = 0.0 (64 MB)");
+	param.bAdaptiveCacheDepth = 0;
+	prmAddParam(prm, "bAdaptiveCacheDepth", paramBool,
+		    &param.bAdaptiveCacheDepth, sizeof(int), "adaptdepth",
+		    "adapt the depth of node cache fills to the requester");
+	param.bHistoryPrefetch = 0;
+	prmAddParam(prm, "bHistoryPrefetch", paramBool,
+		    &param.bHistoryPrefetch, sizeof(int), "histprefetch",
+		    "prefetch the remote nodes requested on the last step at the same rung");
+	param.nBucketGroup = 0;
+	prmAddParam(prm, "nBucketGroup", paramInt, &param.nBucketGroup,
+		    sizeof(int), "bgroup",
+		    "<max particles in a bucket group sharing one interaction list> = 0 (off)");
+	param.dAccErrTol = 0.0;
+	prmAddParam(prm, "dAccErrTol", paramDouble, &param.dAccErrTol,
+		    sizeof(double), "accerr",
+		    "<relative opening criterion tolerance on |a| from the last step> = 0 (theta only)");
+	param.iInterListDump = 0;
+	prmAddParam(prm, "iInterListDump", paramInt, &param.iInterListDump,
+		    sizeof(int), "ildump",
+		    "<record the interaction lists of this gravity calculation to ilist.<TreePiece>> = 0 (off)");
 
 	param.bStaticTest = 0;
 	prmAddParam(prm, "bStaticTest", paramBool, &param.bStaticTest,
@@ -720,6 +846,10 @@ Main::Main(CkArgMsg* m) {
 	prmAddParam(prm, "dFracNoDomainDecomp", paramDouble,
 		    &param.dFracNoDomainDecomp, sizeof(double),"fndd",
 		    "Fraction of active particles for no new DD = 0.0");
+	param.dRefitTol = 0.0;
+	prmAddParam(prm, "dRefitTol", paramDouble, &param.dRefitTol,
+		    sizeof(double), "refittol",
+		    "<Relative growth of a bucket beyond which a tree refit on a step without a new DD falls back to a rebuild> = 0.0 (always rebuild)");
 	param.bConcurrentSph = 1;
 	prmAddParam(prm, "bConcurrentSph", paramBool, &param.bConcurrentSph,
 		    sizeof(int),"consph", "Enable SPH running concurrently with Gravity");
@@ -847,14 +977,11 @@ Main::Main(CkArgMsg* m) {
 	    ckerr << "bStandard parameter ignored; Output is always standard."
 		  << endl;
 	    }
-	if(prmSpecified(prm, "iOrder")) {
+	if(param.iOrder < 2 || param.iOrder > 4) {
 	    ckerr << "WARNING: ";
-#ifdef HEXADECAPOLE
-	    ckerr << "iOrder parameter ignored; expansion order is 4."
-#else
-	    ckerr << "iOrder parameter ignored; expansion order is 2."
-#endif
+	    ckerr << "iOrder must be 2, 3 or 4; expansion order is 4."
 		  << endl;
+	    param.iOrder = 4;
 	    }
 	if(!prmSpecified(prm, "dTheta2")) {
 	    param.dTheta2 = param.dTheta;
@@ -867,6 +994,75 @@ Main::Main(CkArgMsg* m) {
 	dFracLoadBalance = param.dFracLoadBalance;
 	dGlassDamper = param.dGlassDamper;
 	_cacheLineDepth = param.cacheLineDepth;
+	bSoAGravity = param.bSoAGravity;
+	bFarFieldFloat = param.bFarFieldFloat;
+	bDepthFirstTree = param.bDepthFirstTree;
+	bRadixSort = param.bRadixSort;
+	bCompactFill = param.bCompactFill;
+#ifndef PUSH_GRAVITY
+	bRetainNodes = param.bRetainNodes;
+#else
+	if(param.bRetainNodes) {
+	    ckerr << "WARNING: bRetainNodes is not supported with PUSH_GRAVITY; ignored"
+		  << endl;
+	    }
+	bRetainNodes = 0;
+#endif
+	if(param.dCacheBudget > 0.0 && !bRetainNodes) {
+	    // The cache itself is released chunk by chunk (nChunks).
+	    ckerr << "WARNING: dCacheBudget only bounds the fills kept by bRetainNodes; ignored"
+		  << endl;
+	    }
+	dCacheBudget = param.dCacheBudget;
+	bAdaptiveCacheDepth = param.bAdaptiveCacheDepth;
+	iMultipoleOrder = param.iOrder;
+#if INTERLIST_VER > 0
+	nBucketGroup = param.nBucketGroup;
+#else
+	if(param.nBucketGroup > 0) {
+	    ckerr << "WARNING: nBucketGroup needs an interaction list build; ignored"
+		  << endl;
+	    }
+	nBucketGroup = 0;
+#endif
+	dAccErrTol = param.dAccErrTol;
+#if INTERLIST_VER > 0 && !defined(CUDA)
+	iInterListDump = param.iInterListDump;
+#else
+	if(param.iInterListDump > 0) {
+	    ckerr << "WARNING: iInterListDump needs a CPU interaction list build; ignored"
+		  << endl;
+	    }
+	iInterListDump = 0;
+#endif
+	nEwaldTable = param.nEwaldTable;
+	if(nEwaldTable < 0) {
+	    ckerr << "WARNING: nEwaldTable must be positive; using the exact sum"
+		  << endl;
+	    nEwaldTable = 0;
+	    }
+	if(bSoAGravity && bFarFieldFloat) {
+	    ckerr << "WARNING: bSoAGravity is ignored with bFarFieldFloat"
+		  << endl;
+	    }
+#if INTERLIST_VER > 0 && !defined(CUDA)
+	bFmmGravity = param.bFmmGravity;
+#else
+	if(param.bFmmGravity) {
+	    ckerr << "WARNING: bFmmGravity needs an interaction list build without CUDA; ignored"
+		  << endl;
+	    }
+	bFmmGravity = 0;
+#endif
+#if INTERLIST_VER > 0 && !defined(CUDA)
+	bMutualGravity = param.bMutualGravity;
+#else
+	if(param.bMutualGravity) {
+	    ckerr << "WARNING: bMutualGravity needs an interaction list build without CUDA; ignored"
+		  << endl;
+	    }
+	bMutualGravity = 0;
+#endif
 	verbosity = param.iVerbosity;
 	nIOProcessor = param.nIOProcessor;
 #if CMK_SMP
@@ -968,6 +1164,78 @@ Main::Main(CkArgMsg* m) {
 	    param.vPeriod = Vector3D<double>(1.0e38);
 	    param.bEwald = 0;
 	    }
+	/*
+	 ** TreePM: the mesh replaces the Ewald sum, and the tree only
+	 ** sums the short range force, which the mixed precision, SoA
+	 ** and FMM kernels do not know about.
+	 */
+	if(param.nPMGrid > 0) {
+#if CMK_SSE || defined(CUDA)
+	    ckerr << "WARNING: nPMGrid needs a build without SSE or CUDA; ignored"
+		  << endl;
+	    param.nPMGrid = 0;
+#endif
+	    }
+	if(param.nPMGrid > 0) {
+	    if(!param.bPeriodic || param.vPeriod.x != param.vPeriod.y
+	       || param.vPeriod.x != param.vPeriod.z) {
+		ckerr << "WARNING: nPMGrid needs a periodic cubic box; ignored"
+		      << endl;
+		param.nPMGrid = 0;
+		}
+	    else if(param.nPMGrid < 8
+		    || (param.nPMGrid & (param.nPMGrid - 1)) != 0) {
+		ckerr << "WARNING: nPMGrid must be a power of two of at least 8; ignored"
+		      << endl;
+		param.nPMGrid = 0;
+		}
+	    else if(param.iPMAssign != 1 && param.iPMAssign != 2) {
+		ckerr << "WARNING: iPMAssign must be 1 (CIC) or 2 (TSC); using TSC"
+		      << endl;
+		param.iPMAssign = 2;
+		}
+	    }
+	nPMGrid = param.nPMGrid;
+	iPMAssign = param.iPMAssign;
+	if(nPMGrid > 0) {
+	    nPMSlabs = std::min(nPMGrid, CkNumPes());
+	    dPMSplit = param.dPMAsmth*param.vPeriod.x/nPMGrid;
+	    dPMCut = param.dPMRcut*dPMSplit;
+	    if(dPMCut > 0.5*param.vPeriod.x)
+		ckerr << "WARNING: TreePM cutoff exceeds half the box; increase nPMGrid"
+		      << endl;
+	    if(param.nReplicas < 1)
+		param.nReplicas = 1;
+	    param.bEwald = 0;
+	    if(bFarFieldFloat || bSoAGravity || bFmmGravity || bMutualGravity) {
+		ckerr << "WARNING: bFarFieldFloat, bSoAGravity, bFmmGravity and bMutualGravity are ignored with nPMGrid"
+		      << endl;
+		param.bFarFieldFloat = bFarFieldFloat = 0;
+		param.bSoAGravity = bSoAGravity = 0;
+		param.bFmmGravity = bFmmGravity = 0;
+		param.bMutualGravity = bMutualGravity = 0;
+		}
+	    }
+	else {
+	    nPMSlabs = 0;
+	    dPMSplit = 0.0;
+	    dPMCut = 0.0;
+	    }
+#if defined(CUDA) || defined(PUSH_GRAVITY) || defined(MERGE_REMOTE_REQUESTS)
+	if(param.dRefitTol > 0.0) {
+	    ckerr << "WARNING: dRefitTol is not supported in this build; ignored"
+		  << endl;
+	    param.dRefitTol = 0.0;
+	    }
+#endif
+	if(param.bHistoryPrefetch && (param.dRefitTol <= 0.0 || !_prefetch)) {
+	    // Node keys only carry over from one walk to the next
+	    // on a refitted tree.
+	    ckerr << "WARNING: bHistoryPrefetch needs bPrefetch and dRefitTol > 0; ignored"
+		  << endl;
+	    param.bHistoryPrefetch = 0;
+	    }
+	bHistoryPrefetch = param.bHistoryPrefetch;
 #ifdef CUDA
           double mil = 1e6;
           localNodesPerReq = (int) (localNodesPerReqDouble * mil);
@@ -1145,6 +1413,12 @@ Main::Main(CkArgMsg* m) {
 	}
 
         if (_nocache) _cacheLineDepth = 0;
+	if(bAdaptiveCacheDepth && (useTree == Binary_ORB || _cacheLineDepth == 0)) {
+	    // The requester is located by the key of its particles.
+	    ckerr << "WARNING: bAdaptiveCacheDepth needs an SFC decomposition and a cache depth; ignored"
+		  << endl;
+	    bAdaptiveCacheDepth = 0;
+	    }
 
 	if(verbosity) {
 	  ckerr<<"cache "<<_cache << (_nocache?" (disabled)":"") <<endl;
@@ -1218,6 +1492,8 @@ Main::Main(CkArgMsg* m) {
 #endif
 
         peTreeMergerProxy = CProxy_PETreeMerger::ckNew();
+        if(nPMGrid > 0)
+            pmProxy = CProxy_PMSlab::ckNew(nPMSlabs);
         dfDataProxy = CProxy_DumpFrameData::ckNew();
 	
 	// create CacheManagers
@@ -1461,7 +1737,8 @@ inline int Main::nextMaxRungIncDF(int nextMaxRung)
     return nextMaxRung;
 }
 
-/// @brief wait for gravity in the case of concurrent SPH
+/// @brief wait for gravity in the case of concurrent SPH, then add
+/// the TreePM long range force.
 inline void Main::waitForGravity(const CkCallback &cb, double startTime,
                                  int activeRung) 
 {
@@ -1477,6 +1754,9 @@ inline void Main::waitForGravity(const CkCallback &cb, double startTime,
       }
 #endif
     }
+    // The tree only did the short range part of a TreePM split
+    if(param.bDoGravity && nPMGrid > 0)
+        pmGravity(activeRung);
         double tGrav = CkWallTimer()-startTime;
         timings[activeRung].tGrav += tGrav;
         CkPrintf("Calculating gravity and SPH took %g seconds.\n", tGrav);
@@ -1500,6 +1780,7 @@ void Main::advanceBigStep(int iStep) {
   int nextMaxRung = 0; // the rung that determines the smallest time for advancing
 
   while (currentStep < MAXSUBSTEPS) {
+    bool bKeepTree = false; // tree kept through the drift for a refit
 
     if(!param.bStaticTest) {
       CkAssert(param.dDelta != 0.0);
@@ -1579,6 +1860,8 @@ void Main::advanceBigStep(int iStep) {
 	  }
       
       double dTimeSub = RungToDt(param.dDelta, driftRung);
+      bKeepTree = keepTreeForRefit(currentStep,
+			currentStep + driftSteps*RungToSubsteps(driftRung));
       // Drift of smallest step
       for(int iSub = 0; iSub < driftSteps; iSub++) 
 	  {
@@ -1596,7 +1879,8 @@ void Main::advanceBigStep(int iStep) {
 	      double dKickFac = csmComoveKickFac(param.csm, dTime, dTimeSub);
 	      bool buildTree = (iSub + 1 == driftSteps);
 	      treeProxy.drift(dDriftFac, param.bDoGas, param.bGasIsothermal,
-			      dKickFac, dTimeSub, nGrowMassDrift, buildTree,
+			      dKickFac, dTimeSub, nGrowMassDrift,
+			      buildTree && !bKeepTree, bKeepTree,
 			      CkCallbackResumeThread());
               double tDrift = CkWallTimer() - startTime;
               timings[activeRung].tDrift += tDrift;
@@ -1686,68 +1970,83 @@ void Main::advanceBigStep(int iStep) {
     if(verbosity > 1)
 	memoryStats();
 
-    /***** Resorting of particles and Domain Decomposition *****/
-    CkPrintf("Domain decomposition ... ");
+    /***** Tree refit *****/
     double startTime;
-    bool bDoDD = param.dFracNoDomainDecomp*nTotalParticles < nActiveGrav;
+    bool bRefitted = false;
+    if(bKeepTree) {
+	CkPrintf("Refitting trees ... ");
+	startTime = CkWallTimer();
+	bRefitted = refitTree();
+	double tTB = CkWallTimer()-startTime;
+	timings[activeRung].tTBuild += tTB;
+	CkPrintf("%s %g seconds.\n", bRefitted ? "took" : "rebuilding after",
+		 tTB);
+	}
 
-    startTime = CkWallTimer();
-    if (bDoDD) {
-      sorter.startSorting(dataManagerID, ddTolerance,
-                        CkCallbackResumeThread(), bDoDD);
-    } else {
-      CkReductionMsg *isTPEmpty;
-      treeProxy.unshuffleParticlesWoDD(CkCallbackResumeThread((void*&)isTPEmpty));
-
-      // After shuffling of particles based on the previous splitter, if any
-      // TreePiece ends up with no particles, then startSorting needs to be
-      // called as we cannot handle the case where there are empty TreePieces in
-      // the middle.
-      if (*((int*)isTPEmpty->getData())) {
-        sorter.startSorting(dataManagerID, ddTolerance,
-            CkCallbackResumeThread(), bDoDD);
-      }
-      delete isTPEmpty;
-    }
-    double tDD = CkWallTimer()-startTime;
-    timings[activeRung].tDD += tDD;
-    CkPrintf("total %g seconds.\n", tDD);
+    if(!bRefitted) {
+        /***** Resorting of particles and Domain Decomposition *****/
+        CkPrintf("Domain decomposition ... ");
+        bool bDoDD = param.dFracNoDomainDecomp*nTotalParticles < nActiveGrav;
 
-    if(verbosity && !bDoDD)
-	CkPrintf("Skipped DD\n");
+        startTime = CkWallTimer();
+        if (bDoDD) {
+          sorter.startSorting(dataManagerID, ddTolerance,
+                            CkCallbackResumeThread(), bDoDD);
+        } else {
+          CkReductionMsg *isTPEmpty;
+          treeProxy.unshuffleParticlesWoDD(CkCallbackResumeThread((void*&)isTPEmpty));
+
+          // After shuffling of particles based on the previous splitter, if any
+          // TreePiece ends up with no particles, then startSorting needs to be
+          // called as we cannot handle the case where there are empty TreePieces in
+          // the middle.
+          if (*((int*)isTPEmpty->getData())) {
+            sorter.startSorting(dataManagerID, ddTolerance,
+                CkCallbackResumeThread(), bDoDD);
+          }
+          delete isTPEmpty;
+        }
+        double tDD = CkWallTimer()-startTime;
+        timings[activeRung].tDD += tDD;
+        CkPrintf("total %g seconds.\n", tDD);
 
-    if(verbosity > 1)
-	memoryStats();
-    /********* Load balancer ********/
-    //ckout << "Load balancer ...";
-    CkPrintf("Load balancer ... ");
-    startTime = CkWallTimer();
-    treeProxy.startlb(CkCallbackResumeThread(), activeRung);
-    double tLB = CkWallTimer()-startTime;
-    timings[activeRung].tLoadB += tLB;
-    CkPrintf("took %g seconds.\n", tLB);
+        if(verbosity && !bDoDD)
+	    CkPrintf("Skipped DD\n");
 
-    if(verbosity > 1)
-	memoryStats();
+        if(verbosity > 1)
+	    memoryStats();
+        /********* Load balancer ********/
+        //ckout << "Load balancer ...";
+        CkPrintf("Load balancer ... ");
+        startTime = CkWallTimer();
+        treeProxy.startlb(CkCallbackResumeThread(), activeRung);
+        double tLB = CkWallTimer()-startTime;
+        timings[activeRung].tLoadB += tLB;
+        CkPrintf("took %g seconds.\n", tLB);
 
+        if(verbosity > 1)
+	    memoryStats();
+	}
 
 #ifdef PUSH_GRAVITY
     bool bDoPush = param.dFracPushParticles*nTotalParticles > nActiveGrav;
     if(bDoPush) CkPrintf("[main] fracActive %f PUSH_GRAVITY\n", 1.0*nActiveGrav/nTotalParticles);
 #endif
 
-    /******** Tree Build *******/
-    //ckout << "Building trees ...";
-    CkPrintf("Building trees ... ");
-    startTime = CkWallTimer();
+    if(!bRefitted) {
+        /******** Tree Build *******/
+        //ckout << "Building trees ...";
+        CkPrintf("Building trees ... ");
+        startTime = CkWallTimer();
 #ifdef PUSH_GRAVITY
-    treeProxy.buildTree(bucketSize, CkCallbackResumeThread(),!bDoPush);
+        treeProxy.buildTree(bucketSize, CkCallbackResumeThread(),!bDoPush);
 #else
-    treeProxy.buildTree(bucketSize, CkCallbackResumeThread());
+        treeProxy.buildTree(bucketSize, CkCallbackResumeThread());
 #endif
-    double tTB =  CkWallTimer()-startTime;
-    timings[activeRung].tTBuild += tTB;
-    CkPrintf("took %g seconds.\n", tTB);
+        double tTB =  CkWallTimer()-startTime;
+        timings[activeRung].tTBuild += tTB;
+        CkPrintf("took %g seconds.\n", tTB);
+	}
 
     CkCallback cbGravity(CkCallback::resumeThread);
     if(verbosity > 1)
@@ -1953,6 +2252,63 @@ void Main::advanceBigStep(int iStep) {
 
   }
 }
+
+///
+/// @brief Decide whether the drift to the next substep keeps the tree.
+/// @param iStep The substep the drift starts from.
+/// @param iNextStep The substep the drift ends on.
+///
+/// The tree is only kept for a refit (see refitTree()) within a big
+/// step, since output reorders the particles, and when the next
+/// substep would not do a domain decomposition anyway.  Substeps that
+/// form stars or have sinks change the particles and always rebuild.
+///
+bool Main::keepTreeForRefit(int iStep, int iNextStep)
+{
+    if(param.dRefitTol <= 0.0 || useTree != Binary_Oct)
+	return false;
+    if(iStep == 0 || iNextStep >= MAXSUBSTEPS || param.sinks.bDoSinks)
+	return false;
+
+    int iNextRung = 0;
+    int tmpRung = iNextStep;
+    while (tmpRung &= ~MAXSUBSTEPS) {
+	iNextRung++;
+	tmpRung <<= 1;
+	}
+    if((param.bStarForm || param.bFeedback)
+       && param.stfm->isStarFormRung(iNextRung))
+	return false;
+
+    CkReductionMsg *msg;
+    treeProxy.countActive(iNextRung, CkCallbackResumeThread((void*&)msg));
+    int64_t nActive = ((int64_t *)msg->getData())[0];
+    delete msg;
+    return param.dFracNoDomainDecomp*nTotalParticles >= nActive;
+    }
+
+///
+/// @brief Refit the trees kept through the last drift.
+/// @return false if a bucket grew beyond dRefitTol and the trees
+/// were discarded instead; the caller then does the usual domain
+/// decomposition and tree build.
+///
+bool Main::refitTree()
+{
+    CkReductionMsg *msg;
+    treeProxy.refitTree(param.dRefitTol, CkCallbackResumeThread((void*&)msg));
+    int bRebuild = *(int *)msg->getData();
+    delete msg;
+    if(bRebuild) {
+	if(verbosity)
+	    CkPrintf("Refit exceeded dRefitTol, rebuilding\n");
+	treeProxy.drift(0.0, 0, 0, 0.0, 0.0, 0, true, false,
+			CkCallbackResumeThread());
+	return false;
+	}
+    treeProxy.refitMoments(CkCallbackResumeThread());
+    return true;
+    }
     
 ///
 /// @brief Load particles into pieces
@@ -2133,6 +2489,12 @@ void Main::setupICs() {
 #ifdef CMK_USE_AVX
   ofsLog << " CMK_USE_AVX";
 #endif
+#ifdef CMK_USE_AVX2
+  ofsLog << " CMK_USE_AVX2";
+#endif
+#ifdef CMK_USE_AVX512
+  ofsLog << " CMK_USE_AVX512";
+#endif
 #ifdef COSMO_FLOAT
   ofsLog << " COSMO_FLOAT";
 #endif
@@ -2172,9 +2534,6 @@ void Main::setupICs() {
 #ifdef VSIGVISC
   ofsLog << " VSIGVISC";
 #endif
-#ifdef HEXADECAPOLE
-  ofsLog << " HEXADECAPOLE";
-#endif
 #ifdef INTERLIST_VER
   ofsLog << " INTERLIST_VER:" << INTERLIST_VER;
 #endif
@@ -2254,7 +2613,7 @@ void Main::setupICs() {
 	
 // for periodic, puts all particles within the boundary
 // Also assigns keys and sorts.
-  treeProxy.drift(0.0, 0, 0, 0.0, 0.0, 0, true, CkCallbackResumeThread());
+  treeProxy.drift(0.0, 0, 0, 0.0, 0.0, 0, true, false, CkCallbackResumeThread());
 
   initialForces();
 }
@@ -2375,13 +2734,75 @@ Main::restart(CkCheckpointStatusMsg *msg)
 	prmAddParam(prm, "dFracNoDomainDecomp", paramDouble,
 		    &param.dFracNoDomainDecomp, sizeof(double),"fndd",
 		    "Fraction of active particles for no new DD = 0.0");
+	prmAddParam(prm, "dRefitTol", paramDouble, &param.dRefitTol,
+		    sizeof(double), "refittol",
+		    "<Relative growth of a bucket beyond which a tree refit on a step without a new DD falls back to a rebuild> = 0.0 (always rebuild)");
 	prmAddParam(prm, "bUseCkLoopPar", paramBool, &param.bUseCkLoopPar, sizeof(int),
 		    "useckloop", "enable CkLoop to parallelize within node");
+	prmAddParam(prm, "bSoAGravity", paramBool, &param.bSoAGravity,
+		    sizeof(int), "soagrav",
+		    "pack interaction lists for streaming gravity kernels");
+	prmAddParam(prm, "bFarFieldFloat", paramBool, &param.bFarFieldFloat,
+		    sizeof(int), "farfloat",
+		    "single precision for unsoftened cell interactions");
+	prmAddParam(prm, "bFmmGravity", paramBool, &param.bFmmGravity,
+		    sizeof(int), "fmm",
+		    "cell-cell (FMM) gravity within each TreePiece");
+	prmAddParam(prm, "bMutualGravity", paramBool, &param.bMutualGravity,
+		    sizeof(int), "mutual",
+		    "mutual particle-particle gravity within each TreePiece");
+	prmAddParam(prm, "bDepthFirstTree", paramBool, &param.bDepthFirstTree,
+		    sizeof(int), "dftree",
+		    "reorder each local tree into one block in depth first order");
+	prmAddParam(prm, "bRadixSort", paramBool, &param.bRadixSort,
+		    sizeof(int), "radixsort",
+		    "sort particles by key with a radix sort");
+	prmAddParam(prm, "bCompactFill", paramBool, &param.bCompactFill,
+		    sizeof(int), "compactfill",
+		    "compact single precision node and particle cache fills");
+	prmAddParam(prm, "bRetainNodes", paramBool, &param.bRetainNodes,
+		    sizeof(int), "retainnodes",
+		    "keep remote node fills across the tree walks on one tree");
+	prmAddParam(prm, "dCacheBudget", paramDouble, &param.dCacheBudget,
+		    sizeof(double), "cachebudget",
+		    "<MB per processor for the node fills kept with bRetainNodes> = 0.0 (64 MB)");
+	prmAddParam(prm, "bAdaptiveCacheDepth", paramBool,
+		    &param.bAdaptiveCacheDepth, sizeof(int), "adaptdepth",
+		    "adapt the depth of node cache fills to the requester");
+	prmAddParam(prm, "bHistoryPrefetch", paramBool,
+		    &param.bHistoryPrefetch, sizeof(int), "histprefetch",
+		    "prefetch the remote nodes requested on the last step at the same rung");
+	prmAddParam(prm, "iOrder", paramInt, &param.iOrder,
+		    sizeof(int), "or",
+		    "Multipole expansion order: 2, 3 or 4");
+	prmAddParam(prm, "nBucketGroup", paramInt, &param.nBucketGroup,
+		    sizeof(int), "bgroup",
+		    "<max particles in a bucket group sharing one interaction list> = 0 (off)");
+	prmAddParam(prm, "dAccErrTol", paramDouble, &param.dAccErrTol,
+		    sizeof(double), "accerr",
+		    "<relative opening criterion tolerance on |a| from the last step> = 0 (theta only)");
+	prmAddParam(prm, "iInterListDump", paramInt, &param.iInterListDump,
+		    sizeof(int), "ildump",
+		    "<record the interaction lists of this gravity calculation to ilist.<TreePiece>> = 0 (off)");
+	prmAddParam(prm, "nEwaldTable", paramInt, &param.nEwaldTable,
+		    sizeof(int), "ewtable",
+		    "<grid intervals per dimension of the tabulated (monopole) Ewald correction> = 0 (exact)");
 
         int processSimfile = 0; 
 	if(!prmArgProc(prm,CmiGetArgc(args->argv),args->argv,processSimfile)) {
 	    CkExit();
 	}
+	if(param.nPMGrid > 0
+	   && (param.bFarFieldFloat || param.bSoAGravity || param.bFmmGravity
+	       || param.bMutualGravity)) {
+	    // Same restriction as at startup.
+	    ckerr << "WARNING: bFarFieldFloat, bSoAGravity, bFmmGravity and bMutualGravity are ignored with nPMGrid"
+		  << endl;
+	    param.bFarFieldFloat = 0;
+	    param.bSoAGravity = 0;
+	    param.bFmmGravity = 0;
+	    param.bMutualGravity = 0;
+	    }
 	
 	dMProxy.resetReadOnly(param, CkCallbackResumeThread());
   if (bUseCkLoopPar) {
@@ -2389,7 +2810,7 @@ Main::restart(CkCheckpointStatusMsg *msg)
   } else {
     CkPrintf("Not Using CkLoop %d\n", param.bUseCkLoopPar);
   }
-	treeProxy.drift(0.0, 0, 0, 0.0, 0.0, 0, true, CkCallbackResumeThread());
+	treeProxy.drift(0.0, 0, 0, 0.0, 0.0, 0, true, false, CkCallbackResumeThread());
 	if(param.bGasCooling || param.bStarForm) 
 	    initCooling();
 	if(param.bStarForm)
@@ -2559,6 +2980,8 @@ Main::initialForces()
         turnProjectionsOff();
 #endif
       }
+  if(param.bDoGravity && nPMGrid > 0)
+      pmGravity(0);
   
   if (param.sinks.bDoSinksAtStart) doSinks(dTime, 0.0, 0);
 
@@ -2628,6 +3051,12 @@ Main::doSimulation()
 #endif
   timings.resize(PHASE_FEEDBACK+1);
 
+  // Clear the cache statistics of the initial forces, so that each
+  // step only reports its own walks.
+  CkReductionMsg *msgCacheStats;
+  treeProxy.cacheStats(CkCallbackResumeThread((void*&)msgCacheStats));
+  delete msgCacheStats;
+
   for(int iStep = param.iStartStep+1; iStep <= param.nSteps; iStep++){
     if (killAt > 0 && killAt == iStep) {
       ckout << "KillAT: Stopping after " << (CkWallTimer()-dSimStartTime) << " seconds\n";
@@ -2645,6 +3074,7 @@ Main::doSimulation()
     ckout << "Big step " << iStep << " took " << stepTime << " seconds."
 	  << endl;
     writeTimings(iStep);
+    writeCacheStats(iStep);
 
     if(iStep%param.iOrbitOutInterval == 0) {
 	outputBlackHoles(dTime);
@@ -2687,7 +3117,7 @@ Main::doSimulation()
 	    }
 	// The following drift is called because it deletes the tree
 	// so it won't be saved on disk.
-	treeProxy.drift(0.0, 0, 0, 0.0, 0.0, 0, false, CkCallbackResumeThread());
+	treeProxy.drift(0.0, 0, 0, 0.0, 0.0, 0, false, false, CkCallbackResumeThread());
 	treeProxy[0].flushStarLog(CkCallbackResumeThread());
 	param.iStartStep = iStep; // update so that restart continues on
 	bIsRestarting = 0;
@@ -2852,7 +3282,7 @@ Main::doSimulation()
       if(param.bDoGas && param.bDoDensity) {
 	  // The following call is to get the particles in key order
 	  // before the sort.
-	  treeProxy.drift(0.0, 0, 0, 0.0, 0.0, 0, true, CkCallbackResumeThread());
+	  treeProxy.drift(0.0, 0, 0, 0.0, 0.0, 0, true, false, CkCallbackResumeThread());
 	  sorter.startSorting(dataManagerID, ddTolerance,
 			      CkCallbackResumeThread(), true);
 #ifdef PUSH_GRAVITY
@@ -3009,6 +3439,48 @@ Main::writeTimings(int iStep)
     fclose(fpTime);
 }
 
+///
+/// @brief Write out the remote cache counters of the step
+/// @param iStep Step number
+///
+/// Each line of the .cachestats file is: step, cache (node, gravpart
+/// or smoothpart), chunk, requests, hits, misses, duplicate requests
+/// of fills in flight, misses answered from retained node fills
+/// (bRetainNodes), misses on retained fills dropped to stay within
+/// the NodeFillStore budget, bytes received and the histogram of fill
+/// latencies in CacheStats::nLatencyBins power of two bins starting
+/// at 1 microsecond.
+///
+void
+Main::writeCacheStats(int iStep)
+{
+    CkReductionMsg *msg;
+    treeProxy.cacheStats(CkCallbackResumeThread((void*&)msg));
+    int64_t *counts = (int64_t *) msg->getData();
+    const int nCounters = CacheStats::nCounters;
+    const int nChunks = msg->getSize()/(3*nCounters*sizeof(int64_t));
+    const char *achCache[3] = {"node", "gravpart", "smoothpart"};
+
+    string achStatsFileName = string(param.achOutName) + ".cachestats";
+    FILE *fpStats = fopen(achStatsFileName.c_str(), "a");
+    CkAssert(fpStats != NULL);
+
+    fprintf(fpStats, "# Cache statistics for step %d\n", iStep);
+    fprintf(fpStats, "# Step Cache Chunk Requests Hits Misses Duplicates Retained Refetches Bytes Latency[0-%d]\n",
+            CacheStats::nLatencyBins - 1);
+    for(int i = 0; i < 3; i++) {
+        for(int c = 0; c < nChunks; c++) {
+            int64_t *cc = counts + (i*nChunks + c)*nCounters;
+            fprintf(fpStats, "%d %s %d", iStep, achCache[i], c);
+            for(int j = 0; j < nCounters; j++)
+                fprintf(fpStats, " %lld", (long long) cc[j]);
+            fprintf(fpStats, "\n");
+            }
+        }
+    fclose(fpStats);
+    delete msg;
+}
+
 ///
 /// \brief Calculate various energy and momentum quantities, and output them
 /// to a log file.
@@ -3358,7 +3830,7 @@ void Main::writeOutput(int iStep)
     if(param.nSteps != 0 && param.bDoDensity) {
 	// The following call is to get the particles in key order
 	// before the sort.
-	treeProxy.drift(0.0, 0, 0, 0.0, 0.0, 0, true, CkCallbackResumeThread());
+	treeProxy.drift(0.0, 0, 0, 0.0, 0.0, 0, true, false, CkCallbackResumeThread());
 	sorter.startSorting(dataManagerID, ddTolerance,
 			    CkCallbackResumeThread(), true);
 #ifdef PUSH_GRAVITY
@@ -3407,7 +3879,7 @@ void Main::writeOutput(int iStep)
 	    startTime = CkWallTimer();
 	    // The following call is to get the particles in key order
 	    // before the sort.
-	    treeProxy.drift(0.0, 0, 0, 0.0, 0.0, 0, true, CkCallbackResumeThread());
+	    treeProxy.drift(0.0, 0, 0, 0.0, 0.0, 0, true, false, CkCallbackResumeThread());
 	    sorter.startSorting(dataManagerID, ddTolerance,
 				CkCallbackResumeThread(), true);
 #ifdef PUSH_GRAVITY
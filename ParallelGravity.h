@@ -19,6 +19,7 @@
 #include "SFC.h"
 #include "TreeNode.h"
 #include "GenericTreeNode.h"
+#include "Ewald.h"
 #include "Interval.h"
 #include "parameters.h"
 #include "param.h"
@@ -142,6 +143,27 @@ extern double dMaxBalance;
 extern double dFracLoadBalance;
 extern double dGlassDamper;
 extern int bUseCkLoopPar;
+extern int bSoAGravity;
+extern int bFarFieldFloat;
+extern int bFmmGravity;
+extern int bMutualGravity;
+extern int bDepthFirstTree;
+extern int bRadixSort;
+extern int bCompactFill;
+extern int bRetainNodes;
+extern double dCacheBudget;
+extern int bAdaptiveCacheDepth;
+extern int bHistoryPrefetch;
+extern int iMultipoleOrder;
+extern int nBucketGroup;
+extern double dAccErrTol;
+extern int iInterListDump;
+extern int nEwaldTable;
+extern int nPMGrid;
+extern int nPMSlabs;
+extern int iPMAssign;
+extern double dPMSplit;
+extern double dPMCut;
 extern GenericTrees useTree;
 extern CProxy_TreePiece treeProxy;
 #ifdef REDUCTION_HELPER
@@ -159,6 +181,7 @@ extern int nIOProcessor;
 
 extern CProxy_DumpFrameData dfDataProxy;
 extern CProxy_PETreeMerger peTreeMergerProxy;
+extern CProxy_PMSlab pmProxy;
 extern CProxy_CkCacheManager<KeyType> cacheGravPart;
 extern CProxy_CkCacheManager<KeyType> cacheSmoothPart;
 extern CProxy_CkCacheManager<KeyType> cacheNode;
@@ -513,6 +536,7 @@ class Main : public CBase_Main {
        
        CkVec<timing_fields> timings;  ///< One element for each rung.
        void writeTimings(int iStep);
+       void writeCacheStats(int iStep);
 
 #ifdef SELECTIVE_TRACING
        int monitorRung;
@@ -541,7 +565,10 @@ public:
 	void restart(CkCheckpointStatusMsg *msg);
 	void waitForGravity(const CkCallback &cb, double startTime,
             int activeRung);
+	void pmGravity(int activeRung);
         void advanceBigStep(int);
+	bool keepTreeForRefit(int iStep, int iNextStep);
+	bool refitTree();
 	int adjust(int iKickRung);
 	void rungStats();
 	void countActive(int activeRung);
@@ -584,14 +611,6 @@ public:
 	void liveVizImagePrep(liveVizRequestMsg *msg);
 };
 
-/* IBM brain damage */
-#undef hz
-/// @brief Coefficients for the Fourier space part of the Ewald sum.
-typedef struct ewaldTable {
-  double hx,hy,hz;
-  double hCfac,hSfac;
-} EWT;
-
 // jetley
 class MissRecord;
 class State;
@@ -607,9 +626,7 @@ typedef struct OffsetNodeStruct
 /// @brief Queue of nodes to check for interactions.
 typedef CkQ<OffsetNode> CheckList;
 /// @brief Vector of nodes that are undecided at this level.
-typedef CkVec<OffsetNode> UndecidedList;
-/// @brief Vector of undecided lists, one for each level.
-typedef CkVec<UndecidedList> UndecidedLists;
+typedef ArenaList<OffsetNode> UndecidedList;
 #endif
 
 /// @brief Remote particles in an interaction list.
@@ -705,6 +722,8 @@ struct NonLocalMomentsClientList {
   }
 };
 
+typedef NodeKeyTable<NonLocalMomentsClientList> NonLocalMomentsClientTable;
+
 /// Fundamental structure that holds particle and tree data.
 class TreePiece : public CBase_TreePiece {
    // jetley
@@ -737,6 +756,13 @@ class TreePiece : public CBase_TreePiece {
 #endif
    Compute *sGravity, *sPrefetch;
    SmoothCompute *sSmooth;
+   /// DualTreeWalk, Compute and State of the local dual walk (FMM or
+   /// mutual gravity) while it is split over nextDualPairs() calls.
+   TreeWalk *twDual;
+   Compute *cDual;
+   State *sDualState;
+   /// Periodic replica the dual walk is on.
+   int iDualReplica;
    
    Opt *sLocal, *sRemote, *sPref;
    Opt *optSmooth;
@@ -795,6 +821,7 @@ class TreePiece : public CBase_TreePiece {
   State *getSLocalGravityState(){ return sLocalGravityState; }
 #endif
   void memCacheStats(const CkCallback &cb);
+  void cacheStats(const CkCallback &cb);
   void addActiveWalk(int iAwi, TreeWalk *tw, Compute *c, Opt *o, State *s);
 
   /// @brief Called when walk on the current TreePiece is done.
@@ -833,6 +860,11 @@ class TreePiece : public CBase_TreePiece {
   /// Start prefetching the specfied chunk; prefetch compute
   /// calls startRemoteChunk() once chunk prefetch is complete
   void initiatePrefetch(int chunk);
+  /// Prefetch a chunk from the requests of the last walk instead
+  bool historyPrefetch(int chunk);
+  void savePrefetchHistory();
+  void recordPrefetch(Tree::NodeKey key, int remoteIndex, int chunk,
+		      int offset);
   /// Start a new remote computation upon prefetch finished
   void startRemoteChunk();
 
@@ -1067,6 +1099,19 @@ private:
 	/// Number of particles in my tree.  Can be different from
 	/// myNumParticles when particles are created.
 	int myTreeParticles;
+	/// Bounding box diagonal of each bucket when the tree was
+	/// built, to limit how far a refit can stretch it.
+	std::vector<double> bucketSizeBuilt;
+	/// The tree being completed is a refit, not a new build.
+	bool bRefitting;
+	/// Internal nodes with at most this many particles are left by
+	/// buildOctTree() for buildDeferredSubtrees(); 0 if not used.
+	int nTreeBuildSplit;
+	/// Subtree roots left by buildOctTree() in depth first order,
+	/// with their levels.
+	std::vector<std::pair<GenericTreeNode *, int> > deferredSubtrees;
+	/// Node pools of the subtrees, merged into pTreeNodes once built.
+	std::vector<NodePool *> deferredPools;
  public:
 	/// Total Particles in the simulation
 	int64_t nTotalParticles;
@@ -1098,6 +1143,9 @@ private:
 
 	/// List of all the node-buckets in this TreePiece
 	std::vector<GenericTreeNode *> bucketList;
+	/// File the interaction lists are recorded to (iInterListDump),
+	/// NULL when not recording
+	FILE *fpInterList;
 
 	/// Array with sorted particles for domain decomposition (ORB)
 	std::vector<GravityParticle> mySortedParticles;
@@ -1156,6 +1204,19 @@ private:
 	GenericTreeNode* root;
 	/// pool of memory to hold TreeNodes: makes allocation more efficient.
 	NodePool *pTreeNodes;
+	/// Backing store of pTreeNodes, kept from one tree to the next
+	/// and released in one step by deleteTree().
+	Arena nodeArena;
+	/// Backing store of the reordered tree (bDepthFirstTree), kept
+	/// and released like nodeArena.
+	Arena depthFirstArena;
+	/// Backing store of the states and interaction lists of the
+	/// gravity and prefetch walks, reset by freeWalkObjects().
+	Arena walkArena;
+	/// Backing store of the state of the smooth walk, reset by
+	/// finishSmoothWalk().  It is separate from walkArena since the
+	/// two walks can run at the same time (bConcurrentSph).
+	Arena smoothArena;
 
 	typedef std::map<NodeKey, CkVec<int>* >   MomentRequestType;
 	/// Keep track of the requests for remote moments not yet satisfied.
@@ -1183,9 +1244,19 @@ private:
 	EWT *ewt;
 	int nMaxEwhLoop;
 	int nEwhLoop;
-#ifdef HEXADECAPOLE
 	MOMC momcRoot;		/* complete moments of root */
-#endif
+	/// Node's tabulated Ewald correction, set by EwaldInit() if
+	/// nEwaldTable is used.
+	const EwaldTable *ewaldTable;
+	/// Sorted PM mesh cells my particles were assigned to
+	/// (pmDeposit()), with the potential and acceleration there.
+	std::vector<int64_t> pmCells;
+	std::vector<double> pmField;
+	/// First entry of pmCells held by each PMSlab.
+	std::vector<int> pmSlabOffset;
+	int nPMPending;		///< PMSlabs yet to answer
+	int pmActiveRung;
+	CkCallback cbPMDone;
 
 	int bGasCooling;
 #ifndef COOLING_NONE
@@ -1209,6 +1280,31 @@ private:
 	OrientedBox<double> prefetchReq[2];
 	unsigned int numPrefetchReq;
 
+	/// A remote node requested by a gravity walk (bHistoryPrefetch).
+	struct PrefetchRecord {
+	  Tree::NodeKey key;
+	  int remoteIndex;
+	  int chunk;
+	  int offset;		///< replica offset bits of the reqID
+	  int next;		///< next record with the same key, or -1
+	};
+	/// Nodes requested by the current gravity walk.
+	std::vector<PrefetchRecord> prefetchRecords;
+	/// First record of each key in prefetchRecords.
+	Tree::NodeKeyTable<int> prefetchRecordIndex;
+	/// Rung and tree build of the current gravity walk.
+	int prefetchRecordRung;
+	int prefetchRecordBuild;
+	/// Set while historyPrefetch() replays a history, whose requests
+	/// are not recorded.
+	bool bPrefetchReplay;
+	/// Nodes requested by the last gravity walk at each rung, and
+	/// the tree build they were requested on.
+	std::vector<std::vector<PrefetchRecord> > prefetchHistory;
+	std::vector<int> prefetchHistoryBuild;
+	/// Number of tree builds, not counting refits.
+	int iTreeBuild;
+
 	/// number of chunks in which the tree will be chopped for prefetching
 	int numChunks;
 
@@ -1337,6 +1433,8 @@ private:
     if(pTreeNodes != NULL) {
         delete pTreeNodes;
         pTreeNodes = NULL;
+        nodeArena.reset();
+        depthFirstArena.reset();
         root = NULL;
         nodeLookupTable.clear();
         }
@@ -1353,6 +1451,18 @@ private:
 	/// Recursive call to build the subtree with root "node", level
 	/// specifies the level at which "node" resides inside the tree
 	void buildOctTree(GenericTreeNode* node, int level);
+	/// Build the Internal subtrees left by buildOctTree() concurrently
+	void buildDeferredSubtrees();
+	/// Build a subtree with no remote nodes, allocating from pool and
+	/// touching no state shared with the rest of the tree
+	void buildLocalOctTree(GenericTreeNode* node, int level,
+			       NodePool *pool);
+	void linkLocalTree(GenericTreeNode* node, bool bDeferred,
+			   unsigned int &iDeferred);
+	/// Reorder the local tree into one depth first block (bDepthFirstTree)
+	void layoutDepthFirst();
+	void layoutChildren(BinaryTreeNode* node, BinaryTreeNode* nodes,
+			    int &next);
 #ifdef TREE_BREADTH_FIRST
 	void growBottomUp(GenericTreeNode* node);
 #endif
@@ -1376,6 +1486,9 @@ private:
 	/// Initialize all the buckets for the tree walk
 	/// @TODO: Eliminate this redundant copy!
 	void initBuckets();
+	/// Set accOldMin of the local nodes for the relative opening
+	/// criterion; must be called before initBuckets().
+	void setAccOldMin(GenericTreeNode *node);
 	template <class Tsmooth>
 	void initBucketsSmooth(Tsmooth tSmooth);
 	void smoothNextBucket();
@@ -1397,6 +1510,7 @@ public:
  TreePiece() : pieces(thisArrayID), root(0),
             prevLARung (-1), sTopDown(0), sGravity(0),
 	  sPrefetch(0), sLocal(0), sRemote(0), sPref(0), sSmooth(0), 
+	  twDual(0), cDual(0), sDualState(0),
 	  treePieceLoad(0.0), treePieceLoadTmp(0.0), treePieceLoadExp(0.0),
     treePieceActivePartsTmp(0) {
 	  //CkPrintf("[%d] TreePiece created on proc %d\n",thisIndex, CkMyPe());
@@ -1456,6 +1570,8 @@ public:
 	  numPrefetchReq = 0;
 	  ewt = NULL;
 	  nMaxEwhLoop = 100;
+	  ewaldTable = NULL;
+	  nPMPending = 0;
 
           incomingParticlesMsg.clear();
           incomingParticlesArrived = 0;
@@ -1468,10 +1584,17 @@ public:
 	  nStore = nStoreSPH = nStoreStar = 0;
           bBucketsInited = false;
 	  myTreeParticles = -1;
+	  bRefitting = false;
+	  nTreeBuildSplit = 0;
+	  prefetchRecordRung = -1;
+	  prefetchRecordBuild = 0;
+	  bPrefetchReplay = false;
+	  iTreeBuild = 0;
 	  orbBoundaries.clear();
 	  boxes = NULL;
 	  splitDims = NULL;
 	  bGasCooling = 0;
+	  fpInterList = NULL;
 
 #ifdef PUSH_GRAVITY
           createdSpanningTree = false;
@@ -1497,6 +1620,8 @@ public:
 	  prefetchRoots = NULL;
 	  //remaining Chunk = NULL;
           ewt = NULL;
+	  ewaldTable = NULL;
+	  nPMPending = 0;
 	  root = NULL;
 	  pTreeNodes = NULL;
 
@@ -1504,6 +1629,9 @@ public:
 	  sGravity = NULL;
 	  sPrefetch = NULL;
 	  sSmooth = NULL;
+	  twDual = NULL;
+	  cDual = NULL;
+	  sDualState = NULL;
 #if INTERLIST_VER > 0
 	  sInterListWalk = NULL;
 #endif
@@ -1521,6 +1649,13 @@ public:
 	  splitDims = NULL;
           bBucketsInited = false;
 	  myTreeParticles = -1;
+	  bRefitting = false;
+	  nTreeBuildSplit = 0;
+	  prefetchRecordRung = -1;
+	  prefetchRecordBuild = 0;
+	  bPrefetchReplay = false;
+	  iTreeBuild = 0;
+	  fpInterList = NULL;
 
 
           localTreeBuildComplete = false;
@@ -1567,6 +1702,7 @@ public:
 	void calculateEwald(dummyMsg *m);
   void calculateEwaldUsingCkLoop(dummyMsg *msg, int yield_num);
   void callBucketEwald(int id);
+  void buildDeferredSubtree(int i);
   void doParallelNextBucketWork(int id, LoopParData* lpdata);
 	void initCoolingData(const CkCallback& cb);
 	// Scale velocities (needed to convert to canonical momenta for
@@ -1686,7 +1822,7 @@ public:
 	    int bNeedVPred, int bGasIsothermal, double duDelta[MAXRUNG+1],
 	    const CkCallback& cb);
   void drift(double dDelta, int bNeedVPred, int bGasIsothermal, double dvDelta,
-	     double duDelta, int nGrowMass, bool buildTree,
+	     double duDelta, int nGrowMass, bool buildTree, bool bKeepTree,
 	     const CkCallback& cb);
   void initAccel(int iKickRung, const CkCallback& cb);
   void applyFrameAcc(int iKickRung, Vector3D<double> frameAcc, const CkCallback& cb);
@@ -1698,6 +1834,9 @@ public:
  */
   void externalGravity(int activeRung, const ExternalGravity exGrav,
                        const CkCallback& cb);
+  void pmDeposit(int activeRung, const CkCallback &cbCounts,
+                 const CkCallback &cbDone);
+  void pmForces(int iSlab, int n, double *values);
 /**
  * Adjust timesteps of active particles.
  * @param iKickRung The rung we are on.
@@ -1807,6 +1946,13 @@ public:
 
 	/// \brief Real tree build, independent of other TreePieces.
 	void startOctTreeBuild(CkReductionMsg* m);
+	/// \brief Refit the local part of the tree kept through the
+	/// drift; the first of the two steps replacing buildTree().
+	void refitTree(double dTol, const CkCallback& cb);
+	/// \brief Complete a refit by gathering the remote moments.
+	void refitMoments(const CkCallback& cb);
+	void refitLocalNode(GenericTreeNode *node);
+	void refitBoundaryNode(GenericTreeNode *node);
   void recvBoundary(SFC::Key key, NborDir dir);
 	void recvdBoundaries(CkReductionMsg* m);
 
@@ -1832,6 +1978,15 @@ public:
 	/// this TreePiece. The opening angle theta has already been passed
 	/// through startGravity().  This function just calls doAllBuckets().
 	void calculateGravityLocal();
+	/// Local computation with cell-cell (FMM) interactions; used
+	/// by calculateGravityLocal() when bFmmGravity is set.
+	void calculateGravityFmm();
+	/// Local computation with mutual bucket-bucket interactions;
+	/// used by calculateGravityLocal() when bMutualGravity is set.
+	void calculateGravityMutual();
+	/// Local computation by a DualTreeWalk with comp, which is
+	/// deleted once the walk is done.
+	void calculateGravityDual(Compute *comp);
 	/// Do some minor preparation for the local walkk then
 	/// calculateGravityLocal().
 	void commenceCalculateGravityLocal();
@@ -1894,6 +2049,11 @@ public:
 	/// @brief Receive a request for Nodes from a remote processor, copy the
 	/// data into it, and send back a message.
 	void fillRequestNode(CkCacheRequestMsg<KeyType> *msg);
+	/// @brief As fillRequestNode(), with a depth adapted to the
+	/// requester (bAdaptiveCacheDepth).
+	void fillRequestNodeDepth(Tree::NodeKey key, int replyTo,
+				  Tree::NodeKey requesterKey, int depthMax);
+	void replyNodeFill(CkCacheRequestMsg<KeyType> *msg, int depth);
 	/** @brief Receive the node from the cache as following a previous
 	 * request which returned NULL, and continue the treewalk of the bucket
 	 * which requested it with this new node.
@@ -1972,6 +2132,10 @@ public:
 	 */
         void nextBucket(dummyMsg *m);
   void nextBucketUsingCkLoop(dummyMsg *m);
+	/// Entry method used to split the local dual walk in pieces,
+	/// like nextBucket().  The buckets are finished after the last
+	/// piece.
+	void nextDualPairs(dummyMsg *m);
 
 	void report();
 	void printTreeViz(GenericTreeNode* node, std::ostream& os);
@@ -2010,12 +2174,11 @@ public:
         void sendRequestForNonLocalMoments(GenericTreeNode *pickedNode);
         void mergeNonLocalRequestsDone();
         //void addTreeBuildMomentsClient(GenericTreeNode *targetNode, TreePiece *client, GenericTreeNode *clientNode);
-        std::map<NodeKey,NonLocalMomentsClientList>::iterator createTreeBuildMomentsEntry(GenericTreeNode *pickedNode);
+        NonLocalMomentsClientTable::iterator createTreeBuildMomentsEntry(GenericTreeNode *pickedNode);
 
 
         private:
-        // XXX - hashtable instead of map
-        std::map<NodeKey,NonLocalMomentsClientList> nonLocalMomentsClients;
+        NonLocalMomentsClientTable nonLocalMomentsClients;
         bool localTreeBuildComplete;
         int getResponsibleIndex(int first, int last);
         
@@ -2024,8 +2187,9 @@ public:
         void accumulateMomentsFromChild(GenericTreeNode *parent, GenericTreeNode *child);
 
         void deliverMomentsToClients(GenericTreeNode *);
-        void deliverMomentsToClients(const std::map<NodeKey,NonLocalMomentsClientList>::iterator &it);
+        void deliverMomentsToClients(const NonLocalMomentsClientTable::iterator &it);
         void treeBuildComplete();
+        void contributeLocalTree();
         void processRemoteRequestsForMoments();
         void sendParticlesDuringDD(bool withqd);
         void mergeAllParticlesAndSaveCentroid();
@@ -0,0 +1,76 @@
+/** @file RadixSort.h
+ * Radix sort of particles by their space filling curve key.
+ *
+ * The keys are sorted, least significant byte first, together with
+ * the index of their particle, and the particles are then permuted
+ * in place so that each one is moved once.  Bytes on which all keys
+ * agree (the top of the key for a TreePiece occupying a small part
+ * of the domain) are skipped.  Like a comparison sort on
+ * GravityParticle::operator<, this orders the particles by key;
+ * unlike std::sort it is stable.
+ */
+
+#ifndef RADIXSORT_H
+#define RADIXSORT_H
+
+#include <vector>
+#include "keytype.h"
+
+/// @brief Sort n objects with a KeyType member "key" by key.
+template <class P>
+void radixSortByKey(P *part, int n)
+{
+    if(n < 2)
+        return;
+    const int nBins = 256;
+    const int nPasses = sizeof(KeyType);
+
+    std::vector<KeyType> keys(n), keysTmp(n);
+    std::vector<int> index(n), indexTmp(n);
+    // Histograms of every byte in one sweep.
+    std::vector<int> counts(nPasses*nBins, 0);
+    for(int i = 0; i < n; i++) {
+        KeyType k = part[i].key;
+        keys[i] = k;
+        index[i] = i;
+        for(int b = 0; b < nPasses; b++)
+            counts[b*nBins + (int)((k >> (8*b)) & 0xff)]++;
+    }
+
+    for(int b = 0; b < nPasses; b++) {
+        int *count = &counts[b*nBins];
+        if(count[(int)((keys[0] >> (8*b)) & 0xff)] == n)
+            continue;		// all keys share this byte
+        int offset = 0;
+        for(int d = 0; d < nBins; d++) {
+            int c = count[d];
+            count[d] = offset;
+            offset += c;
+        }
+        for(int i = 0; i < n; i++) {
+            int j = count[(int)((keys[i] >> (8*b)) & 0xff)]++;
+            keysTmp[j] = keys[i];
+            indexTmp[j] = index[i];
+        }
+        keys.swap(keysTmp);
+        index.swap(indexTmp);
+    }
+
+    // part[index[i]] belongs at i: follow the cycles of the permutation.
+    for(int i = 0; i < n; i++) {
+        if(index[i] == i)
+            continue;
+        P tmp = part[i];
+        int j = i;
+        while(index[j] != i) {
+            int k = index[j];
+            part[j] = part[k];
+            index[j] = j;
+            j = k;
+        }
+        part[j] = tmp;
+        index[j] = j;
+    }
+}
+
+#endif
@@ -3,6 +3,24 @@
 
 #include "cosmoType.h"
 
+#if CMK_USE_AVX512
+	#if !defined(__AVX512F__)
+		#undef CMK_USE_AVX512
+		#define CMK_USE_AVX512 0
+	#else
+		#warning "using AVX-512"
+	#endif
+#endif
+
+#if CMK_USE_AVX2
+	#if !defined(__AVX2__) || !defined(__FMA__)
+		#undef CMK_USE_AVX2
+		#define CMK_USE_AVX2 0
+	#else
+		#warning "using AVX2"
+	#endif
+#endif
+
 #if  CMK_USE_AVX
 	#if !defined(__AVX__)
 		#undef CMK_USE_AVX
@@ -17,11 +35,89 @@
 	#define CMK_USE_SSE2 0
 #endif
 
-#if CMK_USE_AVX || CMK_USE_SSE2
+#if CMK_USE_AVX512 || CMK_USE_AVX2 || CMK_USE_AVX || CMK_USE_SSE2
 	#define CMK_SSE 1
 #endif
 
-#if CMK_USE_AVX
+#if CMK_USE_AVX512
+	#include "SSE-Wide.h"
+	#define CMK_SSE_FMA 1
+	#ifdef COSMO_FLOAT
+		#define SSE_COSMO_FLOAT
+		#define SSE_VECTOR_WIDTH 16
+		#define FORCE_INPUT_LIST_PAD 15
+		typedef AVX512Float SSEcosmoType;
+		#define SSELoad(where, arr, idx, field) where(arr[idx]field, \
+		  arr[idx+1]field, arr[idx+2]field, arr[idx+3]field, \
+		  arr[idx+4]field, arr[idx+5]field, arr[idx+6]field, \
+		  arr[idx+7]field, arr[idx+8]field, arr[idx+9]field, \
+		  arr[idx+10]field, arr[idx+11]field, arr[idx+12]field, \
+		  arr[idx+13]field, arr[idx+14]field, arr[idx+15]field)
+		#define SSEStore(what, arr, idx, field) { \
+		  float p[16]; \
+		  storeu(p, what); \
+		  for(int iLane = 0; iLane < 16; iLane++) \
+		    arr[idx+iLane]field = p[iLane]; \
+		}
+		enum {cosmoMask=0xffff};
+		#define SSELoadAligned(where, p) where(_mm512_load_ps(p))
+		#define SSEStoreAligned(what, p) _mm512_store_ps(p, (what).val)
+	#else
+		#define SSE_VECTOR_WIDTH 8
+		#define FORCE_INPUT_LIST_PAD 7
+		typedef AVX512Double SSEcosmoType;
+		#define SSELoad(where, arr, idx, field) where(arr[idx]field, \
+		  arr[idx+1]field, arr[idx+2]field, arr[idx+3]field, \
+		  arr[idx+4]field, arr[idx+5]field, arr[idx+6]field, \
+		  arr[idx+7]field)
+		#define SSEStore(what, arr, idx, field) { \
+		  double p[8]; \
+		  storeu(p, what); \
+		  for(int iLane = 0; iLane < 8; iLane++) \
+		    arr[idx+iLane]field = p[iLane]; \
+		}
+		enum {cosmoMask=0xff};
+		#define SSELoadAligned(where, p) where(_mm512_load_pd(p))
+		#define SSEStoreAligned(what, p) _mm512_store_pd(p, (what).val)
+	#endif
+#elif CMK_USE_AVX2
+	#include "SSE-Wide.h"
+	#define CMK_SSE_FMA 1
+	#ifdef COSMO_FLOAT
+		#define SSE_COSMO_FLOAT
+		#define SSE_VECTOR_WIDTH 8
+		#define FORCE_INPUT_LIST_PAD 7
+		typedef AVXFloat SSEcosmoType;
+		#define SSELoad(where, arr, idx, field) where(arr[idx]field, \
+		  arr[idx+1]field, arr[idx+2]field, arr[idx+3]field, \
+		  arr[idx+4]field, arr[idx+5]field, arr[idx+6]field, \
+		  arr[idx+7]field)
+		#define SSEStore(what, arr, idx, field) { \
+		  float p[8]; \
+		  storeu(p, what); \
+		  for(int iLane = 0; iLane < 8; iLane++) \
+		    arr[idx+iLane]field = p[iLane]; \
+		}
+		enum {cosmoMask=0xff};
+		#define SSELoadAligned(where, p) where(_mm256_load_ps(p))
+		#define SSEStoreAligned(what, p) _mm256_store_ps(p, (what).val)
+	#else
+		#define SSE_VECTOR_WIDTH 4
+		#define FORCE_INPUT_LIST_PAD 3
+		typedef AVXDouble SSEcosmoType;
+		#define SSELoad(where, arr, idx, field) where(arr[idx]field, \
+		  arr[idx+1]field, arr[idx+2]field, arr[idx+3]field)
+		#define SSEStore(what, arr, idx, field) { \
+		  double p[4]; \
+		  storeu(p, what); \
+		  for(int iLane = 0; iLane < 4; iLane++) \
+		    arr[idx+iLane]field = p[iLane]; \
+		}
+		enum {cosmoMask=0xf};
+		#define SSELoadAligned(where, p) where(_mm256_load_pd(p))
+		#define SSEStoreAligned(what, p) _mm256_store_pd(p, (what).val)
+	#endif
+#elif CMK_USE_AVX
 	#ifdef COSMO_FLOAT
 		#error "single-precision AVX is not supported"
 	#else
@@ -39,6 +135,8 @@
 		  arr[idx+3]field = p[3]; \
 		}
 		enum {cosmoMask=0xf};
+		#define SSELoadAligned(where, p) where(_mm256_load_pd(p))
+		#define SSEStoreAligned(what, p) _mm256_store_pd(p, (what).val)
 	#endif
 #elif CMK_USE_SSE2
 	#ifdef COSMO_FLOAT
@@ -58,6 +156,8 @@
 			  arr[idx+3]field = p[3]; \
 			}
 			enum {cosmoMask=0xf};
+			#define SSELoadAligned(where, p) where(_mm_load_ps(p))
+			#define SSEStoreAligned(what, p) _mm_store_ps(p, (what).val)
                 #else
                       #error("SSE not available");
                 #endif
@@ -73,10 +173,35 @@
 			  storeh(&arr[idx+1]field, what); \
 			}
 			enum {cosmoMask=0x3};
+			#define SSELoadAligned(where, p) where(_mm_load_pd(p))
+			#define SSEStoreAligned(what, p) _mm_store_pd(p, (what).val)
                 #else
                       #error("SSE not available");
 		#endif
 	#endif
 #endif
 
+/// Scalar versions, so that kernels templated on the lane type can use
+/// fmadd() throughout; the compiler contracts these when FMA is enabled.
+inline float fmadd(float a, float b, float c) { return a*b + c; }
+inline double fmadd(double a, double b, double c) { return a*b + c; }
+inline float fnmadd(float a, float b, float c) { return c - a*b; }
+inline double fnmadd(double a, double b, double c) { return c - a*b; }
+
+#if CMK_SSE && !CMK_SSE_FMA
+/// Fused multiply-add fallbacks for vector types without FMA; the
+/// wide types in SSE-Wide.h provide the single-rounding versions.
+inline SSEcosmoType fmadd(const SSEcosmoType &a, const SSEcosmoType &b,
+			  const SSEcosmoType &c)
+{
+    return a*b + c;
+}
+
+inline SSEcosmoType fnmadd(const SSEcosmoType &a, const SSEcosmoType &b,
+			   const SSEcosmoType &c)
+{
+    return c - a*b;
+}
+#endif
+
 #endif
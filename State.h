@@ -1,6 +1,7 @@
 #ifndef __STATE_H__
 #define __STATE_H__
 #include "ParallelGravity.h"
+#include <vector>
 
 /// @brief Base class for maintaining the state of a tree walk.
 class State {
@@ -38,6 +39,8 @@ class State {
 };
 
 #if INTERLIST_VER > 0
+class InteractionListSoA;
+
 #if defined CUDA
 #include "HostCUDA.h"
 #include "DataManager.h"
@@ -113,20 +116,26 @@ class GenericList{
 ///
 /// @brief Hold state where both the targets and sources are tree walked.
 ///
+/// The state, its per level lists and their storage are allocated
+/// from the walk arena of the TreePiece (see
+/// ListCompute::allocDoubleWalkState()).
+///
 class DoubleWalkState : public State {
   public:
     /// Lists of cells to be checked for the opening criterion.  One
     /// list for each level in the tree.
   CheckList *chklists;
   /// Lists of cells which need to go to the next local level before
-  /// deciding if to open them.
-  UndecidedLists undlists;
+  /// deciding if to open them.  One list for each level.
+  UndecidedList *undlists;
   /// Lists of cells to be computed.  One list for each level.
-  CkVec<CkVec<OffsetNode> >clists;
-  /// Lists of local particles to be computed.  One list for each level.
-  CkVec<CkVec<LocalPartInfo> >lplists;
-  /// Lists of remote particles to be computed.  One list for each level.
-  CkVec<CkVec<RemotePartInfo> >rplists;
+  ArenaList<OffsetNode> *clists;
+  /// Lists of local particles to be computed.  One list for each
+  /// level; NULL unless this is the state of a local walk.
+  ArenaList<LocalPartInfo> *lplists;
+  /// Lists of remote particles to be computed.  One list for each
+  /// level; NULL unless this is the state of a remote walk.
+  ArenaList<RemotePartInfo> *rplists;
    
   /// set once before the first TreePiece::calculateGravityRemote() is called for a chunk
   /// the idea is to place the chunkRoot (along with replicas)
@@ -199,7 +208,12 @@ class DoubleWalkState : public State {
   GenericTreeNode *lowestNode;
   int level;
 
-  DoubleWalkState() : chklists(0), lowestNode(0), level(-1) {
+  /// Packed copy of the interaction lists for the streaming
+  /// kernels; allocated on first use when bSoAGravity is set.
+  InteractionListSoA *soa;
+
+  DoubleWalkState() : chklists(0), undlists(0), clists(0), lplists(0),
+                      rplists(0), lowestNode(0), level(-1), soa(0) {
 #ifdef CUDA
       partMap.reserve(100);
 #endif
@@ -226,6 +240,43 @@ class DoubleWalkState : public State {
 };
 #endif //  INTERLIST_VER 
 
+/// @brief A cell of the local tree as seen by the dual tree walks
+/// (FMM and mutual gravity).
+struct FmmCell {
+  GenericTreeNode *node;
+  /// Index of the first child in FmmState::cells; children are
+  /// stored contiguously.
+  int iChild;
+  int nChild;
+  /// Scale of the local expansion.
+  cosmoType v;
+  /// Local expansion of the far field about node->moments.cm.
+  FLOCR l;
+  /// Mass and (timescale)^-2 carried by the local expansion.
+  cosmoType interMass;
+  cosmoType dtGrav;
+};
+
+/// @brief State of the dual tree walks.
+///
+/// Holds a flattened copy of the purely local (Internal and Bucket)
+/// part of the tree, with a local expansion for each cell in the FMM
+/// walk.
+class FmmState : public State {
+  public:
+  std::vector<FmmCell> cells;
+  /// The first nRoots cells are the roots of the local subtrees.
+  int nRoots;
+  /// Pair of cells being considered by the DualTreeWalk.
+  int target, source;
+  /// Pairs of cells still to be walked, the next one last.
+  std::vector<std::pair<int, int> > pairs;
+  /// Apply interactions to the source cell as well as the target.
+  bool bMutual;
+  /// Interaction counts for the statistics.
+  int64_t nCellInter, nPartInter, nLocalEval;
+};
+
 class NullState : public State {
 };
 
@@ -28,11 +28,13 @@
 
 #include "Space.h"
 #include "gravity.h"
+#include "InterListRecord.h"
 #include "smooth.h"
 
 #include "PETreeMerger.h"
 #include "IntraNodeLBManager.h"
 #include "CkLoopAPI.h"
+#include "RadixSort.h"
 
 #if !CMK_LB_USER_DATA
 #error "Please recompile charm with --enable-lbuserdata"
@@ -74,6 +76,15 @@ string getColor(GenericTreeNode*);
 
 const char *typeString(NodeType type);
 
+/// @brief Sort n particles by key with the sort chosen by bRadixSort.
+static void sortParticlesByKey(GravityParticle *first, int n)
+{
+    if(bRadixSort)
+        radixSortByKey(first, n);
+    else
+        sort(first, first + n);
+}
+
 /**
  * @brief glassDamping applies a damping force to a particle's velocity.
  * 
@@ -169,7 +180,7 @@ void TreePiece::assignKeys(CkReductionMsg* m) {
 		myParticles[i+1].key = generateKey(myParticles[i+1].position,
 						   boundingBox);
 	      }
-	      sort(&myParticles[1], &myParticles[myNumParticles+1]);
+	      sortParticlesByKey(&myParticles[1], myNumParticles);
 	}
 
 #if COSMO_DEBUG > 1
@@ -1320,7 +1331,7 @@ void TreePiece::acceptSortedParticles(ParticleShuffleMsg *shuffleMsg) {
         myParticles[iPart+1].extraData = NULL;
     }
 
-    sort(myParticles+1, myParticles+myNumParticles+1);
+    sortParticlesByKey(myParticles+1, myNumParticles);
     savedCentroid = vCenter/(double)myNumParticles;
     //signify completion with a reduction
     if(verbosity>1) ckout << thisIndex <<" contributing to accept particles"
@@ -1834,9 +1845,11 @@ void TreePiece::drift(double dDelta,  // time step in x containing
 				      // in place
 		      bool buildTree, // is a treebuild happening before the
 				      // next drift?
+		      bool bKeepTree, // keep the tree for a refit
 		      const CkCallback& cb) {
   callback = cb;		// called by assignKeys()
-  deleteTree();
+  if(!bKeepTree)
+      deleteTree();
 
   if(bucketReqs != NULL) {
     delete[] bucketReqs;
@@ -2404,6 +2417,21 @@ void TreePiece::buildTree(int bucketSize, const CkCallback& cb)
   maxBucketSize = bucketSize;
   callback = cb;
   myTreeParticles = myNumParticles;
+  iTreeBuild++;
+
+  if (bAdaptiveCacheDepth && myNumParticles > 0) {
+    // Smallest node holding all my particles: the common prefix of
+    // the first and last keys.
+    KeyType first = myParticles[1].key;
+    KeyType last = myParticles[myNumParticles].key;
+    int level = KeyBits;
+    while (first != last) {
+      first >>= 1;
+      last >>= 1;
+      level--;
+    }
+    gravityNodeEntry.requesterKey = (KeyType(1) << level) | first;
+  }
 
   deleteTree();
   if(bucketReqs != NULL) {
@@ -2557,7 +2585,7 @@ void TreePiece::startORBTreeBuild(CkReductionMsg* m){
     if(doMerge){
 #endif
       if (verbosity > 3) ckerr << "TreePiece " << thisIndex << ": No particles, finished tree build" << endl;
-      contribute(sizeof(callback), &callback, CkReduction::random, CkCallback(CkIndex_DataManager::combineLocalTrees((CkReductionMsg*)NULL), CProxy_DataManager(dataManagerID)));
+      contributeLocalTree();
 #ifdef PUSH_GRAVITY
     }
     else{
@@ -2574,7 +2602,7 @@ void TreePiece::startORBTreeBuild(CkReductionMsg* m){
   compFuncPtr[1]= &comp_dim1;
   compFuncPtr[2]= &comp_dim2;
 
-  pTreeNodes = new NodePool();
+  pTreeNodes = new NodePool(&nodeArena);
   root = pTreeNodes->alloc_one(1, numTreePieces>1?Tree::Boundary:Tree::Internal,
 			       0, myNumParticles+1, 0);
 
@@ -2803,7 +2831,7 @@ void TreePiece::startOctTreeBuild(CkReductionMsg* m) {
 #endif
       // No particle assigned to this TreePiece
       if (verbosity > 3) ckerr << "TreePiece " << thisIndex << ": No particles, finished tree build" << endl;
-      contribute(sizeof(callback), &callback, CkReduction::random, CkCallback(CkIndex_DataManager::combineLocalTrees((CkReductionMsg*)NULL), CProxy_DataManager(dataManagerID)));
+      contributeLocalTree();
 #ifdef PUSH_GRAVITY
     }
     else{
@@ -2831,7 +2859,7 @@ void TreePiece::startOctTreeBuild(CkReductionMsg* m) {
   // create the root of the global tree
   switch (useTree) {
   case Binary_Oct:
-    pTreeNodes = new NodePool;
+    pTreeNodes = new NodePool(&nodeArena);
     root = pTreeNodes->alloc_one(1, numTreePieces>1?Tree::Boundary:Tree::Internal, 0, myNumParticles+1, 0);
     root->particlePointer = &myParticles[1];
     break;
@@ -2896,7 +2924,18 @@ void TreePiece::startOctTreeBuild(CkReductionMsg* m) {
 
 #else
         start = CmiWallTimer();
+        nTreeBuildSplit = 0;
+#if CMK_SMP && !defined(TREE_BREADTH_FIRST)
+        // Leave the local subtrees below a fraction of the piece to
+        // be built concurrently by the other threads of the node.
+        if (bUseCkLoopPar && otherIdlePesAvail()) {
+          nTreeBuildSplit = myNumParticles/(4*CkMyNodeSize());
+          if (nTreeBuildSplit < 4*maxBucketSize) nTreeBuildSplit = 0;
+        }
+#endif
 	buildOctTree(root, 0);
+        if (!deferredSubtrees.empty()) buildDeferredSubtrees();
+        if (bDepthFirstTree) layoutDepthFirst();
         traceUserBracketEvent(tbRecursiveUE,start,CmiWallTimer());
 #endif
 
@@ -3173,6 +3212,13 @@ void TreePiece::buildOctTree(GenericTreeNode * node, int level) {
 #ifdef TREE_BREADTH_FIRST
       queueNext->enq(child);
 #else
+      if (child->getType() == Internal
+          && child->lastParticle - child->firstParticle < nTreeBuildSplit) {
+        // Built by buildDeferredSubtrees(), which then also
+        // recomputes this node.
+        deferredSubtrees.push_back(std::make_pair(child, level+1));
+        continue;
+      }
       buildOctTree(child, level+1);
 #endif
       // if we have a Boundary child, we will have to compute it's multipole
@@ -3215,6 +3261,220 @@ void TreePiece::buildOctTree(GenericTreeNode * node, int level) {
 #endif
 }
 
+/// @brief CkLoop worker building the deferred subtrees start to end.
+static void doTreeBuildForCkLoop(int start, int end, void *result, int pnum,
+                                 void *param) {
+  TreePiece *tp = (TreePiece *)param;
+  double tstart = CkWallTimer();
+  for (int i = start; i <= end; i++) {
+    tp->buildDeferredSubtree(i);
+  }
+  *(double *)result = CkWallTimer() - tstart;
+}
+
+void TreePiece::buildDeferredSubtree(int i) {
+  deferredPools[i] = new NodePool;
+  buildLocalOctTree(deferredSubtrees[i].first, deferredSubtrees[i].second,
+                    deferredPools[i]);
+}
+
+/**
+ * Build the Internal subtrees that buildOctTree() left in
+ * deferredSubtrees on all the threads of the node with CkLoop.
+ * Their nodes are then entered in the nodeLookupTable, the bucket
+ * list is renumbered in depth first order and the nodes above them
+ * are recomputed, leaving the same tree as a serial build.
+ */
+void TreePiece::buildDeferredSubtrees() {
+  int nTasks = deferredSubtrees.size();
+  deferredPools.assign(nTasks, NULL);
+
+  int num_chunks = 3 * CkMyNodeSize();
+  // CkLoop library limits the number of chunks to be 64.
+  if (num_chunks > 64) {
+    num_chunks = 64;
+  }
+  if (num_chunks > nTasks) {
+    num_chunks = nTasks;
+  }
+
+  double timebeforeckloop = getObjTime();
+  double timeforckloop;
+  LBTurnInstrumentOff();
+#if CMK_SMP
+  CkLoop_Parallelize(doTreeBuildForCkLoop, 1, this, num_chunks, 0, nTasks-1,
+                     1, &timeforckloop, CKLOOP_DOUBLE_SUM);
+#else
+  CkAbort("CkLoop usage only in SMP mode\n");
+#endif
+  setObjTime(timebeforeckloop + timeforckloop);
+  LBTurnInstrumentOn();
+
+  for (int i = 0; i < nTasks; i++) {
+    pTreeNodes->adopt(*deferredPools[i]);
+    delete deferredPools[i];
+  }
+  deferredPools.clear();
+
+  numBuckets = 0;
+  bucketList.clear();
+  unsigned int iDeferred = 0;
+  linkLocalTree(root, false, iDeferred);
+  CkAssert(iDeferred == deferredSubtrees.size());
+  deferredSubtrees.clear();
+}
+
+void TreePiece::buildLocalOctTree(GenericTreeNode *node, int level,
+                                  NodePool *pool) {
+  if (level == NodeKeyBits-2) {
+    CkAbort("Tree is too deep!");
+  }
+  CkAssert(node->getType() == Internal);
+
+  node->makeOctChildren(myParticles, myNumParticles, level, pool);
+  node->boundingBox.reset();
+  node->rungs = 0;
+
+  for (unsigned int i=0; i<node->numChildren(); ++i) {
+    GenericTreeNode *child = node->getChildren(i);
+    child->remoteIndex = thisIndex;
+    if (child->getType() == Empty) continue;
+    CkAssert(child->getType() == Internal);
+    if (child->lastParticle - child->firstParticle < maxBucketSize
+        || level >= NodeKeyBits-3) {
+      if (child->lastParticle - child->firstParticle >= maxBucketSize)
+        CkError("Truncated tree with %d particle bucket\n",
+                child->lastParticle - child->firstParticle);
+      child->makeBucket(myParticles);
+    } else {
+      buildLocalOctTree(child, level+1, pool);
+    }
+    accumulateMomentsFromChild(node, child);
+    if (child->rungs > node->rungs) node->rungs = child->rungs;
+  }
+  calculateRadiusFarthestCorner(node->moments, node->boundingBox);
+}
+
+/// @brief Serial pass over the tree after buildDeferredSubtrees().
+/// @param bDeferred node is within a concurrently built subtree.
+/// @param iDeferred next entry of deferredSubtrees to be met.
+void TreePiece::linkLocalTree(GenericTreeNode *node, bool bDeferred,
+                              unsigned int &iDeferred) {
+  if (bDeferred)
+    nodeLookupTable[node->getKey()] = node;
+#if INTERLIST_VER > 0
+  node->startBucket = numBuckets;
+#endif
+  if (node->getType() == Bucket) {
+    node->iRank = CkMyRank();
+    bucketList.push_back(node);
+    numBuckets++;
+    return;
+  }
+  if (node->getType() != Internal && node->getType() != Boundary)
+    return;
+
+#if INTERLIST_VER > 0
+  int bucketsBeneath = 0;
+#endif
+  for (unsigned int i=0; i<node->numChildren(); ++i) {
+    GenericTreeNode *child = node->getChildren(i);
+    bool bChildDeferred = bDeferred;
+    if (!bDeferred && iDeferred < deferredSubtrees.size()
+        && deferredSubtrees[iDeferred].first == child) {
+      bChildDeferred = true;
+      iDeferred++;
+    }
+    linkLocalTree(child, bChildDeferred, iDeferred);
+#if INTERLIST_VER > 0
+    bucketsBeneath += child->numBucketsBeneath;
+#endif
+  }
+#if INTERLIST_VER > 0
+  node->numBucketsBeneath = bucketsBeneath;
+#endif
+  if (bDeferred) return;
+
+  // A node of the serial part of the build: its children are now
+  // complete.  Boundary moments wait for the remote ones.
+  if (node->getType() == Internal) {
+    node->moments.clear();
+    node->boundingBox.reset();
+    node->bndBoxBall.reset();
+    node->iParticleTypes = 0;
+    node->nSPH = 0;
+  }
+  node->rungs = 0;
+  for (unsigned int i=0; i<node->numChildren(); ++i) {
+    GenericTreeNode *child = node->getChildren(i);
+    NodeType type = child->getType();
+    if (type != Internal && type != Bucket && type != Boundary) continue;
+    if (node->getType() == Internal)
+      accumulateMomentsFromChild(node, child);
+    if (child->rungs > node->rungs) node->rungs = child->rungs;
+  }
+  if (node->getType() == Internal)
+    calculateRadiusFarthestCorner(node->moments, node->boundingBox);
+}
+
+/**
+ * Reorder the local tree into a single block of nodes in depth first
+ * order, with the two children of a node next to each other.  The
+ * NodePool hands out nodes in the order the build creates them,
+ * scattered over blocks of 128 (and over the pools of
+ * buildDeferredSubtrees()), so this gives the tree walks that descend
+ * from a node to its children a mostly sequential sweep through
+ * memory.  Only the order changes: the nodes keep their layout and
+ * their pointer links, so the walks and the cache are unchanged.
+ *
+ * The block comes from depthFirstArena, and the nodes of the build go
+ * back to nodeArena, which keeps its memory for the next build; both
+ * are reset by deleteTree(), so no node storage is allocated from the
+ * heap once the arenas have grown to the size of the tree.
+ *
+ * This runs before any node pointer leaves the TreePiece: the remote
+ * moments requested so far are identified by their keys.
+ */
+void TreePiece::layoutDepthFirst() {
+  int nNodes = nodeLookupTable.size();
+  NodePool *pool = new NodePool(&depthFirstArena);
+  BinaryTreeNode *nodes = pool->alloc_block(nNodes);
+
+  nodes[0] = *(BinaryTreeNode *)root;
+  int next = 1;
+  bucketList.clear();
+  layoutChildren(&nodes[0], nodes, next);
+  CkAssert(next == nNodes);
+  CkAssert(bucketList.size() == numBuckets);
+
+  delete pTreeNodes;
+  nodeArena.reset();
+  pTreeNodes = pool;
+  root = &nodes[0];
+  nodeLookupTable.clear();
+  for (int i = 0; i < nNodes; i++) {
+    nodeLookupTable[nodes[i].getKey()] = &nodes[i];
+  }
+}
+
+/// @brief Copy the children of node (already copied) to nodes[next]
+/// onwards, then their subtrees in turn.
+void TreePiece::layoutChildren(BinaryTreeNode *node, BinaryTreeNode *nodes,
+                               int &next) {
+  if (node->getType() == Bucket) bucketList.push_back(node);
+  for (int i = 0; i < 2; i++) {
+    if (node->children[i] == NULL) continue;
+    nodes[next] = *node->children[i];
+    nodes[next].parent = node;
+    node->children[i] = &nodes[next];
+    next++;
+  }
+  for (int i = 0; i < 2; i++) {
+    if (node->children[i] != NULL)
+      layoutChildren(node->children[i], nodes, next);
+  }
+}
+
 #ifdef TREE_BREADTH_FIRST
 void TreePiece::growBottomUp(GenericTreeNode *node) {
   GenericTreeNode *child;
@@ -3464,7 +3724,7 @@ void TreePiece::accumulateMomentsFromChild(GenericTreeNode *parent, GenericTreeN
 /// This is used by MERGE_REMOTE_REQUESTS to distribute the received
 /// moments among Treepieces on a core.
 void TreePiece::deliverMomentsToClients(GenericTreeNode *node){
-  std::map<NodeKey,NonLocalMomentsClientList>::iterator it;
+  NonLocalMomentsClientTable::iterator it;
   it = nonLocalMomentsClients.find(node->getKey());
   if(it == nonLocalMomentsClients.end()) return;
 
@@ -3476,7 +3736,7 @@ void TreePiece::deliverMomentsToClients(GenericTreeNode *node){
 ///
 /// This is used by MERGE_REMOTE_REQUESTS to distribute the received
 /// moments among Treepieces on a core.
-void TreePiece::deliverMomentsToClients(const std::map<NodeKey,NonLocalMomentsClientList>::iterator &it){
+void TreePiece::deliverMomentsToClients(const NonLocalMomentsClientTable::iterator &it){
   NonLocalMomentsClientList &entry = it->second;
   CkVec<NonLocalMomentsClient> &clients = entry.clients;
   GenericTreeNode *node = entry.targetNode;
@@ -3505,12 +3765,22 @@ void TreePiece::treeBuildComplete(){
   CkAssert(nonLocalMomentsClients.empty());
 #endif
 
+  if(bRefitting)
+    bRefitting = false;
+  else {
+    bucketSizeBuilt.resize(numBuckets);
+    for(unsigned int j = 0; j < numBuckets; ++j) {
+      OrientedBox<double> &box = bucketList[j]->boundingBox;
+      bucketSizeBuilt[j] = (box.greater_corner - box.lesser_corner).length();
+    }
+  }
+
 #ifdef PUSH_GRAVITY
   if(doMerge){
 #endif
 
     dm->notifyPresence(root, this);
-    contribute(sizeof(callback), &callback, CkReduction::random, CkCallback(CkIndex_DataManager::combineLocalTrees((CkReductionMsg*)NULL), CProxy_DataManager(dataManagerID)));
+    contributeLocalTree();
 
 #ifdef PUSH_GRAVITY
   }
@@ -3521,6 +3791,116 @@ void TreePiece::treeBuildComplete(){
 #endif
 }
 
+/// @brief Hand the local tree to DataManager::combineLocalTrees().
+void TreePiece::contributeLocalTree() {
+  contribute(sizeof(callback), &callback, CkReduction::random, CkCallback(CkIndex_DataManager::combineLocalTrees((CkReductionMsg*)NULL), CProxy_DataManager(dataManagerID)));
+}
+
+/// @brief Refit the local part of the tree to the drifted particles.
+///
+/// The topology of the tree (kept through TreePiece::drift()) is
+/// reused: the buckets are refilled from their particles and the
+/// local nodes recomputed bottom-up.  Boundary nodes are cleared so
+/// that requests for them wait for refitMoments().  The reduction to
+/// cb is true if the tree must be rebuilt instead, because it is
+/// gone, particles were added, or a bucket grew by more than a
+/// factor 1 + dTol since the tree was built.
+void TreePiece::refitTree(double dTol, const CkCallback& cb) {
+  int bRebuild = 0;
+  if(myNumParticles > 0)
+    bRebuild = (root == NULL || myTreeParticles != (int) myNumParticles
+                || bucketSizeBuilt.size() != numBuckets);
+  else
+    bRebuild = (root != NULL);
+
+  for(unsigned int j = 0; j < numBuckets && root != NULL && !bRebuild; ++j) {
+    GenericTreeNode *node = bucketList[j];
+    // makeBucket() scales the moments to the box it is given
+    // before fitting them; give it a box of the old radius.
+    cosmoType radius = node->moments.getRadius();
+    Vector3D<double> halfDiag(radius/sqrt(3.0));
+    Vector3D<double> cm(node->moments.cm);
+    node->moments.clear();
+    node->boundingBox.reset();
+    node->boundingBox.grow(cm - halfDiag);
+    node->boundingBox.grow(cm + halfDiag);
+    node->makeBucket(myParticles);
+    OrientedBox<double> &box = node->boundingBox;
+    if((box.greater_corner - box.lesser_corner).length()
+       > (1.0 + dTol)*bucketSizeBuilt[j])
+      bRebuild = 1;
+  }
+  if(!bRebuild && root != NULL)
+    refitLocalNode(root);
+  contribute(sizeof(int), &bRebuild, CkReduction::logical_or, cb);
+}
+
+/// @brief Recompute the Internal nodes below node from their
+/// (already refitted) children, and clear the Boundary ones.
+void TreePiece::refitLocalNode(GenericTreeNode *node) {
+  node->moments.clear();
+  node->boundingBox.reset();
+  node->bndBoxBall.reset();
+  node->iParticleTypes = 0;
+  node->nSPH = 0;
+  node->rungs = 0;
+  for(unsigned int i = 0; i < node->numChildren(); ++i) {
+    GenericTreeNode *child = node->getChildren(i);
+    switch(child->getType()) {
+    case Internal:
+    case Boundary:
+      refitLocalNode(child);
+      break;
+    case Bucket:
+      break;
+    default:			// remote or empty
+      continue;
+    }
+    if(node->getType() != Boundary)
+      accumulateMomentsFromChild(node, child);
+    if(child->rungs > node->rungs) node->rungs = child->rungs;
+  }
+  if(node->getType() == Internal)
+    calculateRadiusFarthestCorner(node->moments, node->boundingBox);
+}
+
+/// @brief Second step of a refit: request the moments of the remote
+/// nodes again and complete the Boundary nodes as in a tree build.
+void TreePiece::refitMoments(const CkCallback& cb) {
+  callback = cb;
+  if(myNumParticles == 0) {
+    contributeLocalTree();
+    return;
+  }
+  bRefitting = true;
+  if(root->getType() != Boundary) {
+    treeBuildComplete();
+    return;
+  }
+  refitBoundaryNode(root);
+}
+
+/// @brief Count the children of a Boundary node that have to report
+/// back, and request the remote ones.
+void TreePiece::refitBoundaryNode(GenericTreeNode *node) {
+  node->remoteIndex = 0;
+  for(unsigned int i = 0; i < node->numChildren(); ++i) {
+    GenericTreeNode *child = node->getChildren(i);
+    if(child->getType() == NonLocal || child->getType() == NonLocalBucket) {
+      node->remoteIndex--;
+      CkEntryOptions opts;
+      opts.setPriority((unsigned int) -110000000);
+      streamingProxy[child->remoteIndex].requestRemoteMoments(child->getKey(), thisIndex, &opts);
+    } else if(child->getType() == Boundary) {
+      node->remoteIndex--;
+      refitBoundaryNode(child);
+    }
+  }
+  // All the remote children may have been empty
+  if(node->remoteIndex == 0 && boundaryParentReady(node) == NULL)
+    treeBuildComplete();
+}
+
 /// @brief is this a periodic replica?
 bool bIsReplica(int reqID)
 {
@@ -3566,6 +3946,37 @@ int reEncodeOffset(int reqID, int offsetID)
 }
 
 
+/// Record in each local node the smallest acceleration of its active
+/// particles.  Nodes with an active particle that has no acceleration
+/// yet (e.g. the first step) get zero, which makes the opening
+/// criterion fall back to the geometric test; nodes without active
+/// particles get FLT_MAX.
+void TreePiece::setAccOldMin(GenericTreeNode *node) {
+  cosmoType aMin = FLT_MAX;
+  switch(node->getType()) {
+  case Bucket:
+    for(int i = node->firstParticle; i <= node->lastParticle; ++i) {
+      if(myParticles[i].rung >= activeRung) {
+        cosmoType a = myParticles[i].treeAcceleration.length();
+        if(a < aMin) aMin = a;
+      }
+    }
+    break;
+  case Internal:
+  case Boundary:
+    for(int i = 0; i < node->numChildren(); ++i) {
+      GenericTreeNode *child = node->getChildren(i);
+      if(child == NULL) continue;
+      setAccOldMin(child);
+      if(child->accOldMin < aMin) aMin = child->accOldMin;
+    }
+    break;
+  default:
+    break;
+  }
+  node->accOldMin = aMin;
+}
+
 /**
  * Initialize all particles for gravity force calculation.
  * This includes zeroing out the acceleration and potential.
@@ -3832,7 +4243,8 @@ void TreePiece::nextBucket(dummyMsg *msg){
 #if !defined(CUDA)
   LoopParData* lpdata;
   int tmpBucketBegin;
-  if (bUseCkLoopPar && otherIdlePesAvail()) {
+  // Lists are recorded from stateReady(), which CkLoop bypasses.
+  if (bUseCkLoopPar && fpInterList == NULL && otherIdlePesAvail()) {
     useckloop = true;
     // This value was chosen to be 2*Nodesize so that we have enough buckets for
     // all the PEs in the node and also giving some extra for load balance.
@@ -4020,9 +4432,104 @@ void TreePiece::doParallelNextBucketWork(int idx, LoopParData* lpdata) {
 
 /// This function could be replaced by the doAllBuckets() call.
 void TreePiece::calculateGravityLocal() {
+  if(bFmmGravity) {
+    calculateGravityFmm();
+    return;
+  }
+  if(bMutualGravity) {
+    calculateGravityMutual();
+    return;
+  }
   doAllBuckets();
 }
 
+/// @brief Local gravity with cell-cell interactions.
+void TreePiece::calculateGravityFmm() {
+#if INTERLIST_VER > 0 && !defined(CUDA)
+  calculateGravityDual(new FmmCompute());
+#else
+  CkAbort("FMM gravity needs an interaction list build without CUDA");
+#endif
+}
+
+/// @brief Local gravity with mutual bucket-bucket interactions.
+void TreePiece::calculateGravityMutual() {
+#if INTERLIST_VER > 0 && !defined(CUDA)
+  calculateGravityDual(new MutualCompute());
+#else
+  CkAbort("Mutual gravity needs an interaction list build without CUDA");
+#endif
+}
+
+/// Pairs of cells the dual walk interacts per _yieldPeriod, a rough
+/// equivalent of one bucket of the local walk.
+static const int nDualPairsPerBucket = 256;
+
+/// @brief reqID of periodic replica iReplica of the dual walk.
+static int dualWalkOffset(int iReplica, int nReplicas) {
+  int nRep = 2*nReplicas + 1;
+  return encodeOffset(0, iReplica/(nRep*nRep) - nReplicas,
+                      (iReplica/nRep)%nRep - nReplicas,
+                      iReplica%nRep - nReplicas);
+}
+
+/// @brief Local gravity with a DualTreeWalk.
+///
+/// Replaces the per bucket local walk: a DualTreeWalk over the local
+/// tree does all local interactions, in pieces walked by
+/// nextDualPairs(), after which every bucket has finished its local
+/// work.
+void TreePiece::calculateGravityDual(Compute *comp) {
+  cDual = comp;
+  DualTreeWalk *dualWalk = new DualTreeWalk(comp, this);
+  twDual = dualWalk;
+
+  comp->init(root, activeRung, sLocal);
+  sDualState = comp->getNewState();
+  comp->initState(sDualState);
+  iDualReplica = 0;
+  dualWalk->start(sDualState, dualWalkOffset(iDualReplica, nReplicas));
+
+  dummyMsg *msg = new (8*sizeof(int)) dummyMsg;
+  *((int *)CkPriorityPtr(msg)) = 2 * numTreePieces * numChunks + thisIndex + 1;
+  CkSetQueueing(msg,CK_QUEUEING_IFIFO);
+  thisProxy[thisIndex].nextDualPairs(msg);
+}
+
+void TreePiece::nextDualPairs(dummyMsg *msg) {
+  DualTreeWalk *dualWalk = (DualTreeWalk *)twDual;
+  int nRep = 2*nReplicas + 1;
+
+  if(dualWalk->resume(sDualState, -1,
+                      dualWalkOffset(iDualReplica, nReplicas), -1,
+                      _yieldPeriod*nDualPairsPerBucket)) {
+    iDualReplica++;
+    if(iDualReplica < nRep*nRep*nRep)
+      dualWalk->start(sDualState, dualWalkOffset(iDualReplica, nReplicas));
+  }
+  if(iDualReplica < nRep*nRep*nRep) {
+    thisProxy[thisIndex].nextDualPairs(msg);
+    return;
+  }
+  delete msg;
+
+  FmmState *state = (FmmState *)sDualState;
+  cDual->walkDone(state);
+  addToNodeInterLocal(state->nCellInter + state->nLocalEval);
+  addToParticleInterLocal(state->nPartInter);
+  cDual->freeState(state);
+  delete twDual;
+  delete cDual;
+  twDual = NULL;
+  cDual = NULL;
+  sDualState = NULL;
+
+  for(int j = 0; j < numBuckets; j++) {
+    sLocalGravityState->counterArrays[0][j]--;
+    finishBucket(j);
+  }
+}
+
 void TreePiece::calculateEwald(dummyMsg *msg) {
 #ifdef SPCUDA
   if(dm->gputransfer){
@@ -4168,7 +4675,7 @@ void TreePiece::calculateGravityRemote(ComputeChunkMsg *msg) {
   // ckloop part.
   int tmpBucketBegin;
 
-  if (bUseCkLoopPar && otherIdlePesAvail()) {
+  if (bUseCkLoopPar && fpInterList == NULL && otherIdlePesAvail()) {
     useckloop = true;
     // This value was chosen to be 2*Nodesize so that we have enough buckets for
     // all the PEs in the node and also giving some extra for load balance.
@@ -4643,6 +5150,8 @@ void TreePiece::finishNodeCache(const CkCallback& cb)
     for (j = 0; j < numChunks; j++) {
 	cacheNode.ckLocalBranch()->finishedChunk(j, 0);
 	}
+    if (bAdaptiveCacheDepth)
+	CkpvAccess(cacheDepthModel)->flush();
     contribute(cb);
     }
 
@@ -4886,6 +5395,7 @@ void TreePiece::startGravity(int am, // the active mask for multistepping
 
   int oldNumChunks = numChunks;
   dm->getChunks(numChunks, prefetchRoots);
+  if (bHistoryPrefetch) savePrefetchHistory();
   CkArrayIndexMax idxMax = CkArrayIndex1D(thisIndex);
   // The following if is necessary to make nodes containing only TreePieces
   // without particles to get stuck and crash...
@@ -4947,8 +5457,21 @@ void TreePiece::startGravity(int am, // the active mask for multistepping
   prevRemoteBucket = -1;
 #endif
 
+  if(dAccErrTol > 0.0)
+    setAccOldMin(root);
   initBuckets();
 
+  if(iInterListDump > 0 && iterationNo == (unsigned int) iInterListDump) {
+    char achFile[64];
+    sprintf(achFile, "ilist.%d", thisIndex);
+    fpInterList = fopen(achFile, "w");
+    if(fpInterList == NULL)
+      CkAbort("Unable to open interaction list file\n");
+    ILHeader header;
+    header.init(thisIndex, activeRung);
+    fwrite(&header, sizeof(header), 1, fpInterList);
+  }
+
   switch(domainDecomposition){
     case Oct_dec:
     case ORB_dec:
@@ -4990,7 +5513,10 @@ void TreePiece::startGravity(int am, // the active mask for multistepping
   sTopDown = new TopDownTreeWalk;
 
   sLocal = new LocalOpt;
-  sRemote = new RemoteOpt;
+  if(bFmmGravity || bMutualGravity)
+    sRemote = new FmmRemoteOpt;
+  else
+    sRemote = new RemoteOpt;
 
   if(_prefetch) sPrefetch = new PrefetchCompute;
   else sPrefetch = new DummyPrefetchCompute;
@@ -5010,6 +5536,7 @@ void TreePiece::startGravity(int am, // the active mask for multistepping
 #endif
 
   // much of this part is common to interlist and normal algo.
+  compute->setArena(&walkArena);
   compute->init((void *)0, activeRung, sLocal);
   localWalkState = compute->getNewState(numBuckets);
 
@@ -5149,6 +5676,7 @@ void TreePiece::startGravity(int am, // the active mask for multistepping
 
   sPrefetch->init((void *)0, activeRung, sPref);
   sTopDown->init(sPrefetch, this);
+  sPrefetch->setArena(&walkArena);
   sPrefetchState = sPrefetch->getNewState(1);
   // instead of prefetchWaiting, we count through state->counters[0]
   sPrefetchState->counterArrays[0][0] = (2*nReplicas + 1)*(2*nReplicas + 1)*(2*nReplicas + 1);
@@ -5205,6 +5733,7 @@ void TreePiece::startGravity(int am, // the active mask for multistepping
 // given chunk has been completely prefetched, the prefetch
 // compute invokes startRemoteChunk() 
 void TreePiece::initiatePrefetch(int chunk){
+  if (historyPrefetch(chunk)) return;
 #ifdef DISABLE_NODE_TREE
   GenericTreeNode *child = keyToNode(prefetchRoots[chunk]);
 #else
@@ -5235,6 +5764,76 @@ void TreePiece::initiatePrefetch(int chunk){
 
 }
 
+/// @brief Prefetch chunk by requesting the remote nodes that the
+/// last gravity walk at this rung requested (bHistoryPrefetch).
+///
+/// The requests are counted like the misses of the prefetch walk
+/// which they replace, and a node received resumes that walk below
+/// it.
+/// @return false if there is no history on this tree, in which case
+/// the prefetch walk is done.
+bool TreePiece::historyPrefetch(int chunk) {
+  if (!bHistoryPrefetch || activeRung >= (int) prefetchHistory.size()
+      || prefetchHistoryBuild[activeRung] != iTreeBuild)
+    return false;
+
+  const std::vector<PrefetchRecord> &history = prefetchHistory[activeRung];
+  int &nPending = sPrefetchState->counterArrays[0][0];
+  // Only the walks record requests: a node no longer needed drops
+  // out of the history.
+  bPrefetchReplay = true;
+  for (size_t i = 0; i < history.size(); i++) {
+    const PrefetchRecord &r = history[i];
+    if (r.chunk != chunk) continue;
+    nPending++;
+    if (requestNode(r.remoteIndex, r.key, chunk, r.offset, prefetchAwi,
+                    (void *)0, true) != NULL)
+      nPending--;
+  }
+  bPrefetchReplay = false;
+  // Account for the replica walks not done.
+  nPending -= (2*nReplicas + 1)*(2*nReplicas + 1)*(2*nReplicas + 1);
+  if (nPending == 0) startRemoteChunk();
+  return true;
+}
+
+/// @brief Keep the requests of the last gravity walk as the history
+/// of its rung, and start recording those of a new walk.
+void TreePiece::savePrefetchHistory() {
+  if (prefetchRecordRung >= 0) {
+    if ((int) prefetchHistory.size() <= prefetchRecordRung) {
+      prefetchHistory.resize(prefetchRecordRung + 1);
+      prefetchHistoryBuild.resize(prefetchRecordRung + 1, -1);
+    }
+    prefetchHistory[prefetchRecordRung].swap(prefetchRecords);
+    prefetchHistoryBuild[prefetchRecordRung] = prefetchRecordBuild;
+  }
+  prefetchRecords.clear();
+  prefetchRecordIndex.clear();
+  prefetchRecordRung = activeRung;
+  prefetchRecordBuild = iTreeBuild;
+}
+
+/// @brief Record a node request of a gravity walk, once for each
+/// replica offset.
+void TreePiece::recordPrefetch(Tree::NodeKey key, int remoteIndex,
+                               int chunk, int offset) {
+  int i = prefetchRecords.size();
+  std::pair<Tree::NodeKeyTable<int>::iterator, bool> first
+    = prefetchRecordIndex.insert(std::make_pair(key, i));
+  if (!first.second) {
+    int j = first.first->second;
+    while (true) {
+      if (prefetchRecords[j].offset == offset) return;
+      if (prefetchRecords[j].next < 0) break;
+      j = prefetchRecords[j].next;
+    }
+    prefetchRecords[j].next = i;
+  }
+  PrefetchRecord r = {key, remoteIndex, chunk, offset, -1};
+  prefetchRecords.push_back(r);
+}
+
 void TreePiece::commenceCalculateGravityLocal(){
 #if INTERLIST_VER > 0 
   // must set placedRoots to false before starting local comp.
@@ -5424,6 +6023,11 @@ GenericTreeNode* TreePiece::requestNode(int remoteIndex, Tree::NodeKey key, int
     CkCacheRequestorData<KeyType> request(thisElement, &EntryTypeGravityNode::callback, userData);
     CkArrayIndexMax remIdx = CkArrayIndex1D(remoteIndex);
     GenericTreeNode *res = (GenericTreeNode *) cacheNode.ckLocalBranch()->requestData(key,remIdx,chunk,&gravityNodeEntry,request);
+    gravityNodeEntry.stats.lookup(chunk, res != NULL);
+    if (bAdaptiveCacheDepth && res == NULL)
+      CkpvAccess(cacheDepthModel)->missed(key);
+    if (bHistoryPrefetch && awi != smoothAwi && !bPrefetchReplay)
+      recordPrefetch(key, remoteIndex, chunk, reqID - decodeReqID(reqID));
 
 #ifdef CHANGA_REFACTOR_INTERLIST_PRINT_BUCKET_START_FIN
     if(source && !res){
@@ -5463,6 +6067,7 @@ ExternalGravityParticle *TreePiece::requestParticles(Tree::NodeKey key,int chunk
     //
     KeyType ckey = key<<1;
     CacheParticle *p = (CacheParticle *) cacheGravPart.ckLocalBranch()->requestData(ckey,remIdx,chunk,&gravityParticleEntry,request);
+    gravityParticleEntry.stats.lookup(chunk, p != NULL);
     if (p == NULL) {
 #ifdef CHANGA_REFACTOR_INTERLIST_PRINT_BUCKET_START_FIN
       if(source){
@@ -5509,6 +6114,7 @@ TreePiece::requestSmoothParticles(Tree::NodeKey key,int chunk,int remoteIndex,
     CkArrayIndexMax remIdx = CkArrayIndex1D(remoteIndex);
     KeyType ckey = key<<1;
     CacheSmoothParticle *p = (CacheSmoothParticle *) cacheSmoothPart.ckLocalBranch()->requestData(ckey,remIdx,chunk,&smoothParticleEntry,request);
+    smoothParticleEntry.stats.lookup(chunk, p != NULL);
     if (p == NULL) {
       return NULL;
     }
@@ -5895,10 +6501,8 @@ void TreePiece::printTree(GenericTreeNode* node, ostream& os) {
     os << "Empty "<<node->remoteIndex;
     break;
   }
-#ifndef HEXADECAPOLE
   if (node->getType() == Bucket || node->getType() == Internal || node->getType() == Boundary || node->getType() == NonLocal || node->getType() == NonLocalBucket)
-    os << " V "<<node->moments.soft<<" "<<node->moments.cm.x<<" "<<node->moments.cm.y<<" "<<node->moments.cm.z<<" "<<node->moments.xx<<" "<<node->moments.xy<<" "<<node->moments.xz<<" "<<node->moments.yy<<" "<<node->moments.yz<<" "<<node->moments.zz<<" "<<node->boundingBox;
-#endif
+    os << " V "<<node->moments.soft<<" "<<node->moments.cm.x<<" "<<node->moments.cm.y<<" "<<node->moments.cm.z<<" "<<node->moments.mom.xx<<" "<<node->moments.mom.xy<<" "<<node->moments.mom.xz<<" "<<node->moments.mom.yy<<" "<<node->moments.mom.yz<<" "<<node->boundingBox;
   os << "\n";
 
   if(node->getType() == NonLocal || node->getType() == NonLocalBucket || node->getType() == Bucket || node->getType() == Empty)
@@ -6019,10 +6623,8 @@ void printGenericTree(GenericTreeNode* node, ostream& os) {
     os << "Empty "<<node->remoteIndex;
     break;
   }
-#ifndef HEXADECAPOLE
   if (node->getType() == Bucket || node->getType() == Internal || node->getType() == Boundary || node->getType() == NonLocal || node->getType() == NonLocalBucket)
-    os << " V "<<node->moments.soft<<" "<<node->moments.cm.x<<" "<<node->moments.cm.y<<" "<<node->moments.cm.z<<" "<<node->moments.xx<<" "<<node->moments.xy<<" "<<node->moments.xz<<" "<<node->moments.yy<<" "<<node->moments.yz<<" "<<node->moments.zz;
-#endif
+    os << " V "<<node->moments.soft<<" "<<node->moments.cm.x<<" "<<node->moments.cm.y<<" "<<node->moments.cm.z<<" "<<node->moments.mom.xx<<" "<<node->moments.mom.xy<<" "<<node->moments.mom.xz<<" "<<node->moments.mom.yy<<" "<<node->moments.mom.yz;
 
   os << "\n";
 
@@ -6267,6 +6869,8 @@ void TreePiece::freeWalkObjects(){
     delete sRemote;
     sPrefetch = NULL;
   }
+  // All the states of the walk have been freed.
+  walkArena.reset();
 }
 
 void TreePiece::finishedChunk(int chunk){
@@ -6429,6 +7033,10 @@ void TreePiece::finishWalk()
   
 #endif
 
+  if(fpInterList != NULL) {
+    fclose(fpInterList);
+    fpInterList = NULL;
+  }
   gravityProxy[thisIndex].ckLocal()->contribute(cbGravity);
 }
 
@@ -6523,6 +7131,33 @@ void TreePiece::memCacheStats(const CkCallback &cb)
     contribute(4*sizeof(int), memOut, CkReduction::max_int, cb);
 }
 
+/*
+ * Gather the cache counters of the node, gravity particle and smooth
+ * particle caches since the last call, for each chunk, and reset them.
+ */
+void TreePiece::cacheStats(const CkCallback &cb)
+{
+    CacheStats *stats[3] = {&gravityNodeEntry.stats,
+                            &gravityParticleEntry.stats,
+                            &smoothParticleEntry.stats};
+    const int nChunks = (_numChunks > 0 ? _numChunks : 1);
+    const int nCounters = CacheStats::nCounters;
+    std::vector<int64_t> counts(3*nChunks*nCounters, 0);
+    for(int i = 0; i < 3; i++) {
+        int nUsed = stats[i]->counts.size()/nCounters;
+        for(int c = 0; c < nUsed; c++) {
+            // Fold any chunk beyond the last into it.
+            int iOut = (c < nChunks ? c : nChunks - 1);
+            for(int j = 0; j < nCounters; j++)
+                counts[(i*nChunks + iOut)*nCounters + j]
+                    += stats[i]->counts[c*nCounters + j];
+        }
+        stats[i]->clear();
+    }
+    contribute(counts.size()*sizeof(int64_t), &counts[0],
+               CkReduction::sum_long_long, cb);
+}
+
 void TreePiece::balanceBeforeInitialForces(const CkCallback &cb){
   LDObjHandle handle = myRec->getLdHandle();
   LBDatabase *lbdb = LBDatabaseObj();
@@ -6623,8 +7258,8 @@ int TreePiece::getResponsibleIndex(int first, int last){
   return dm->responsibleIndex[which];
 }
 
-std::map<NodeKey,NonLocalMomentsClientList>::iterator TreePiece::createTreeBuildMomentsEntry(GenericTreeNode *pickedNode){
-  std::pair<std::map<NodeKey,NonLocalMomentsClientList>::iterator,bool> ret;
+NonLocalMomentsClientTable::iterator TreePiece::createTreeBuildMomentsEntry(GenericTreeNode *pickedNode){
+  std::pair<NonLocalMomentsClientTable::iterator,bool> ret;
   ret = nonLocalMomentsClients.insert(make_pair(pickedNode->getKey(),NonLocalMomentsClientList(pickedNode)));
   CkAssert(ret.second);
   return ret.first;
@@ -456,8 +456,8 @@ void LocalTargetWalk::resumeWalk(GenericTreeNode *node, State *state_, int chunk
 	// other resumed walks in the computation for this
 	// instance
 	// init state
-	bool localLists = state->lplists.length() > 0;
-	bool remoteLists = state->rplists.length() > 0;
+	bool localLists = state->lplists != NULL;
+	bool remoteLists = state->rplists != NULL;
 
 	int level = source->getLevel(source->getKey());
 	for(int i = 0; i <= level; i++){
@@ -519,6 +519,79 @@ void LocalTargetWalk::resumeWalk(GenericTreeNode *node, State *state_, int chunk
 }
 #endif
 
+void DualTreeWalk::walk(GenericTreeNode *node, State *state, int chunk, int reqID, int awi){
+  start(state, reqID);
+  resume(state, chunk, reqID, awi, -1);
+}
+
+void DualTreeWalk::start(State *state, int reqID){
+  FmmState *s = (FmmState *)state;
+  // Without an offset, i interacting with j is j interacting with i.
+  s->bMutual = (ownerTP->decodeOffset(reqID).lengthSquared() == 0.0);
+  s->pairs.clear();
+  for(int i = s->nRoots - 1; i >= 0; i--){
+    for(int j = s->nRoots - 1; j >= (s->bMutual ? i : 0); j--){
+      s->pairs.push_back(std::make_pair(i, j));
+    }
+  }
+}
+
+bool DualTreeWalk::resume(State *state, int chunk, int reqID, int awi, int nPairs){
+#ifdef BENCHMARK_TIME_WALK
+  double startTime = CmiWallTimer();
+#endif
+  FmmState *s = (FmmState *)state;
+  for(int n = 0; !s->pairs.empty() && (nPairs < 0 || n < nPairs); n++){
+    std::pair<int, int> p = s->pairs.back();
+    s->pairs.pop_back();
+    walkPair(p.first, p.second, state, chunk, reqID, awi);
+  }
+#ifdef BENCHMARK_TIME_WALK
+  walkTime += CmiWallTimer() - startTime;
+#endif
+  return s->pairs.empty();
+}
+
+/// @brief Interact a pair of cells, and queue the pairs of their
+/// children if the pair has to be split.  Children are queued in
+/// reverse so that the walk stays depth first in the original order.
+/// @param target Index of the target cell in FmmState::cells.
+/// @param source Index of the source cell in FmmState::cells.
+void DualTreeWalk::walkPair(int target, int source, State *state, int chunk, int reqID, int awi){
+  FmmState *s = (FmmState *)state;
+  FmmCell &t = s->cells[target];
+  FmmCell &src = s->cells[source];
+
+  if(target == source && s->bMutual && t.nChild > 0){
+    // a cell with itself: every unordered pair of its children
+    for(int i = t.iChild + t.nChild - 1; i >= t.iChild; i--){
+      for(int j = t.iChild + t.nChild - 1; j >= i; j--){
+        s->pairs.push_back(std::make_pair(i, j));
+      }
+    }
+    return;
+  }
+
+  s->target = target;
+  s->source = source;
+  bool didcomp = false;
+  if(comp->doWork(src.node, this, state, chunk, reqID, false, didcomp, awi) != KEEP)
+    return;
+
+  // split the larger of the two cells
+  if(src.nChild == 0 || (t.nChild > 0 &&
+     t.node->moments.getRadius() >= src.node->moments.getRadius())){
+    for(int i = t.iChild + t.nChild - 1; i >= t.iChild; i--){
+      s->pairs.push_back(std::make_pair(i, source));
+    }
+  }
+  else{
+    for(int j = src.iChild + src.nChild - 1; j >= src.iChild; j--){
+      s->pairs.push_back(std::make_pair(target, j));
+    }
+  }
+}
+
 const char *translations[] = {"",
                                  "Invalid",
                                  "Bucket",
@@ -131,6 +131,29 @@ class LocalTargetWalk : public TreeWalk {
 };
 #endif
 
+/// @brief Walk pairs of cells of the local tree for FmmCompute and
+/// MutualCompute.
+///
+/// Every pair of local subtree roots is visited for each periodic
+/// offset; pairs the Compute wants opened (KEEP) are split on the
+/// larger cell.  With no offset each unordered pair is visited once
+/// and the Compute applies it to both cells.
+class DualTreeWalk : public TreeWalk {
+  void walkPair(int target, int source, State *state, int chunk, int reqID,
+                int awi);
+
+  public:
+  DualTreeWalk(Compute *_comp, TreePiece *tp):TreeWalk(_comp,tp,DualTree){}
+  DualTreeWalk() : TreeWalk(DualTree) {}
+
+  void walk(GenericTreeNode *node, State *state, int chunk, int reqID, int awi);
+  /// Queue the pairs of roots for a walk with offset reqID.
+  void start(State *state, int reqID);
+  /// Walk at most nPairs queued pairs (all if negative).
+  /// @return true once no pairs are left.
+  bool resume(State *state, int chunk, int reqID, int awi, int nPairs);
+};
+
 /// @brief class to walk just the local treepiece.
 class LocalTreeTraversal {
 
@@ -22,9 +22,10 @@
 #define CONTAIN 1 
 #define NO_INTERSECT 0
 
-enum WalkType {TopDown, LocalTarget, BottomUp, BucketIterator, InvalidWalk};
+enum WalkType {TopDown, LocalTarget, BottomUp, BucketIterator, DualTree,
+	       InvalidWalk};
 enum ComputeType {Gravity, Prefetch, List, BucketEwald, Smooth, ReSmooth,
-		  InvalidCompute};
+		  Fmm, Mutual, InvalidCompute};
 
 enum OptType {Local, Remote, Pref, Double, PushGravity, InvalidOpt};
 
@@ -75,13 +75,9 @@ typedef struct CudaMultipoleMoments{
   cudatype totalMass;
   CudaVector3D cm;
 
-#ifdef HEXADECAPOLE
   cudatype xx, xy, xz, yy, yz;
   cudatype xxx,xyy,xxy,yyy,xxz,yyz,xyz;
   cudatype xxxx,xyyy,xxxy,yyyy,xxxz,yyyz,xxyy,xxyz,xyyz;
-#else
-  cudatype xx, xy, xz, yy, yz, zz;
-#endif
 
 #if __cplusplus && !defined __CUDACC__
   CudaMultipoleMoments(){}
@@ -94,14 +90,6 @@ typedef struct CudaMultipoleMoments{
     totalMass = m.totalMass;
 
     cm = m.cm;
-#if ! defined(HEXADECAPOLE)
-    xx = m.xx;
-    xy = m.xy;
-    xz = m.xz;
-    yy = m.yy;
-    yz = m.yz;
-    zz = m.zz;
-#else
     xx = m.mom.xx;
     yy = m.mom.yy;
     xy = m.mom.xy;
@@ -123,7 +111,6 @@ typedef struct CudaMultipoleMoments{
     xxyy = m.mom.xxyy;
     xxyz = m.mom.xxyz;
     xyyz = m.mom.xyyz;
-#endif
 
     return *this;
   }
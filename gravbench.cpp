@@ -0,0 +1,726 @@
+/** @file gravbench.cpp
+ * Microbenchmark of the gravity kernels in gravity.h and Ewald.h.
+ * A synthetic bucket and a list of well separated source cells are
+ * built once, then each kernel is applied to them repeatedly and the
+ * rate is reported as interactions per second and nanoseconds per
+ * interaction.
+ *
+ * Usage: ./charmrun +p1 ./gravbench [nBucket [nCells [nRepeat]]]
+ *        ./charmrun +p1 ./gravbench -replay nRepeat ilist.0 [ilist.1 ...]
+ *        ./charmrun +p1 ./gravbench -lookup nNodes nRepeat
+ *        ./charmrun +p1 ./gravbench -sort nParticles nRepeat
+ *
+ * The second form replays interaction lists recorded by ChaNGa with
+ * iInterListDump, so the kernels can be timed on the lists of a real
+ * simulation without the tree walk and communication.  The third
+ * times key to node lookups in NodeLookupType against a std::map,
+ * and the fourth the radix sort of particles by key (bRadixSort)
+ * against std::sort.
+ *
+ * The SIMD width and precision are fixed when ChaNGa is configured, so
+ * build "make bench" in each build directory of interest and compare
+ * the output.  The node-bucket kernel is timed at each expansion order.
+ */
+
+#include "config.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <map>
+#include "gravity.h"
+#include "Ewald.h"
+#include "InterListRecord.h"
+#include "RadixSort.h"
+#include "gravbench.decl.h"
+
+using namespace Tree;
+
+cosmoType theta = 0.7;
+cosmoType thetaMono = 0.7;
+int iMultipoleOrder = 4;
+double dAccErrTol = 0.0;
+double dPMSplit = 0.0;
+double dPMCut = 0.0;
+
+/// Number of particles in each source cell
+const int nPartPerCell = 8;
+/// Half width of the bucket and of the source cells
+const double dCellSize = 0.005;
+/// Gravitational softening of all particles
+const double dSoft = 1.0e-4;
+
+static double ran(double lo, double hi)
+{
+    return lo + (hi - lo)*(rand()/((double) RAND_MAX));
+}
+
+/// @brief Place a particle uniformly in a cube about center.
+static void initParticle(GravityParticle &p, const Vector3D<double> &center,
+                         double mass)
+{
+    p.position.x = center.x + ran(-dCellSize, dCellSize);
+    p.position.y = center.y + ran(-dCellSize, dCellSize);
+    p.position.z = center.z + ran(-dCellSize, dCellSize);
+    p.mass = mass;
+    p.soft = dSoft;
+    p.treeAcceleration.x = p.treeAcceleration.y = p.treeAcceleration.z = 0.0;
+    p.potential = 0.0;
+    p.dtGrav = 0.0;
+    p.rung = 0;
+    p.iType = TYPE_DARK;
+    p.extraData = NULL;
+}
+
+/// @brief Make a bucket node holding particles first through last.
+static BinaryTreeNode *makeNode(NodeKey key, int first, int last,
+                                GravityParticle *particles)
+{
+    BinaryTreeNode *node = new BinaryTreeNode(key, Bucket, first, last, NULL);
+    node->particleCount = last - first + 1;
+    node->particlePointer = &particles[first];
+    node->makeBucket(particles);
+    return node;
+}
+
+/// @brief Buckets and the interaction list applied to them, as read
+/// from a recorded ILRecord.
+struct ReplayList {
+    int activeRung;
+    std::vector<BinaryTreeNode *> buckets;
+    std::vector<BinaryTreeNode *> nodes;
+    std::vector<Vector3D<cosmoType> > nodeOffsets;
+    std::vector<ExternalGravityParticle> parts;
+    std::vector<Vector3D<cosmoType> > partOffsets;
+};
+
+static void readOrAbort(void *buf, size_t size, FILE *fp)
+{
+    if(fread(buf, size, 1, fp) != 1)
+        CkAbort("gravbench: truncated interaction list file\n");
+}
+
+/// @brief Main chare: sets up the synthetic tree, runs and times each
+/// kernel, then exits.
+class GravBench : public CBase_GravBench {
+    int nBucket;	///< particles in the target bucket
+    int nCells;		///< source cells in the interaction list
+    int nRepeat;	///< times each kernel is applied to the list
+    /// The bucket particles followed by those of the source cells
+    std::vector<GravityParticle> particles;
+    BinaryTreeNode *bucket;
+    std::vector<BinaryTreeNode *> cells;
+    BinaryTreeNode *root;
+
+    void report(const char *name, double dTime, double nInter);
+    void benchPartBucket();
+    void benchNodeBucket();
+    void benchFarFieldFloat();
+    void benchSoA();
+    void benchSpline();
+    void benchEwald();
+    void readInterLists(const char *file, std::vector<ReplayList> &lists,
+                        std::vector<GravityParticle> &targets);
+    void replay(int nFiles, char **files);
+    void benchLookup(int nNodes);
+    void benchSort(int nParticles);
+public:
+    GravBench(CkArgMsg *m);
+};
+
+GravBench::GravBench(CkArgMsg *m)
+{
+    if(m->argc > 3 && strcmp(m->argv[1], "-replay") == 0) {
+        nRepeat = atoi(m->argv[2]);
+        if(nRepeat < 1)
+            CkAbort("Usage: gravbench -replay nRepeat files\n");
+        replay(m->argc - 3, &m->argv[3]);
+        delete m;
+        CkExit();
+        return;
+    }
+    if(m->argc > 1 && strcmp(m->argv[1], "-lookup") == 0) {
+        int nNodes = (m->argc > 2 ? atoi(m->argv[2]) : 100000);
+        nRepeat = (m->argc > 3 ? atoi(m->argv[3]) : 100);
+        if(nNodes < 1 || nRepeat < 1)
+            CkAbort("Usage: gravbench -lookup nNodes nRepeat\n");
+        benchLookup(nNodes);
+        delete m;
+        CkExit();
+        return;
+    }
+    if(m->argc > 1 && strcmp(m->argv[1], "-sort") == 0) {
+        int nParticles = (m->argc > 2 ? atoi(m->argv[2]) : 100000);
+        nRepeat = (m->argc > 3 ? atoi(m->argv[3]) : 10);
+        if(nParticles < 1 || nRepeat < 1)
+            CkAbort("Usage: gravbench -sort nParticles nRepeat\n");
+        benchSort(nParticles);
+        delete m;
+        CkExit();
+        return;
+    }
+    nBucket = (m->argc > 1 ? atoi(m->argv[1]) : 16);
+    nCells = (m->argc > 2 ? atoi(m->argv[2]) : 512);
+    nRepeat = (m->argc > 3 ? atoi(m->argv[3]) : 1000);
+    delete m;
+    if(nBucket < 1 || nCells < 1 || nRepeat < 1)
+        CkAbort("Usage: gravbench [nBucket [nCells [nRepeat]]]\n");
+
+    int nTotal = nBucket + nCells*nPartPerCell;
+    double mass = 1.0/nTotal;
+    particles.resize(nTotal);
+    srand(1);
+    for(int i = 0; i < nBucket; i++)
+        initParticle(particles[i], Vector3D<double>(0.0, 0.0, 0.0), mass);
+    // Source cells are scattered on shells well outside the bucket.
+    for(int c = 0; c < nCells; c++) {
+        Vector3D<double> dir(ran(-1.0, 1.0), ran(-1.0, 1.0), ran(-1.0, 1.0));
+        Vector3D<double> center = dir*(ran(0.05, 0.4)/dir.length());
+        for(int k = 0; k < nPartPerCell; k++)
+            initParticle(particles[nBucket + c*nPartPerCell + k], center,
+                         mass);
+    }
+
+    bucket = makeNode(2, 0, nBucket - 1, &particles[0]);
+    for(int c = 0; c < nCells; c++) {
+        int first = nBucket + c*nPartPerCell;
+        cells.push_back(makeNode(c + 3, first, first + nPartPerCell - 1,
+                                 &particles[0]));
+    }
+    root = makeNode(1, 0, nTotal - 1, &particles[0]);
+
+    CkPrintf("gravbench: bucket of %d, %d cells of %d particles, %d repeats\n",
+             nBucket, nCells, nPartPerCell, nRepeat);
+    CkPrintf("gravbench: %s precision, vector width %d\n",
+#ifdef COSMO_FLOAT
+             "single",
+#else
+             "double",
+#endif
+#if CMK_SSE
+             SSE_VECTOR_WIDTH
+#else
+             1
+#endif
+             );
+    CkPrintf("%-28s %14s %10s %12s %10s\n", "kernel", "interactions",
+             "seconds", "inter/s", "ns/inter");
+
+    benchPartBucket();
+    benchNodeBucket();
+    benchFarFieldFloat();
+    benchSoA();
+    benchSpline();
+    benchEwald();
+
+    // Use the results so the kernels cannot be optimized away.
+    double sum = 0.0;
+    for(int i = 0; i < nBucket; i++)
+        sum += particles[i].potential + particles[i].treeAcceleration.x;
+    CkPrintf("gravbench: checksum %g\n", sum);
+
+    for(int c = 0; c < nCells; c++)
+        delete cells[c];
+    delete bucket;
+    delete root;
+    CkExit();
+}
+
+void GravBench::report(const char *name, double dTime, double nInter)
+{
+    CkPrintf("%-28s %14.0f %10.4f %12.4g %10.3f\n", name, nInter, dTime,
+             nInter/dTime, 1.0e9*dTime/nInter);
+}
+
+/// @brief partBucketForce() with every source cell particle.
+void GravBench::benchPartBucket()
+{
+    Vector3D<cosmoType> offset(0.0, 0.0, 0.0);
+    double nInter = 0.0;
+    double dStart = CmiWallTimer();
+    for(int r = 0; r < nRepeat; r++)
+        for(unsigned int k = nBucket; k < particles.size(); k++)
+            nInter += partBucketForce(&particles[k], bucket, &particles[0],
+                                      offset, 0);
+    report("partBucketForce", CmiWallTimer() - dStart, nInter);
+}
+
+/// @brief nodeBucketForce() at each expansion order.
+void GravBench::benchNodeBucket()
+{
+    Vector3D<cosmoType> offset(0.0, 0.0, 0.0);
+    const int maxOrder = 4;
+    for(int order = 2; order <= maxOrder; order++) {
+        char name[64];
+        iMultipoleOrder = order;
+        double nInter = 0.0;
+        double dStart = CmiWallTimer();
+        for(int r = 0; r < nRepeat; r++)
+            for(int c = 0; c < nCells; c++)
+                nInter += nodeBucketForce(cells[c], bucket, &particles[0],
+                                          offset, 0);
+        sprintf(name, "nodeBucketForce order %d", order);
+        report(name, CmiWallTimer() - dStart, nInter);
+    }
+    iMultipoleOrder = maxOrder;
+}
+
+/// @brief Mixed precision nodeBucketForceFloat() (bFarFieldFloat).
+void GravBench::benchFarFieldFloat()
+{
+    Vector3D<cosmoType> offset(0.0, 0.0, 0.0);
+    std::vector<char> buf(FarFieldTargets::bytes(nBucket));
+    FarFieldTargets targets;
+    double nInter = 0.0;
+    double dStart = CmiWallTimer();
+    for(int r = 0; r < nRepeat; r++) {
+        targets.init(&buf[0], &particles[0], bucket, 0);
+        for(int c = 0; c < nCells; c++)
+            nInter += nodeBucketForceFloat(cells[c], bucket, &particles[0],
+                                           offset, 0, targets);
+        targets.store(&particles[0]);
+    }
+    report("nodeBucketForceFloat", CmiWallTimer() - dStart, nInter);
+}
+
+/// @brief Packed interaction list kernels (bSoAGravity).
+void GravBench::benchSoA()
+{
+    Vector3D<cosmoType> offset(0.0, 0.0, 0.0);
+    GravityNodeSoA srcNodes;
+    GravityPartSoA srcParts;
+    GravityTargetSoA targets;
+    for(int c = 0; c < nCells; c++)
+        srcNodes.push_back(cells[c]->moments, offset);
+    for(unsigned int k = nBucket; k < particles.size(); k++)
+        srcParts.push_back(particles[k], offset);
+
+    double nInter = 0.0;
+    double dStart = CmiWallTimer();
+    for(int r = 0; r < nRepeat; r++) {
+        targets.load(&particles[0], bucket, 0);
+        nInter += partBucketForceSoA(srcParts, targets);
+        targets.store();
+    }
+    report("partBucketForceSoA", CmiWallTimer() - dStart, nInter);
+
+    nInter = 0.0;
+    dStart = CmiWallTimer();
+    for(int r = 0; r < nRepeat; r++) {
+        targets.load(&particles[0], bucket, 0);
+        nInter += nodeBucketForceSoA(srcNodes, bucket, targets);
+        targets.store();
+    }
+    report("nodeBucketForceSoA", CmiWallTimer() - dStart, nInter);
+}
+
+/// @brief The softening kernel on its own, with separations that
+/// straddle the softening length.
+void GravBench::benchSpline()
+{
+#if CMK_SSE
+    const int nWidth = SSE_VECTOR_WIDTH;
+#else
+    const int nWidth = 1;
+#endif
+    int n = ((nCells*nPartPerCell + nWidth - 1)/nWidth)*nWidth;
+    std::vector<cosmoType> r2(n), invr(n), twoh(n), out(n);
+    for(int i = 0; i < n; i++) {
+        twoh[i] = 2.0*dSoft;
+        r2[i] = ran(0.01, 2.0)*twoh[i]*twoh[i];
+        invr[i] = 1.0/sqrt(r2[i]);
+    }
+
+    double dStart = CmiWallTimer();
+    for(int r = 0; r < nRepeat; r++) {
+        for(int i = 0; i < n; i += nWidth) {
+#if CMK_SSE
+            SSEcosmoType a, b, c, d;
+            SPLINEQ(SSELoad(SSEcosmoType, invr, i, ),
+                    SSELoad(SSEcosmoType, r2, i, ),
+                    SSELoad(SSEcosmoType, twoh, i, ), a, b, c, d);
+            SSEcosmoType sum = a + b + c + d;
+            SSEStore(sum, out, i, );
+#else
+            cosmoType a, b, c, d;
+            SPLINEQ(invr[i], r2[i], twoh[i], a, b, c, d);
+            out[i] = a + b + c + d;
+#endif
+        }
+    }
+    double dTime = CmiWallTimer() - dStart;
+    particles[0].potential += out[0]*1.0e-30;
+    report("SPLINEQ", dTime, ((double) n)*nRepeat);
+}
+
+/// @brief EwaldSum::evalParticle() for the bucket particles, with
+/// the default dEwCut and dEwhCut, then batched with evalBatch() and
+/// interpolated from an EwaldTable.
+/// An interaction here is one real or Fourier space term.
+void GravBench::benchEwald()
+{
+    const double dEwCut = 2.6;
+    const double dEwhCut = 2.8;
+    const double dPeriod = 1.0;
+    MOMC momc;
+    momRescaleFmomr(&(root->moments.mom), 1.0f, root->moments.getRadius());
+    momFmomr2Momc(&(root->moments.mom), &momc);
+    momRescaleFmomr(&(root->moments.mom), root->moments.getRadius(), 1.0f);
+    EwaldSum ew(momc, root->moments, dPeriod, 1, dEwCut);
+    int nMaxEwhLoop = 100;
+    EWT *ewt = new EWT[nMaxEwhLoop];
+    int nEwhLoop = ew.fillTable(dEwhCut, ewt, nMaxEwhLoop);
+
+    double nInter = 0.0;
+    double dStart = CmiWallTimer();
+    for(int r = 0; r < nRepeat; r++) {
+        for(int j = 0; j < nBucket; j++) {
+            double fPot, ax, ay, az;
+            nInter += ew.evalParticle(particles[j].position, ewt, nEwhLoop,
+                                      fPot, ax, ay, az) + nEwhLoop;
+            particles[j].potential += fPot;
+            particles[j].treeAcceleration.x += ax;
+            particles[j].treeAcceleration.y += ay;
+            particles[j].treeAcceleration.z += az;
+        }
+    }
+    report("Ewald", CmiWallTimer() - dStart, nInter);
+
+    // The same sums, EWALD_BATCH particles at a time as in BucketEwald().
+    double x[EWALD_BATCH], y[EWALD_BATCH], z[EWALD_BATCH];
+    double fPot[EWALD_BATCH], ax[EWALD_BATCH], ay[EWALD_BATCH],
+        az[EWALD_BATCH];
+    nInter = 0.0;
+    dStart = CmiWallTimer();
+    for(int r = 0; r < nRepeat; r++) {
+        for(int j = 0; j < nBucket; j += EWALD_BATCH) {
+            int nBatch = std::min(EWALD_BATCH, nBucket - j);
+            for(int k = 0; k < nBatch; k++) {
+                x[k] = particles[j+k].position.x;
+                y[k] = particles[j+k].position.y;
+                z[k] = particles[j+k].position.z;
+            }
+            nInter += ew.evalBatch(nBatch, x, y, z, ewt, nEwhLoop,
+                                   fPot, ax, ay, az) + nBatch*nEwhLoop;
+            for(int k = 0; k < nBatch; k++) {
+                particles[j+k].potential += fPot[k];
+                particles[j+k].treeAcceleration.x += ax[k];
+                particles[j+k].treeAcceleration.y += ay[k];
+                particles[j+k].treeAcceleration.z += az[k];
+            }
+        }
+    }
+    report("Ewald batch", CmiWallTimer() - dStart, nInter);
+    delete[] ewt;
+
+    // The same correction interpolated from a 64^3 table (nEwaldTable);
+    // an interaction here is one particle.
+    EwaldTable table(64, dPeriod, 1, dEwCut, dEwhCut);
+    const Vector3D<cosmoType> &cm = root->moments.cm;
+    cosmoType m = root->moments.totalMass;
+    dStart = CmiWallTimer();
+    for(int r = 0; r < nRepeat; r++) {
+        for(int j = 0; j < nBucket; j++) {
+            double fPot, ax, ay, az;
+            table.eval(particles[j].position - cm, fPot, ax, ay, az);
+            particles[j].potential += m*fPot;
+            particles[j].treeAcceleration.x += m*ax;
+            particles[j].treeAcceleration.y += m*ay;
+            particles[j].treeAcceleration.z += m*az;
+        }
+    }
+    report("Ewald table", CmiWallTimer() - dStart,
+           ((double) nBucket)*nRepeat);
+}
+
+/// @brief Read the lists of one file, appending the target particles
+/// to targets.
+void GravBench::readInterLists(const char *file,
+                               std::vector<ReplayList> &lists,
+                               std::vector<GravityParticle> &targets)
+{
+    FILE *fp = fopen(file, "r");
+    if(fp == NULL) {
+        CkError("gravbench: unable to open %s\n", file);
+        CkAbort("gravbench: bad interaction list file\n");
+    }
+    ILHeader header;
+    readOrAbort(&header, sizeof(header), fp);
+    if(!header.compatible()) {
+        CkError("gravbench: %s was not written by a ChaNGa built like this benchmark\n",
+                file);
+        CkAbort("gravbench: bad interaction list file\n");
+    }
+
+    ILRecord rec;
+    while(fread(&rec, sizeof(rec), 1, fp) == 1) {
+        lists.push_back(ReplayList());
+        ReplayList &list = lists.back();
+        list.activeRung = header.activeRung;
+        for(int b = 0; b < rec.nBuckets; b++) {
+            ILBucket ilb;
+            readOrAbort(&ilb, sizeof(ilb), fp);
+            int first = targets.size();
+            int rungs = 0;
+            for(int j = 0; j < ilb.nPart; j++) {
+                ILTarget t;
+                readOrAbort(&t, sizeof(t), fp);
+                GravityParticle p;
+                initParticle(p, Vector3D<double>(0.0, 0.0, 0.0), t.mass);
+                p.position = t.position;
+                p.soft = t.soft;
+                p.rung = t.rung;
+                if(t.rung > rungs)
+                    rungs = t.rung;
+                targets.push_back(p);
+            }
+            BinaryTreeNode *bucket = new BinaryTreeNode(ilb.index, Bucket,
+                                                        first,
+                                                        first + ilb.nPart - 1,
+                                                        NULL);
+            bucket->particleCount = ilb.nPart;
+            bucket->moments = ilb.moments;
+            bucket->boundingBox = ilb.boundingBox;
+            bucket->rungs = rungs;
+            list.buckets.push_back(bucket);
+        }
+        for(int i = 0; i < rec.nNodes; i++) {
+            ILNode n;
+            readOrAbort(&n, sizeof(n), fp);
+            BinaryTreeNode *node = new BinaryTreeNode(0, Internal, 0, -1, NULL);
+            node->moments = n.moments;
+            list.nodes.push_back(node);
+            list.nodeOffsets.push_back(n.offset);
+        }
+        for(int i = 0; i < rec.nParticles; i++) {
+            ILSource s;
+            readOrAbort(&s, sizeof(s), fp);
+            list.parts.push_back(s.part);
+            list.partOffsets.push_back(s.offset);
+        }
+    }
+    fclose(fp);
+}
+
+/// @brief Time the force kernels on recorded interaction lists.
+/// Cell interactions are timed with nodeBucketForce() and with
+/// nodeBucketForceFloat(), particle interactions with
+/// partBucketForce().
+void GravBench::replay(int nFiles, char **files)
+{
+    std::vector<ReplayList> lists;
+    std::vector<GravityParticle> targets;
+    for(int i = 0; i < nFiles; i++)
+        readInterLists(files[i], lists, targets);
+    if(targets.size() == 0)
+        CkAbort("gravbench: no buckets in the interaction list files\n");
+
+    double nNode = 0.0, nPart = 0.0;
+    int nBucketsTotal = 0;
+    for(unsigned int l = 0; l < lists.size(); l++) {
+        nBucketsTotal += lists[l].buckets.size();
+        nNode += ((double) lists[l].buckets.size())*lists[l].nodes.size();
+        nPart += ((double) lists[l].buckets.size())*lists[l].parts.size();
+    }
+    CkPrintf("gravbench: replay of %d files, %d lists, %d bucket lists, %d repeats\n",
+             nFiles, (int) lists.size(), nBucketsTotal, nRepeat);
+    CkPrintf("gravbench: %g cell and %g particle interactions with buckets per repeat\n",
+             nNode, nPart);
+    CkPrintf("%-28s %14s %10s %12s %10s\n", "kernel", "interactions",
+             "seconds", "inter/s", "ns/inter");
+
+    GravityParticle *particles = &targets[0];
+    double nInter = 0.0;
+    double dStart = CmiWallTimer();
+    for(int r = 0; r < nRepeat; r++)
+        for(unsigned int l = 0; l < lists.size(); l++) {
+            ReplayList &list = lists[l];
+            for(unsigned int b = 0; b < list.buckets.size(); b++)
+                for(unsigned int i = 0; i < list.nodes.size(); i++)
+                    nInter += nodeBucketForce(list.nodes[i], list.buckets[b],
+                                              particles, list.nodeOffsets[i],
+                                              list.activeRung);
+        }
+    report("replay nodeBucketForce", CmiWallTimer() - dStart, nInter);
+
+    nInter = 0.0;
+    dStart = CmiWallTimer();
+    for(int r = 0; r < nRepeat; r++)
+        for(unsigned int l = 0; l < lists.size(); l++) {
+            ReplayList &list = lists[l];
+            for(unsigned int b = 0; b < list.buckets.size(); b++) {
+                BinaryTreeNode *bucket = list.buckets[b];
+                std::vector<char> buf(FarFieldTargets::bytes(
+                                          bucket->particleCount));
+                FarFieldTargets farTargets;
+                farTargets.init(&buf[0], particles, bucket, list.activeRung);
+                for(unsigned int i = 0; i < list.nodes.size(); i++)
+                    nInter += nodeBucketForceFloat(list.nodes[i], bucket,
+                                                   particles,
+                                                   list.nodeOffsets[i],
+                                                   list.activeRung,
+                                                   farTargets);
+                farTargets.store(particles);
+            }
+        }
+    report("replay nodeBucketForceFloat", CmiWallTimer() - dStart, nInter);
+
+    nInter = 0.0;
+    dStart = CmiWallTimer();
+    for(int r = 0; r < nRepeat; r++)
+        for(unsigned int l = 0; l < lists.size(); l++) {
+            ReplayList &list = lists[l];
+            for(unsigned int b = 0; b < list.buckets.size(); b++)
+                for(unsigned int i = 0; i < list.parts.size(); i++)
+                    nInter += partBucketForce(&list.parts[i], list.buckets[b],
+                                              particles, list.partOffsets[i],
+                                              list.activeRung);
+        }
+    report("replay partBucketForce", CmiWallTimer() - dStart, nInter);
+
+    double sum = 0.0;
+    for(unsigned int i = 0; i < targets.size(); i++)
+        sum += targets[i].potential + targets[i].treeAcceleration.x;
+    CkPrintf("gravbench: checksum %g\n", sum);
+
+    for(unsigned int l = 0; l < lists.size(); l++) {
+        for(unsigned int b = 0; b < lists[l].buckets.size(); b++)
+            delete lists[l].buckets[b];
+        for(unsigned int i = 0; i < lists[l].nodes.size(); i++)
+            delete lists[l].nodes[i];
+    }
+}
+
+/// @brief Time inserting and finding the keys of a synthetic tree in
+/// NodeLookupType and in a std::map.
+///
+/// The keys are those of random descents of a binary tree to about
+/// the depth of a tree with nNodes nodes.  Half of the lookups miss,
+/// as for remote nodes not yet in a cache.
+void GravBench::benchLookup(int nNodes)
+{
+    std::vector<NodeKey> keys;
+    NodeLookupType table;
+    std::map<NodeKey, GenericTreeNode *> tree;
+    int depth = 1;
+    while((1 << depth) < nNodes && depth < 30)
+        depth++;
+    srand(1);
+    while((int) keys.size() < nNodes) {
+        NodeKey key = 1;
+        int d = depth - 2 + rand()%5;
+        for(int i = 0; i < d; i++)
+            key = (key << 1) | (rand() & 1);
+        if(table.find(key) != table.end())
+            continue;
+        table[key] = NULL;
+        keys.push_back(key);
+    }
+    table.clear();
+    // Each key followed by one that is not in the tree.
+    std::vector<NodeKey> queries;
+    for(int i = 0; i < nNodes; i++) {
+        queries.push_back(keys[i]);
+        queries.push_back((keys[i] << 5) | 31);
+    }
+    for(int i = queries.size() - 1; i > 0; i--)
+        std::swap(queries[i], queries[rand()%(i + 1)]);
+
+    GenericTreeNode *node = NULL;
+    CkPrintf("gravbench: %d node keys, depth about %d, %d repeats\n",
+             nNodes, depth, nRepeat);
+    CkPrintf("%-28s %14s %10s %12s %10s\n", "table", "operations",
+             "seconds", "op/s", "ns/op");
+
+    double dStart = CmiWallTimer();
+    for(int r = 0; r < nRepeat; r++) {
+        tree.clear();
+        for(int i = 0; i < nNodes; i++)
+            tree[keys[i]] = node;
+    }
+    report("std::map insert", CmiWallTimer() - dStart,
+           ((double) nRepeat)*nNodes);
+    dStart = CmiWallTimer();
+    for(int r = 0; r < nRepeat; r++) {
+        table.clear();
+        for(int i = 0; i < nNodes; i++)
+            table[keys[i]] = node;
+    }
+    report("NodeLookupType insert", CmiWallTimer() - dStart,
+           ((double) nRepeat)*nNodes);
+
+    int nFound = 0;
+    dStart = CmiWallTimer();
+    for(int r = 0; r < nRepeat; r++)
+        for(unsigned int i = 0; i < queries.size(); i++)
+            nFound += (tree.find(queries[i]) != tree.end());
+    report("std::map find", CmiWallTimer() - dStart,
+           ((double) nRepeat)*queries.size());
+    dStart = CmiWallTimer();
+    for(int r = 0; r < nRepeat; r++)
+        for(unsigned int i = 0; i < queries.size(); i++)
+            nFound -= (table.find(queries[i]) != table.end());
+    report("NodeLookupType find", CmiWallTimer() - dStart,
+           ((double) nRepeat)*queries.size());
+    if(nFound != 0)
+        CkAbort("gravbench: NodeLookupType and std::map disagree\n");
+}
+
+/// @brief Time sorting particles by key with std::sort and with
+/// radixSortByKey().
+///
+/// The keys are random within a range sharing their top 17 bits, as
+/// for a TreePiece holding a slice of the domain.  Both sorts are
+/// timed on unordered particles and on particles that are already
+/// nearly in order, as after a drift, where one particle in 64 has
+/// moved.
+void GravBench::benchSort(int nParticles)
+{
+    std::vector<GravityParticle> unsorted(nParticles), nearly;
+    std::vector<GravityParticle> work1, work2;
+    KeyType base = ((KeyType) 0x5a5a) << (8*sizeof(KeyType) - 17);
+    srand(1);
+    for(int i = 0; i < nParticles; i++) {
+        KeyType key = 0;
+        for(unsigned int b = 0; b < sizeof(KeyType); b++)
+            key = (key << 8) | (rand() & 0xff);
+        unsorted[i].key = base | (key >> 17);
+        unsorted[i].iOrder = i;
+    }
+    nearly = unsorted;
+    std::sort(nearly.begin(), nearly.end());
+    for(int i = 0; i < nParticles/64; i++)
+        std::swap(nearly[rand()%nParticles], nearly[rand()%nParticles]);
+
+    CkPrintf("gravbench: %d particles of %d bytes, %d repeats\n",
+             nParticles, (int) sizeof(GravityParticle), nRepeat);
+    CkPrintf("%-28s %14s %10s %12s %10s\n", "sort", "particles",
+             "seconds", "part/s", "ns/part");
+    const char *names[2][2] = {{"std::sort random", "radix sort random"},
+                               {"std::sort nearly sorted",
+                                "radix sort nearly sorted"}};
+    for(int iCase = 0; iCase < 2; iCase++) {
+        std::vector<GravityParticle> &input = (iCase == 0 ? unsorted : nearly);
+        double dTime = 0.0;
+        for(int r = 0; r < nRepeat; r++) {
+            work1 = input;
+            double dStart = CmiWallTimer();
+            std::sort(work1.begin(), work1.end());
+            dTime += CmiWallTimer() - dStart;
+        }
+        report(names[iCase][0], dTime, ((double) nRepeat)*nParticles);
+        dTime = 0.0;
+        for(int r = 0; r < nRepeat; r++) {
+            work2 = input;
+            double dStart = CmiWallTimer();
+            radixSortByKey(&work2[0], nParticles);
+            dTime += CmiWallTimer() - dStart;
+        }
+        report(names[iCase][1], dTime, ((double) nRepeat)*nParticles);
+        for(int i = 0; i < nParticles; i++)
+            if(work1[i].key != work2[i].key)
+                CkAbort("gravbench: radix sort and std::sort disagree\n");
+    }
+}
+
+#include "gravbench.def.h"
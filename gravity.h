@@ -6,8 +6,38 @@
 #include "Space.h"
 #include "SSEdefs.h"
 
+#include <vector>
+#include <stdlib.h>
+
 extern cosmoType theta;
 extern cosmoType thetaMono;
+extern int iMultipoleOrder;
+extern double dAccErrTol;
+extern double dPMSplit;
+extern double dPMCut;
+
+/*
+** Short range part of the TreePM force split (see PM.h).  With a
+** split scale r_s the tree only sums the kernel erfc(r/2r_s)/r; the
+** rest comes from the mesh.  The derivatives G_l = (-1/r d/dr)^l of
+** that kernel are the Newtonian (2l-1)!!/r^(2l+1) times f[l], with
+** f[0] = erfc(x) and f[l] = f[l-1] + 2x/sqrt(pi) exp(-x^2) (2x^2)^(l-1)/(2l-1)!!
+** for x = r/2r_s.  These are the same terms as the real space Ewald sum.
+*/
+const int PM_NFACTORS = 6;
+
+/// @brief Factors f[0..PM_NFACTORS-1] by which the short range kernel
+/// and its derivatives differ from Newtonian gravity at separation^2 r2.
+inline void pmShortFactors(cosmoType r2, cosmoType *f)
+{
+  cosmoType x = sqrt(r2)/(COSMO_CONST(2.0)*dPMSplit);
+  cosmoType t = COSMO_CONST(2.0)/sqrt(M_PI)*x*exp(-x*x);
+  f[0] = erfc(x);
+  for(int l = 1; l < PM_NFACTORS; l++) {
+    f[l] = f[l-1] + t;
+    t *= COSMO_CONST(2.0)*x*x/(2*l + 1);
+  }
+}
 
 /*
 ** see (A1) and (A2) of TREESPH: A UNIFICATION OF SPH WITH THE 
@@ -63,6 +93,14 @@ void SPLINEQ(cosmoType invr,cosmoType r2,cosmoType twoh,cosmoType& a,
     c = COSMO_CONST(3.0)*b*a*a;
     d = COSMO_CONST(5.0)*c*a*a;
   }
+  if(dPMSplit > 0.0) {
+    cosmoType f[PM_NFACTORS];
+    pmShortFactors(r2, f);
+    a *= f[0];
+    b *= f[1];
+    c *= f[2];
+    d *= f[3];
+  }
 }
 #else
 inline
@@ -101,34 +139,42 @@ void SPLINEQ(SSEcosmoType invr, SSEcosmoType r2, SSEcosmoType twoh,
     select1 = u < COSMO_CONST(1.0);
     compare1 = movemask(select1);
     if (compare1) {
-      a1 = dih*(COSMO_CONST(7.0)/COSMO_CONST(5.0) 
-	       - COSMO_CONST(2.0)/COSMO_CONST(3.0)*u*u 
-	       + COSMO_CONST(3.0)/COSMO_CONST(10.0)*u*u*u*u
-	       - COSMO_CONST(1.0)/COSMO_CONST(10.0)*u*u*u*u*u);
-      b1 = dih*dih*dih*(COSMO_CONST(4.0)/COSMO_CONST(3.0) 
-		       - COSMO_CONST(6.0)/COSMO_CONST(5.0)*u*u 
-		       + COSMO_CONST(1.0)/COSMO_CONST(2.0)*u*u*u);
-      c1 = dih*dih*dih*dih*dih*(COSMO_CONST(12.0)/COSMO_CONST(5.0) 
-			       - COSMO_CONST(3.0)/COSMO_CONST(2.0)*u);
-      d1 = COSMO_CONST(3.0)/COSMO_CONST(2.0)*dih*dih*dih*dih*dih*dih*dir;
+      SSEcosmoType u2 = u*u;
+      SSEcosmoType dih3 = dih*dih*dih;
+      a1 = dih*fmadd(fmadd(fnmadd(COSMO_CONST(1.0)/COSMO_CONST(10.0), u,
+				  COSMO_CONST(3.0)/COSMO_CONST(10.0)),
+			   u2, -COSMO_CONST(2.0)/COSMO_CONST(3.0)),
+		     u2, COSMO_CONST(7.0)/COSMO_CONST(5.0));
+      b1 = dih3*fmadd(fmadd(COSMO_CONST(1.0)/COSMO_CONST(2.0), u,
+			    -COSMO_CONST(6.0)/COSMO_CONST(5.0)),
+		      u2, COSMO_CONST(4.0)/COSMO_CONST(3.0));
+      c1 = dih3*dih*dih*fnmadd(COSMO_CONST(3.0)/COSMO_CONST(2.0), u,
+			       COSMO_CONST(12.0)/COSMO_CONST(5.0));
+      d1 = COSMO_CONST(3.0)/COSMO_CONST(2.0)*dih3*dih3*dir;
     }  
     if ((~compare1) & cosmoMask) {
-      a2 = COSMO_CONST(-1.0)/COSMO_CONST(15.0)*dir 
-	+ dih*(COSMO_CONST(8.0)/COSMO_CONST(5.0) 
-	       - COSMO_CONST(4.0)/COSMO_CONST(3.0)*u*u + u*u*u
-	       - COSMO_CONST(3.0)/COSMO_CONST(10.0)*u*u*u*u 
-	       + COSMO_CONST(1.0)/COSMO_CONST(30.0)*u*u*u*u*u);
-      b2 = COSMO_CONST(-1.0)/COSMO_CONST(15.0)*dir*dir*dir 
-	+ dih*dih*dih*(COSMO_CONST(8.0)/COSMO_CONST(3.0) - COSMO_CONST(3.0)*u 
-		       + COSMO_CONST(6.0)/COSMO_CONST(5.0)*u*u 
-		       - COSMO_CONST(1.0)/COSMO_CONST(6.0)*u*u*u);
-      c2 = COSMO_CONST(-1.0)/COSMO_CONST(5.0)*dir*dir*dir*dir*dir 
-	+ COSMO_CONST(3.0)*dih*dih*dih*dih*dir
-	+ dih*dih*dih*dih*dih*(COSMO_CONST(-12.0)/COSMO_CONST(5.0) 
-			       + COSMO_CONST(1.0)/COSMO_CONST(2.0)*u);
-      d2 = -dir*dir*dir*dir*dir*dir*dir
-	+ COSMO_CONST(3.0)*dih*dih*dih*dih*dir*dir*dir
-	- COSMO_CONST(1.0)/COSMO_CONST(2.0)*dih*dih*dih*dih*dih*dih*dir;
+      SSEcosmoType dih3 = dih*dih*dih;
+      SSEcosmoType dih4 = dih3*dih;
+      SSEcosmoType dir3 = dir*dir*dir;
+      a2 = fmadd(dih,
+		 fmadd(fmadd(fmadd(fmadd(COSMO_CONST(1.0)/COSMO_CONST(30.0), u,
+					 -COSMO_CONST(3.0)/COSMO_CONST(10.0)),
+				   u, COSMO_CONST(1.0)),
+			     u, -COSMO_CONST(4.0)/COSMO_CONST(3.0)),
+		       u*u, COSMO_CONST(8.0)/COSMO_CONST(5.0)),
+		 COSMO_CONST(-1.0)/COSMO_CONST(15.0)*dir);
+      b2 = fmadd(dih3,
+		 fmadd(fmadd(fnmadd(COSMO_CONST(1.0)/COSMO_CONST(6.0), u,
+				    COSMO_CONST(6.0)/COSMO_CONST(5.0)),
+			     u, -COSMO_CONST(3.0)),
+		       u, COSMO_CONST(8.0)/COSMO_CONST(3.0)),
+		 COSMO_CONST(-1.0)/COSMO_CONST(15.0)*dir3);
+      c2 = fmadd(dih4*dih, fmadd(COSMO_CONST(1.0)/COSMO_CONST(2.0), u,
+				 COSMO_CONST(-12.0)/COSMO_CONST(5.0)),
+		 fmadd(COSMO_CONST(3.0)*dih4, dir,
+		       COSMO_CONST(-1.0)/COSMO_CONST(5.0)*dir3*dir*dir));
+      d2 = fnmadd(COSMO_CONST(1.0)/COSMO_CONST(2.0)*dih3*dih3, dir,
+		  dir3*fnmadd(dir3, dir, COSMO_CONST(3.0)*dih4));
     }
 
     a = andnot(select0, a0) 
@@ -143,7 +189,7 @@ void SPLINEQ(SSEcosmoType invr, SSEcosmoType r2, SSEcosmoType twoh,
 }
 #endif
 
-#if !CMK_SSE
+// The scalar SPLINE is also needed by the FMM particle sums in SSE builds.
 inline
 void SPLINE(cosmoType r2, cosmoType twoh, cosmoType &a, cosmoType &b)
 {
@@ -179,8 +225,15 @@ void SPLINE(cosmoType r2, cosmoType twoh, cosmoType &a, cosmoType &b)
     a = COSMO_CONST(1.0)/r;
     b = a*a*a;
   }
+  if(dPMSplit > 0.0) {
+    cosmoType f[PM_NFACTORS];
+    pmShortFactors(r2, f);
+    a *= f[0];
+    b *= f[1];
+  }
 }
-#else 
+
+#if CMK_SSE
 inline
 void SPLINE(SSEcosmoType r2, SSEcosmoType twoh, 
 	    SSEcosmoType &a, SSEcosmoType &b)
@@ -212,25 +265,30 @@ void SPLINE(SSEcosmoType r2, SSEcosmoType twoh,
     select1 = u < COSMO_CONST(1.0);
     compare1 = movemask(select1);
     if (compare1) {
-      a1 = dih*(COSMO_CONST(7.0)/COSMO_CONST(5.0) 
-		- COSMO_CONST(2.0)/COSMO_CONST(3.0)*u*u 
-		+ COSMO_CONST(3.0)/COSMO_CONST(10.0)*u*u*u*u
-		- COSMO_CONST(1.0)/COSMO_CONST(10.0)*u*u*u*u*u);
-      b1 = dih*dih*dih*(COSMO_CONST(4.0)/COSMO_CONST(3.0) 
-			- COSMO_CONST(6.0)/COSMO_CONST(5.0)*u*u 
-			+ COSMO_CONST(1.0)/COSMO_CONST(2.0)*u*u*u);     
+      SSEcosmoType u2 = u*u;
+      a1 = dih*fmadd(fmadd(fnmadd(COSMO_CONST(1.0)/COSMO_CONST(10.0), u,
+				  COSMO_CONST(3.0)/COSMO_CONST(10.0)),
+			   u2, -COSMO_CONST(2.0)/COSMO_CONST(3.0)),
+		     u2, COSMO_CONST(7.0)/COSMO_CONST(5.0));
+      b1 = dih*dih*dih*fmadd(fmadd(COSMO_CONST(1.0)/COSMO_CONST(2.0), u,
+				   -COSMO_CONST(6.0)/COSMO_CONST(5.0)),
+			     u2, COSMO_CONST(4.0)/COSMO_CONST(3.0));
     }
     if ((~compare1) & cosmoMask) {
       dir = COSMO_CONST(1.0)/r;
-      a2 = COSMO_CONST(-1.0)/COSMO_CONST(15.0)*dir 
-	+ dih*(COSMO_CONST(8.0)/COSMO_CONST(5.0) 
-	       - COSMO_CONST(4.0)/COSMO_CONST(3.0)*u*u + u*u*u
-	       - COSMO_CONST(3.0)/COSMO_CONST(10.0)*u*u*u*u 
-	       + COSMO_CONST(1.0)/COSMO_CONST(30.0)*u*u*u*u*u);
-      b2 = COSMO_CONST(-1.0)/COSMO_CONST(15.0)*dir*dir*dir 
-	+ dih*dih*dih*(COSMO_CONST(8.0)/COSMO_CONST(3.0) - COSMO_CONST(3.0)*u 
-		       + COSMO_CONST(6.0)/COSMO_CONST(5.0)*u*u 
-		       - COSMO_CONST(1.0)/COSMO_CONST(6.0)*u*u*u);
+      a2 = fmadd(dih,
+		 fmadd(fmadd(fmadd(fmadd(COSMO_CONST(1.0)/COSMO_CONST(30.0), u,
+					 -COSMO_CONST(3.0)/COSMO_CONST(10.0)),
+				   u, COSMO_CONST(1.0)),
+			     u, -COSMO_CONST(4.0)/COSMO_CONST(3.0)),
+		       u*u, COSMO_CONST(8.0)/COSMO_CONST(5.0)),
+		 COSMO_CONST(-1.0)/COSMO_CONST(15.0)*dir);
+      b2 = fmadd(dih*dih*dih,
+		 fmadd(fmadd(fnmadd(COSMO_CONST(1.0)/COSMO_CONST(6.0), u,
+				    COSMO_CONST(6.0)/COSMO_CONST(5.0)),
+			     u, -COSMO_CONST(3.0)),
+		       u, COSMO_CONST(8.0)/COSMO_CONST(3.0)),
+		 COSMO_CONST(-1.0)/COSMO_CONST(15.0)*dir*dir*dir);
     }
 
     a = andnot(select0, a0) 
@@ -349,8 +407,12 @@ inline int partBucketForce(ExternalGravityParticle *part,
       SSEcosmoType SSELoad(packedPotential, activeParticles, i, ->potential); 
       SSEcosmoType idt2 = (packedMass + part->mass) * b;       
       idt2 = max(idt2, packedDtGrav); 
-      packedAcc += r * (b * part->mass);
-      packedPotential -= part->mass * a; 
+      SSEcosmoType partMass = part->mass;
+      SSEcosmoType bMass = b * partMass;
+      packedAcc.x = fmadd(r.x, bMass, packedAcc.x);
+      packedAcc.y = fmadd(r.y, bMass, packedAcc.y);
+      packedAcc.z = fmadd(r.z, bMass, packedAcc.z);
+      packedPotential = fnmadd(partMass, a, packedPotential); 
       SSEStore(packedAcc.x, activeParticles, i, ->treeAcceleration.x);
       SSEStore(packedAcc.y, activeParticles, i, ->treeAcceleration.y);
       SSEStore(packedAcc.z, activeParticles, i, ->treeAcceleration.z);
@@ -378,11 +440,10 @@ inline int partBucketForce(ExternalGravityParticle *part,
       activeParticles[nActiveParts++] = &particles[j];
   }
   
-  activeParticles[nActiveParts] = &dummyPart; 
-#if SSE_VECTOR_WIDTH == 4
-  activeParticles[nActiveParts+1] = &dummyPart; 
-  activeParticles[nActiveParts+2] = &dummyPart; 
-#endif
+  // Pad the tail of the last vector with a scratch particle whose
+  // results are discarded.
+  for (int k = 0; k < FORCE_INPUT_LIST_PAD; k++)
+    activeParticles[nActiveParts+k] = &dummyPart; 
 
   int ret = partBucketForce(part, req, activeParticles, offset, nActiveParts); 
   return ret; 
@@ -394,10 +455,13 @@ inline int partBucketForce(ExternalGravityParticle *part,
 //
 // Calculated forces on active particles in a bucket due to the
 // multipole of a TreeNode.  Return number of multipoles evaluated.
+// ORDER is the expansion order, 2, 3 or 4; see
+// nodeBucketForce() below.
 //
 #if  !CMK_SSE
+template <int ORDER>
 inline
-int nodeBucketForce(Tree::GenericTreeNode *node, 
+int nodeBucketForceOrder(Tree::GenericTreeNode *node, 
 		    Tree::GenericTreeNode *req,  
 		    GravityParticle *particles, 
 		    Vector3D<cosmoType> offset,    
@@ -412,7 +476,6 @@ int nodeBucketForce(Tree::GenericTreeNode *node,
 
   Vector3D<cosmoType> cm(m.cm + offset);
 
-#ifdef HEXADECAPOLE
   if(openSoftening(node, req, offset)) {
     ExternalGravityParticle tmpPart;
     tmpPart.mass = m.totalMass;
@@ -420,7 +483,6 @@ int nodeBucketForce(Tree::GenericTreeNode *node,
     tmpPart.position = m.cm;
     return partBucketForce(&tmpPart, req, particles, offset, activeRung);
   }
-#endif
   for(int j = req->firstParticle; j <= req->lastParticle; ++j) {
     if (particles[j].rung >= activeRung) {
       particles[j].interMass += m.totalMass;
@@ -437,36 +499,17 @@ int nodeBucketForce(Tree::GenericTreeNode *node,
       r = Vector3D<cosmoType>(particles[j].position) - cm;
       rsq = r.lengthSquared();
       cosmoType dir = COSMO_CONST(1.0)/sqrt(rsq);
-#ifdef HEXADECAPOLE
       cosmoType magai;
-      momEvalFmomrcm(&m.mom, m.getRadius(), dir, r.x, r.y, r.z,
+      cosmoType fShort[PM_NFACTORS];
+      if(dPMSplit > 0.0)
+        pmShortFactors(rsq, fShort);
+      momEvalFmomrcmOrder<ORDER>(&m.mom, m.getRadius(), dir, r.x, r.y, r.z,
 		  &particles[j].potential,
 		  &particles[j].treeAcceleration.x,
 		  &particles[j].treeAcceleration.y,
-		  &particles[j].treeAcceleration.z, &magai);
+		  &particles[j].treeAcceleration.z, &magai,
+		  (dPMSplit > 0.0 ? fShort : NULL));
       cosmoType idt2 = (particles[j].mass + m.totalMass)*dir*dir*dir;
-#else
-      twoh = CONVERT_TO_COSMO_TYPE(m.soft + particles[j].soft);
-      SPLINEQ(dir, rsq, twoh, a, b, c, d);
-      cosmoType qirx = CONVERT_TO_COSMO_TYPE m.xx*r.x 
-	+ CONVERT_TO_COSMO_TYPE m.xy*r.y + CONVERT_TO_COSMO_TYPE m.xz*r.z;
-      cosmoType qiry = CONVERT_TO_COSMO_TYPE m.xy*r.x 
-	+ CONVERT_TO_COSMO_TYPE m.yy*r.y + CONVERT_TO_COSMO_TYPE m.yz*r.z;
-      cosmoType qirz = CONVERT_TO_COSMO_TYPE m.xz*r.x 
-	+ CONVERT_TO_COSMO_TYPE m.yz*r.y + CONVERT_TO_COSMO_TYPE m.zz*r.z;
-      cosmoType qir = COSMO_CONST(0.5)*(qirx*r.x + qiry*r.y + qirz*r.z);
-      cosmoType tr = COSMO_CONST(0.5)*(CONVERT_TO_COSMO_TYPE m.xx 
-				       + CONVERT_TO_COSMO_TYPE m.yy 
-				       + CONVERT_TO_COSMO_TYPE m.zz);
-      cosmoType qir3 = b*CONVERT_TO_COSMO_TYPE m.totalMass + d*qir - c*tr;
-      particles[j].potential -= CONVERT_TO_COSMO_TYPE m.totalMass * a 
-	+ c*qir - b*tr;
-      particles[j].treeAcceleration.x -= qir3*r.x - c*qirx;
-      particles[j].treeAcceleration.y -= qir3*r.y - c*qiry;
-      particles[j].treeAcceleration.z -= qir3*r.z - c*qirz;
-      cosmoType idt2 = (CONVERT_TO_COSMO_TYPE particles[j].mass 
-			+ CONVERT_TO_COSMO_TYPE m.totalMass)*b;
-#endif
       if(idt2 > particles[j].dtGrav)
         particles[j].dtGrav = idt2;
     }
@@ -475,8 +518,9 @@ int nodeBucketForce(Tree::GenericTreeNode *node,
 }
 
 #elif  CMK_SSE
+template <int ORDER>
 inline
-int nodeBucketForce(Tree::GenericTreeNode *node, 
+int nodeBucketForceOrder(Tree::GenericTreeNode *node, 
 		    Tree::GenericTreeNode *req,  
 		    GravityParticle *particles, 
 		    Vector3D<cosmoType> offset,    
@@ -502,13 +546,11 @@ int nodeBucketForce(Tree::GenericTreeNode *node,
       activeParticles[nActiveParts++] = &particles[j];
   }
 
-  activeParticles[nActiveParts] = &dummyPart; 
-#if SSE_VECTOR_WIDTH == 4 
-  activeParticles[nActiveParts+1] = &dummyPart; 
-  activeParticles[nActiveParts+2] = &dummyPart; 
-#endif
+  // Pad the tail of the last vector with a scratch particle whose
+  // results are discarded.
+  for (int k = 0; k < FORCE_INPUT_LIST_PAD; k++)
+    activeParticles[nActiveParts+k] = &dummyPart; 
 
-#ifdef HEXADECAPOLE
   if(openSoftening(node, req, offset)) {
     ExternalGravityParticle tmpPart;
     tmpPart.mass = m.totalMass;
@@ -518,7 +560,6 @@ int nodeBucketForce(Tree::GenericTreeNode *node,
 			   offset, nActiveParts);
     return ret; 
     }
-#endif
   for (int i=0; i<nActiveParts; i+=SSE_VECTOR_WIDTH) {
 #ifdef CMK_VERSION_BLUEGENE
     if (++forProgress > 200) {
@@ -546,36 +587,14 @@ int nodeBucketForce(Tree::GenericTreeNode *node,
     SSEcosmoType SSELoad(packedPotential, activeParticles, i, ->potential); 
     SSEcosmoType SSELoad(packedMass, activeParticles, i, ->mass);  
     SSEcosmoType SSELoad(packedDtGrav, activeParticles, i, ->dtGrav);
-#ifdef HEXADECAPOLE
     SSEcosmoType magai;
-    momEvalFmomrcm(&m.mom, m.getRadius(), dir, r.x, r.y, r.z,
+    momEvalFmomrcmOrder<ORDER>(&m.mom, (SSEcosmoType) m.getRadius(), dir,
+		   r.x, r.y, r.z,
 		   &packedPotential,
 		   &packedAcc.x,
 		   &packedAcc.y,
 		   &packedAcc.z, &magai);
     SSEcosmoType idt2 = (packedMass + m.totalMass)*dir*dir*dir;
-#else
-    SSELoad(SSEcosmoType packedSoft, activeParticles, i, ->soft); 
-    twoh = CONVERT_TO_COSMO_TYPE m.soft + packedSoft;
-    SPLINEQ(dir, rsq, twoh, a, b, c, d);
-    SSEcosmoType qirx = CONVERT_TO_COSMO_TYPE m.xx*r.x 
-      + CONVERT_TO_COSMO_TYPE m.xy*r.y + CONVERT_TO_COSMO_TYPE m.xz*r.z;
-    SSEcosmoType qiry = CONVERT_TO_COSMO_TYPE m.xy*r.x 
-      + CONVERT_TO_COSMO_TYPE m.yy*r.y + CONVERT_TO_COSMO_TYPE m.yz*r.z;
-    SSEcosmoType qirz = CONVERT_TO_COSMO_TYPE m.xz*r.x 
-      + CONVERT_TO_COSMO_TYPE m.yz*r.y + CONVERT_TO_COSMO_TYPE m.zz*r.z;
-    SSEcosmoType qir = COSMO_CONST(0.5)*(qirx*r.x + qiry*r.y + qirz*r.z);
-    SSEcosmoType tr = COSMO_CONST(0.5)*(CONVERT_TO_COSMO_TYPE m.xx 
-					+ CONVERT_TO_COSMO_TYPE m.yy 
-					+ CONVERT_TO_COSMO_TYPE m.zz);
-    SSEcosmoType qir3 = b*CONVERT_TO_COSMO_TYPE m.totalMass + d*qir - c*tr;
-    packedPotential -= CONVERT_TO_COSMO_TYPE m.totalMass *a 
-      + c * qir - b * tr;      
-    packedAcc.x -= qir3*r.x - c*qirx;
-    packedAcc.y -= qir3*r.y - c*qiry;
-    packedAcc.z -= qir3*r.z - c*qirz;
-    SSEcosmoType idt2 = (packedMass + CONVERT_TO_COSMO_TYPE m.totalMass)*b;
-#endif
     SSEStore(packedAcc.x, activeParticles, i, ->treeAcceleration.x);
     SSEStore(packedAcc.y, activeParticles, i, ->treeAcceleration.y);
     SSEStore(packedAcc.z, activeParticles, i, ->treeAcceleration.z);
@@ -587,6 +606,244 @@ int nodeBucketForce(Tree::GenericTreeNode *node,
 }
 #endif
 
+//
+// Select the nodeBucketForceOrder() instantiation for the run time
+// expansion order (iMultipoleOrder, the iOrder parameter).
+//
+inline
+int nodeBucketForce(Tree::GenericTreeNode *node, 
+		    Tree::GenericTreeNode *req,  
+		    GravityParticle *particles, 
+		    Vector3D<cosmoType> offset,    
+		    int activeRung)
+{
+  switch(iMultipoleOrder) {
+  case 2:
+    return nodeBucketForceOrder<2>(node, req, particles, offset, activeRung);
+  case 3:
+    return nodeBucketForceOrder<3>(node, req, particles, offset, activeRung);
+  default:
+    return nodeBucketForceOrder<4>(node, req, particles, offset, activeRung);
+  }
+}
+
+/*
+** Mixed precision far field (bFarFieldFloat).  Cell-bucket
+** interactions that are outside the softening are evaluated in single
+** precision with separations taken relative to the bucket center of
+** mass, so they stay small enough to keep full float precision.  The
+** results are accumulated in double precision.
+*/
+
+/// @brief Active particles of a bucket in the form used by
+/// nodeBucketForceFloat().  The storage is supplied by the caller
+/// (see bytes() and init()) so that it can live on the stack.
+class FarFieldTargets {
+ public:
+  Vector3D<cosmoType> center;	///< bucket center of mass
+  int n;			///< number of active particles
+  float maxSoft;		///< largest softening of the active particles
+  int *index;			///< index of each particle in the bucket
+  float *x, *y, *z, *mass;	///< position relative to center, mass
+  cosmoType *ax, *ay, *az, *pot, *dtGrav; ///< accumulated results
+
+  static size_t bytes(int nMax) {
+    return nMax*(sizeof(int) + 4*sizeof(float) + 5*sizeof(cosmoType));
+  }
+  /// @brief Carve the arrays out of buf and gather the active
+  /// particles of bucket.
+  void init(void *buf, GravityParticle *particles,
+            Tree::GenericTreeNode *bucket, int activeRung) {
+    int nMax = bucket->lastParticle - bucket->firstParticle + 1;
+    ax = (cosmoType *) buf;
+    ay = ax + nMax;
+    az = ay + nMax;
+    pot = az + nMax;
+    dtGrav = pot + nMax;
+    x = (float *) (dtGrav + nMax);
+    y = x + nMax;
+    z = y + nMax;
+    mass = z + nMax;
+    index = (int *) (mass + nMax);
+
+    center = bucket->moments.cm;
+    n = 0;
+    maxSoft = 0.0f;
+    for(int j = bucket->firstParticle; j <= bucket->lastParticle; ++j) {
+      if(particles[j].rung >= activeRung) {
+        index[n] = j;
+        x[n] = particles[j].position.x - center.x;
+        y[n] = particles[j].position.y - center.y;
+        z[n] = particles[j].position.z - center.z;
+        mass[n] = particles[j].mass;
+        if(particles[j].soft > maxSoft)
+          maxSoft = particles[j].soft;
+        ax[n] = ay[n] = az[n] = pot[n] = dtGrav[n] = 0.0;
+        n++;
+      }
+    }
+  }
+  /// @brief Add the accumulated results to the particles.
+  void store(GravityParticle *particles) {
+    for(int i = 0; i < n; i++) {
+      GravityParticle &p = particles[index[i]];
+      p.treeAcceleration.x += ax[i];
+      p.treeAcceleration.y += ay[i];
+      p.treeAcceleration.z += az[i];
+      p.potential += pot[i];
+      if(dtGrav[i] > p.dtGrav)
+        p.dtGrav = dtGrav[i];
+    }
+  }
+};
+
+//
+// Mixed precision version of nodeBucketForce().  Interactions that
+// involve softening are passed to the double precision kernel.
+// Return number of multipoles evaluated.
+//
+template <int ORDER>
+inline
+int nodeBucketForceFloatOrder(Tree::GenericTreeNode *node,
+                         Tree::GenericTreeNode *req,
+                         GravityParticle *particles,
+                         Vector3D<cosmoType> offset,
+                         int activeRung,
+                         FarFieldTargets &t)
+{
+  MultipoleMoments &m = node->moments;
+  Vector3D<cosmoType> cm(m.cm + offset);
+
+  if(openSoftening(node, req, offset))
+    return nodeBucketForceOrder<ORDER>(node, req, particles, offset,
+                                       activeRung);
+  float radius = m.getRadius();
+  float cx = cm.x - t.center.x;
+  float cy = cm.y - t.center.y;
+  float cz = cm.z - t.center.z;
+  float mTotal = m.totalMass;
+
+  for(int i = 0; i < t.n; i++) {
+    float rx = t.x[i] - cx;
+    float ry = t.y[i] - cy;
+    float rz = t.z[i] - cz;
+    float rsq = rx*rx + ry*ry + rz*rz;
+    float dir = 1.0f/sqrtf(rsq);
+    float pot = 0.0f, ax = 0.0f, ay = 0.0f, az = 0.0f, magai;
+    momEvalFmomrcmOrder<ORDER>(&m.momf, radius, dir, rx, ry, rz, &pot, &ax,
+                               &ay, &az, &magai);
+    t.pot[i] += pot;
+    t.ax[i] += ax;
+    t.ay[i] += ay;
+    t.az[i] += az;
+    float idt2 = (t.mass[i] + mTotal)*dir*dir*dir;
+    if(idt2 > t.dtGrav[i])
+      t.dtGrav[i] = idt2;
+  }
+  return t.n;
+}
+
+inline
+int nodeBucketForceFloat(Tree::GenericTreeNode *node,
+                         Tree::GenericTreeNode *req,
+                         GravityParticle *particles,
+                         Vector3D<cosmoType> offset,
+                         int activeRung,
+                         FarFieldTargets &t)
+{
+  switch(iMultipoleOrder) {
+  case 2:
+    return nodeBucketForceFloatOrder<2>(node, req, particles, offset,
+                                        activeRung, t);
+  case 3:
+    return nodeBucketForceFloatOrder<3>(node, req, particles, offset,
+                                        activeRung, t);
+  default:
+    return nodeBucketForceFloatOrder<4>(node, req, particles, offset,
+                                        activeRung, t);
+  }
+}
+
+/// @brief Size of the leading term left out of the expansion of a cell
+/// of mass m and radius b at a distance d, given b^2 and d^2.
+inline cosmoType expansionError(cosmoType m, cosmoType b2, cosmoType d2)
+{
+  cosmoType q = b2/d2;
+  cosmoType sq = sqrt(q);
+  cosmoType err = m/d2*q*sq;
+  if(iMultipoleOrder >= 3)
+    err *= sq;
+  if(iMultipoleOrder >= 4)
+    err *= sq;
+  return err;
+}
+
+/// @brief Relative (acceleration based) opening criterion, as in
+/// GADGET-2.  A node is accepted if the leading error term of its
+/// expansion is below dAccErrTol times the smallest acceleration the
+/// target had in the previous step (myNode->accOldMin, which must be
+/// non-zero).  A node whose bounding sphere reaches the target is
+/// always opened.
+/// @return -1, 0 or +1 with the same meaning as openCriterionNode().
+inline int openRelative(Tree::GenericTreeNode *node,
+                        Tree::GenericTreeNode *myNode,
+                        Vector3D<cosmoType> offset)
+{
+  MultipoleMoments &m = node->moments;
+  Vector3D<cosmoType> cm(m.cm + offset);
+  cosmoType b = m.getRadius();
+
+  Sphere<cosmoType> s(cm, TreeStuff::opening_geometry_factor*b);
+  if(Space::intersect(myNode->boundingBox, s)) {
+    if(Space::contained(myNode->boundingBox, s))
+      return 1;
+    return -1;
+  }
+
+  // Nearest and farthest distance from the node to the target box
+  cosmoType d2Min = 0.0, d2Max = 0.0;
+  for(int k = 0; k < 3; k++) {
+    cosmoType lo = myNode->boundingBox.lesser_corner[k] - cm[k];
+    cosmoType hi = cm[k] - myNode->boundingBox.greater_corner[k];
+    if(lo > 0.0)
+      d2Min += lo*lo;
+    else if(hi > 0.0)
+      d2Min += hi*hi;
+    cosmoType dMax = (fabs(lo) > fabs(hi) ? fabs(lo) : fabs(hi));
+    d2Max += dMax*dMax;
+  }
+  cosmoType b2 = b*b;
+  cosmoType tol = dAccErrTol*myNode->accOldMin;
+  if(expansionError(m.totalMass, b2, d2Max) > tol)
+    return 1;
+  if(expansionError(m.totalMass, b2, d2Min) > tol)
+    return -1;
+  return 0;
+}
+
+/// @brief Is the node entirely beyond the TreePM short range cutoff
+/// (dPMCut) from the target node?  Such nodes can be dropped from the
+/// walk.
+inline bool pmOutOfRange(Tree::GenericTreeNode *node,
+                         Tree::GenericTreeNode *myNode,
+                         Vector3D<cosmoType> offset)
+{
+  if(dPMCut <= 0.0)
+    return false;
+  Vector3D<cosmoType> cm(node->moments.cm + offset);
+  cosmoType d2 = 0.0;
+  for(int k = 0; k < 3; k++) {
+    cosmoType lo = myNode->boundingBox.lesser_corner[k] - cm[k];
+    cosmoType hi = cm[k] - myNode->boundingBox.greater_corner[k];
+    if(lo > 0.0)
+      d2 += lo*lo;
+    else if(hi > 0.0)
+      d2 += hi*hi;
+  }
+  cosmoType dMin = dPMCut + node->moments.getRadius();
+  return d2 > dMin*dMin;
+}
+
 /// @brief Gravity opening criterion for a bucket walk.
 /// @param node Source node to be tested
 /// @param bucketNode Target bucket
@@ -609,6 +866,17 @@ openCriterionBucket(Tree::GenericTreeNode *node,
       return true;
       }
 
+  if(dAccErrTol > 0.0 && bucketNode->accOldMin > 0.0) {
+      if(openRelative(node, bucketNode, offset) != 0)
+          return true;
+      if(openSoftening(node, bucketNode, offset)) {
+          cosmoType radius = TreeStuff::opening_geometry_factor*node->moments.getRadius()/thetaMono;
+          Sphere<cosmoType> sM(node->moments.cm + offset, radius);
+          return Space::intersect(bucketNode->boundingBox, sM);
+          }
+      return false;
+      }
+
   // Note that some of this could be pre-calculated into an "opening radius"
   cosmoType radius = TreeStuff::opening_geometry_factor * node->moments.getRadius() / theta;
   if(radius < node->moments.getRadius())
@@ -616,7 +884,6 @@ openCriterionBucket(Tree::GenericTreeNode *node,
 
   Sphere<cosmoType> s(node->moments.cm + offset, radius);
   
-#ifdef HEXADECAPOLE
   if(!Space::intersect(bucketNode->boundingBox, s)) {
       // Well separated, now check softening
       if(!openSoftening(node, bucketNode, offset)) {
@@ -629,9 +896,6 @@ openCriterionBucket(Tree::GenericTreeNode *node,
       }
       }
   return true;
-#else
-  return Space::intersect(bucketNode->boundingBox, s);
-#endif
 }
 
 /// @brief Gravity opening criterion for "double walk".
@@ -663,6 +927,22 @@ inline int openCriterionNode(Tree::GenericTreeNode *node,
       return 1;
       }
 
+  if(dAccErrTol > 0.0 && myNode->accOldMin > 0.0) {
+      int open = openRelative(node, myNode, offset);
+      if(open != 0) {
+          if(myNode->getType()==Tree::Bucket || myNode->getType()==Tree::CachedBucket || myNode->getType()==Tree::NonLocalBucket)
+              return 1;
+          return open;
+          }
+      if(openSoftening(node, myNode, offset)) {
+          cosmoType radius = TreeStuff::opening_geometry_factor*node->moments.getRadius()/thetaMono;
+          Sphere<cosmoType> sM(node->moments.cm + offset, radius);
+          if(Space::intersect(myNode->boundingBox, sM))
+              return 1;
+          }
+      return 0;
+      }
+
   // Note that some of this could be pre-calculated into an "opening radius"
   cosmoType radius = TreeStuff::opening_geometry_factor * node->moments.getRadius() / theta;
   if(radius < node->moments.getRadius())
@@ -674,7 +954,6 @@ inline int openCriterionNode(Tree::GenericTreeNode *node,
     if(Space::intersect(myNode->boundingBox, s))
         return 1;
     else
-#ifdef HEXADECAPOLE
         {
         // Well separated, now check softening
         if(!openSoftening(node, myNode, offset)) {
@@ -689,9 +968,6 @@ inline int openCriterionNode(Tree::GenericTreeNode *node,
                 return 0;
             }
         }
-#else
-    return 0;
-#endif
     }
     else{
         if(Space::intersect(myNode->boundingBox, s)){
@@ -701,7 +977,6 @@ inline int openCriterionNode(Tree::GenericTreeNode *node,
                 return -1;
         }
         else
-#ifdef HEXADECAPOLE
             {
             // Well separated, now check softening
             if(!openSoftening(node, myNode, offset)) {
@@ -716,10 +991,479 @@ inline int openCriterionNode(Tree::GenericTreeNode *node,
                     return 0;
                 }
             }
+    }
+}
+
+/*
+** Dual tree walks of the local tree.  With bFmmGravity (cell-cell
+** gravity), well separated pairs of local cells add each other's
+** multipole to a local (Taylor) expansion about their center of mass,
+** and the expansions are pushed down the tree and evaluated at the
+** particles once the walk is done.  With bMutualGravity they apply
+** each other's multipole to the particles beneath them instead.  In
+** both, close pairs of buckets are summed directly, once per pair.
+*/
+
+/// @brief Opening criterion for a pair of local cells.
+/// @return 1 if the pair has to be split, 0 if the cells are well
+/// separated and no particle pair between them is softened.
+inline int openCriterionFmm(Tree::GenericTreeNode *node,
+                            Tree::GenericTreeNode *myNode,
+                            Vector3D<cosmoType> offset)
+{
+  // Always open node if this many particles or fewer.
+  const int nMinParticleNode = 6;
+  if(node->particleCount <= nMinParticleNode
+     || myNode->particleCount <= nMinParticleNode)
+      return 1;
+
+  MultipoleMoments &m = node->moments;
+  MultipoleMoments &myM = myNode->moments;
+  cosmoType rSum = m.getRadius() + myM.getRadius();
+  cosmoType radius = TreeStuff::opening_geometry_factor*rSum/theta;
+  if(radius < rSum)
+      radius = rSum;
+
+  cosmoType dist = (myM.cm - (m.cm + offset)).length();
+  if(dist <= radius)
+      return 1;
+  // Closest particles are further apart than the softening kernel?
+  if(dist <= rSum + COSMO_CONST(2.0)*(m.soft + myM.soft))
+      return 1;
+  return 0;
+}
+
+/// @brief Add the multipole of a source cell to the local expansion
+/// of a target cell.
+/// @param l Local expansion of the target, scaled by v.
+/// @param r Target expansion center minus source center of mass.
+/// @return (timescale)^-2 of the interaction.
+inline cosmoType cellCellForce(FLOCR *l, cosmoType v, MultipoleMoments &m,
+                               Vector3D<cosmoType> r)
+{
+  cosmoType tax, tay, taz;
+  cosmoType dir = COSMO_CONST(1.0)/r.length();
+  momFlocrAddFmomr5cm(l, v, &m.mom, m.getRadius(), dir, r.x, r.y, r.z,
+                      &tax, &tay, &taz);
+  return m.totalMass*dir*dir*dir;
+}
+
+/// @brief Direct sum between the particles of two local buckets.
+///
+/// Forces go to the active particles of myNode and, if bMutual, to
+/// the active particles of node as well.  A mutual bucket paired with
+/// itself visits each particle pair once.
+/// @return Number of particle pairs computed.
+inline int bucketBucketForce(Tree::GenericTreeNode *myNode,
+                             Tree::GenericTreeNode *node,
+                             Vector3D<cosmoType> offset, int activeRung,
+                             bool bMutual)
+{
+  GravityParticle *myParts = myNode->particlePointer;
+  GravityParticle *parts = node->particlePointer;
+  int nMyParts = myNode->lastParticle - myNode->firstParticle + 1;
+  int nParts = node->lastParticle - node->firstParticle + 1;
+  bool bSelf = bMutual && node == myNode;
+  int computed = 0;
+
+  for(int i = 0; i < nMyParts; i++) {
+    GravityParticle &p = myParts[i];
+    bool bActive = p.rung >= activeRung;
+    for(int j = (bSelf ? i + 1 : 0); j < nParts; j++) {
+      GravityParticle &q = parts[j];
+      bool bSrcActive = bMutual && q.rung >= activeRung;
+      if(!bActive && !bSrcActive)
+        continue;
+      Vector3D<cosmoType> r = offset + q.position - p.position;
+      cosmoType rsq = r.lengthSquared();
+      if(rsq == 0)
+        continue;
+      cosmoType a, b;
+      SPLINE(rsq, p.soft + q.soft, a, b);
+      cosmoType idt2 = (p.mass + q.mass)*b; // (timescale)^-2
+      computed++;
+      if(bActive) {
+        p.treeAcceleration += r * (b * q.mass);
+        p.potential -= q.mass * a;
+        p.interMass += q.mass;
+        if(idt2 > p.dtGrav)
+          p.dtGrav = idt2;
+      }
+      if(bSrcActive) {
+        q.treeAcceleration -= r * (b * p.mass);
+        q.potential -= p.mass * a;
+        q.interMass += p.mass;
+        if(idt2 > q.dtGrav)
+          q.dtGrav = idt2;
+      }
+    }
+  }
+  return computed;
+}
+
+/// @brief Evaluate a local expansion about req->moments.cm at the
+/// active particles of a bucket.
+/// @return Number of particles evaluated.
+inline int localBucketForce(FLOCR *l, cosmoType v, Tree::GenericTreeNode *req,
+                            int activeRung, cosmoType interMass,
+                            cosmoType idt2)
+{
+  GravityParticle *particles = req->particlePointer;
+  int nParts = req->lastParticle - req->firstParticle + 1;
+  int computed = 0;
+
+  for(int j = 0; j < nParts; j++) {
+    GravityParticle &p = particles[j];
+    if(p.rung < activeRung)
+      continue;
+    Vector3D<cosmoType> r = Vector3D<cosmoType>(p.position) - req->moments.cm;
+    cosmoType pot = 0.0, ax = 0.0, ay = 0.0, az = 0.0;
+    momEvalFlocr(l, v, r.x, r.y, r.z, &pot, &ax, &ay, &az);
+    p.potential += pot;
+    p.treeAcceleration.x += ax;
+    p.treeAcceleration.y += ay;
+    p.treeAcceleration.z += az;
+    p.interMass += interMass;
+    if(idt2 > p.dtGrav)
+      p.dtGrav = idt2;
+    computed++;
+  }
+  return computed;
+}
+
+/*
+** Streaming versions of the force kernels.  The interaction lists of
+** a walk state are packed once into structure of arrays buffers, and
+** the active particles of each bucket are packed likewise, so the
+** kernels below read contiguous memory instead of following
+** GenericTreeNode and particle pointers for every interaction.
+** Enabled with bSoAGravity.
+*/
+#if CMK_SSE
+typedef SSEcosmoType SoAcosmoType;
+#define SOA_VECTOR_WIDTH SSE_VECTOR_WIDTH
+#define SoALoad(arr, idx) SSELoadAligned(SSEcosmoType, &(arr)[idx])
+#define SoAStore(what, arr, idx) SSEStoreAligned(what, &(arr)[idx])
+
+inline SoAcosmoType SoAMax(SoAcosmoType a, SoAcosmoType b)
+{
+  return max(a, b);
+}
+
+/// Zero the forces of lanes where source and target coincide.
+inline void SoAMaskSelf(SoAcosmoType rsq, SoAcosmoType &a, SoAcosmoType &b)
+{
+  SSEcosmoType select = rsq > COSMO_CONST(0.0);
+  a = select & a;
+  b = select & b;
+}
 #else
-        return 0;
+typedef cosmoType SoAcosmoType;
+#define SOA_VECTOR_WIDTH 1
+#define SoALoad(arr, idx) (arr[idx])
+#define SoAStore(what, arr, idx) { arr[idx] = what; }
+
+inline SoAcosmoType SoAMax(SoAcosmoType a, SoAcosmoType b)
+{
+  return a > b ? a : b;
+}
+
+/// Zero the forces of lanes where source and target coincide.
+inline void SoAMaskSelf(SoAcosmoType rsq, SoAcosmoType &a, SoAcosmoType &b)
+{
+  if(rsq == COSMO_CONST(0.0)) {
+    a = COSMO_CONST(0.0);
+    b = COSMO_CONST(0.0);
+  }
+}
 #endif
+
+/// Alignment of the SoA buffers: enough for an aligned load of the
+/// widest vector type.
+#define SOA_ALIGN 64
+
+/// @brief Array aligned to SOA_ALIGN for the packed kernels.  The
+/// storage only grows, so the buffers of a walk state are allocated
+/// up to the largest list of the walk and then reused; the contents
+/// are not kept when it grows.
+template <typename T>
+class SoAArray {
+  T *buf;
+  int n;
+  int nMax;
+  SoAArray(const SoAArray &);
+  SoAArray &operator=(const SoAArray &);
+ public:
+  SoAArray() : buf(NULL), n(0), nMax(0) {}
+  ~SoAArray() { free(buf); }
+  int size() const { return n; }
+  void clear() { n = 0; }
+  void resize(int nNew) {
+    if(nNew > nMax) {
+      free(buf);
+      nMax = nNew + nNew/2 + SOA_VECTOR_WIDTH;
+      if(posix_memalign((void **) &buf, SOA_ALIGN, nMax*sizeof(T)) != 0)
+        CkAbort("SoAArray: out of memory");
     }
+    n = nNew;
+  }
+  T &operator[](int i) { return buf[i]; }
+  const T &operator[](int i) const { return buf[i]; }
+};
+
+/// @brief Source cells of an interaction list, with the periodic
+/// offset already applied to the center of mass.
+class GravityNodeSoA {
+ public:
+  SoAArray<cosmoType> x, y, z, mass, soft;
+  SoAArray<cosmoType> radius;
+  SoAArray<FMOMR> mom;
+
+  int length() const { return mass.size(); }
+  void resize(int n) {
+    x.resize(n); y.resize(n); z.resize(n); mass.resize(n); soft.resize(n);
+    radius.resize(n); mom.resize(n);
+  }
+  void clear() { resize(0); }
+  void set(int k, const MultipoleMoments &m,
+           const Vector3D<cosmoType> &offset) {
+    x[k] = m.cm.x + offset.x;
+    y[k] = m.cm.y + offset.y;
+    z[k] = m.cm.z + offset.z;
+    mass[k] = m.totalMass;
+    soft[k] = m.soft;
+    radius[k] = m.getRadius();
+    mom[k] = m.mom;
+  }
+};
+
+/// @brief Source particles of an interaction list, with the periodic
+/// offset already applied to the positions.
+class GravityPartSoA {
+ public:
+  SoAArray<cosmoType> x, y, z, mass, soft;
+
+  int length() const { return mass.size(); }
+  void resize(int n) {
+    x.resize(n); y.resize(n); z.resize(n); mass.resize(n); soft.resize(n);
+  }
+  void clear() { resize(0); }
+  void set(int k, const ExternalGravityParticle &p,
+           const Vector3D<cosmoType> &offset) {
+    x[k] = p.position.x + offset.x;
+    y[k] = p.position.y + offset.y;
+    z[k] = p.position.z + offset.z;
+    mass[k] = p.mass;
+    soft[k] = p.soft;
+  }
+};
+
+/// @brief The active particles of one bucket.  The arrays are padded
+/// to a multiple of SOA_VECTOR_WIDTH with massless copies of the
+/// first particle; padded results are never written back.  Cell
+/// masses are summed in interMass as in the scalar nodeBucketForce().
+class GravityTargetSoA {
+ public:
+  std::vector<GravityParticle *> part;
+  SoAArray<cosmoType> x, y, z, mass, soft;
+  SoAArray<cosmoType> ax, ay, az, pot, dtGrav;
+  cosmoType interMass;
+  int nActive;
+  int nPadded;
+
+  /// @brief Gather the active particles of a bucket.
+  void load(GravityParticle *particles, Tree::GenericTreeNode *bucket,
+            int activeRung) {
+    part.clear();
+    interMass = COSMO_CONST(0.0);
+    for(int j = bucket->firstParticle; j <= bucket->lastParticle; ++j) {
+      if(particles[j].rung >= activeRung)
+        part.push_back(&particles[j]);
+    }
+    nActive = part.size();
+    nPadded = ((nActive + SOA_VECTOR_WIDTH - 1)/SOA_VECTOR_WIDTH)
+      *SOA_VECTOR_WIDTH;
+    x.resize(nPadded); y.resize(nPadded); z.resize(nPadded);
+    mass.resize(nPadded); soft.resize(nPadded);
+    ax.resize(nPadded); ay.resize(nPadded); az.resize(nPadded);
+    pot.resize(nPadded); dtGrav.resize(nPadded);
+    for(int i = 0; i < nPadded; i++) {
+      GravityParticle *p = part[i < nActive ? i : 0];
+      x[i] = p->position.x;
+      y[i] = p->position.y;
+      z[i] = p->position.z;
+      mass[i] = (i < nActive ? p->mass : COSMO_CONST(0.0));
+      soft[i] = p->soft;
+      ax[i] = p->treeAcceleration.x;
+      ay[i] = p->treeAcceleration.y;
+      az[i] = p->treeAcceleration.z;
+      pot[i] = p->potential;
+      dtGrav[i] = p->dtGrav;
+    }
+  }
+  /// @brief Scatter the accumulated forces back to the particles.
+  void store() {
+    for(int i = 0; i < nActive; i++) {
+      GravityParticle *p = part[i];
+      p->treeAcceleration.x = ax[i];
+      p->treeAcceleration.y = ay[i];
+      p->treeAcceleration.z = az[i];
+      p->potential = pot[i];
+      p->dtGrav = dtGrav[i];
+#if !CMK_SSE
+      p->interMass += interMass;
+#endif
+    }
+  }
+};
+
+//
+// Forces on the packed particles of a bucket from one (softened)
+// point mass.  Return number of particles evaluated.
+//
+inline int partBucketForceSoA(cosmoType sx, cosmoType sy, cosmoType sz,
+                              cosmoType sMass, cosmoType sSoft,
+                              GravityTargetSoA &t)
+{
+  if(t.nPadded == 0)
+    return 0;
+  cosmoType *px = &t.x[0], *py = &t.y[0], *pz = &t.z[0];
+  cosmoType *pmass = &t.mass[0], *psoft = &t.soft[0];
+  cosmoType *pax = &t.ax[0], *pay = &t.ay[0], *paz = &t.az[0];
+  cosmoType *ppot = &t.pot[0], *pdt = &t.dtGrav[0];
+
+  for(int i = 0; i < t.nPadded; i += SOA_VECTOR_WIDTH) {
+    SoAcosmoType rx = sx - SoALoad(px, i);
+    SoAcosmoType ry = sy - SoALoad(py, i);
+    SoAcosmoType rz = sz - SoALoad(pz, i);
+    SoAcosmoType rsq = rx*rx + ry*ry + rz*rz;
+    SoAcosmoType twoh = sSoft + SoALoad(psoft, i);
+    SoAcosmoType a, b;
+    SPLINE(rsq, twoh, a, b);
+    SoAMaskSelf(rsq, a, b);
+    SoAcosmoType bm = b*sMass;
+    SoAcosmoType ax = SoALoad(pax, i) + rx*bm;
+    SoAcosmoType ay = SoALoad(pay, i) + ry*bm;
+    SoAcosmoType az = SoALoad(paz, i) + rz*bm;
+    SoAcosmoType pot = SoALoad(ppot, i) - sMass*a;
+    SoAcosmoType idt2 = SoAMax((SoALoad(pmass, i) + sMass)*b,
+                               SoALoad(pdt, i));
+    SoAStore(ax, pax, i);
+    SoAStore(ay, pay, i);
+    SoAStore(az, paz, i);
+    SoAStore(pot, ppot, i);
+    SoAStore(idt2, pdt, i);
+  }
+  return t.nActive;
+}
+
+//
+// Forces on the packed particles of a bucket from every particle in
+// a packed list.  Return number of interactions evaluated.
+//
+inline int partBucketForceSoA(const GravityPartSoA &src, GravityTargetSoA &t)
+{
+  int computed = 0;
+  for(int k = 0; k < src.length(); k++)
+    computed += partBucketForceSoA(src.x[k], src.y[k], src.z[k],
+                                   src.mass[k], src.soft[k], t);
+  return computed;
 }
 
+//
+// Softening test of openSoftening() for a packed cell.
+//
+inline int openSoftening(cosmoType x, cosmoType y, cosmoType z,
+                         cosmoType soft, Tree::GenericTreeNode *myNode)
+{
+  Sphere<cosmoType> s(Vector3D<cosmoType>(x, y, z), 2.0*soft);
+  Sphere<cosmoType> myS(myNode->moments.cm, 2.0*myNode->moments.soft);
+  if(Space::intersect(myS, s))
+      return true;
+  return Space::intersect(myNode->boundingBox, s);
+}
+
+//
+// Forces on the packed particles of a bucket from every cell in a
+// packed list.  Return number of multipoles evaluated.
+//
+template <int ORDER>
+inline int nodeBucketForceSoAOrder(GravityNodeSoA &src,
+                                   Tree::GenericTreeNode *req,
+                                   GravityTargetSoA &t)
+{
+  if(t.nPadded == 0)
+    return 0;
+  cosmoType *px = &t.x[0], *py = &t.y[0], *pz = &t.z[0];
+  cosmoType *pmass = &t.mass[0];
+  cosmoType *pax = &t.ax[0], *pay = &t.ay[0], *paz = &t.az[0];
+  cosmoType *ppot = &t.pot[0], *pdt = &t.dtGrav[0];
+  int computed = 0;
+
+  for(int k = 0; k < src.length(); k++) {
+    cosmoType cx = src.x[k], cy = src.y[k], cz = src.z[k];
+    cosmoType mTotal = src.mass[k];
+    if(openSoftening(cx, cy, cz, src.soft[k], req)) {
+      computed += partBucketForceSoA(cx, cy, cz, mTotal, src.soft[k], t);
+      continue;
+    }
+    t.interMass += mTotal;
+    FMOMR *mom = &src.mom[k];
+    cosmoType radius = src.radius[k];
+    for(int i = 0; i < t.nPadded; i += SOA_VECTOR_WIDTH) {
+      SoAcosmoType rx = SoALoad(px, i) - cx;
+      SoAcosmoType ry = SoALoad(py, i) - cy;
+      SoAcosmoType rz = SoALoad(pz, i) - cz;
+      SoAcosmoType rsq = rx*rx + ry*ry + rz*rz;
+      SoAcosmoType dir = COSMO_CONST(1.0)/sqrt(rsq);
+      SoAcosmoType ax = SoALoad(pax, i);
+      SoAcosmoType ay = SoALoad(pay, i);
+      SoAcosmoType az = SoALoad(paz, i);
+      SoAcosmoType pot = SoALoad(ppot, i);
+      SoAcosmoType magai;
+      momEvalFmomrcmOrder<ORDER>(mom, (SoAcosmoType) radius, dir, rx, ry, rz,
+                                 &pot, &ax, &ay, &az, &magai);
+      SoAcosmoType idt2 = (SoALoad(pmass, i) + mTotal)*dir*dir*dir;
+      idt2 = SoAMax(idt2, SoALoad(pdt, i));
+      SoAStore(ax, pax, i);
+      SoAStore(ay, pay, i);
+      SoAStore(az, paz, i);
+      SoAStore(pot, ppot, i);
+      SoAStore(idt2, pdt, i);
+    }
+    computed += t.nActive;
+  }
+  return computed;
+}
+
+inline int nodeBucketForceSoA(GravityNodeSoA &src, Tree::GenericTreeNode *req,
+                              GravityTargetSoA &t)
+{
+  switch(iMultipoleOrder) {
+  case 2:
+    return nodeBucketForceSoAOrder<2>(src, req, t);
+  case 3:
+    return nodeBucketForceSoAOrder<3>(src, req, t);
+  default:
+    return nodeBucketForceSoAOrder<4>(src, req, t);
+  }
+}
+
+/// @brief Packed copy of all the interaction lists of a walk state
+/// that apply to a range of buckets, plus scratch space for the
+/// bucket being computed.
+class InteractionListSoA {
+ public:
+  GravityNodeSoA nodes;
+  GravityPartSoA localParts;
+  GravityPartSoA remoteParts;
+  GravityTargetSoA targets;
+
+  void clear() {
+    nodes.clear();
+    localParts.clear();
+    remoteParts.clear();
+  }
+};
+
 #endif
@@ -125,6 +125,13 @@ double momFlocrAddFmomr5cm(FLOCR *l, cosmoType v, FMOMR *m, cosmoType u,
                            cosmoType *tax, cosmoType *tay, cosmoType *taz);
 void momEvalLocr(LOCR *,momFloat,momFloat,momFloat,
 		 momFloat *,momFloat *,momFloat *,momFloat *);
+void momAddFlocr(FLOCR *lr,FLOCR *la);
+void momRescaleFlocr(FLOCR *lr, cosmoType vnew, cosmoType vold);
+double momShiftFlocr(FLOCR *l, cosmoType v, cosmoType x, cosmoType y,
+                     cosmoType z);
+void momEvalFlocr(FLOCR *l, cosmoType v, cosmoType x, cosmoType y, cosmoType z,
+                  cosmoType *fPot, cosmoType *ax, cosmoType *ay,
+                  cosmoType *az);
 double momLocrAddMomr(LOCR *,MOMR *,momFloat,momFloat,momFloat,momFloat);
 #if defined(__cplusplus)
 }
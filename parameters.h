@@ -41,12 +41,18 @@ typedef struct parameters {
     int bEwald;
     double dEwCut;
     double dEwhCut;
+    int nEwaldTable;
+    int nPMGrid;
+    double dPMAsmth;
+    double dPMRcut;
+    int iPMAssign;
     double dTheta;
     double dTheta2;
     double daSwitchTheta;
     int iOrder;
     int bConcurrentSph;
     double dFracNoDomainDecomp;
+    double dRefitTol;
 #ifdef PUSH_GRAVITY
     double dFracPushParticles;
 #endif
@@ -142,6 +148,20 @@ typedef struct parameters {
     int iDirector;
     int bLiveViz;
     int bUseCkLoopPar;
+    int bSoAGravity;
+    int bFarFieldFloat;
+    int bFmmGravity;
+    int bMutualGravity;
+    int bDepthFirstTree;
+    int bRadixSort;
+    int bCompactFill;
+    int bRetainNodes;
+    double dCacheBudget;
+    int bAdaptiveCacheDepth;
+    int bHistoryPrefetch;
+    int nBucketGroup;
+    double dAccErrTol;
+    int iInterListDump;
     int iVerbosity;
     } Parameters;
 
@@ -171,12 +191,18 @@ inline void operator|(PUP::er &p, Parameters &param) {
     p|param.bEwald;
     p|param.dEwCut;
     p|param.dEwhCut;
+    p|param.nEwaldTable;
+    p|param.nPMGrid;
+    p|param.dPMAsmth;
+    p|param.dPMRcut;
+    p|param.iPMAssign;
     p|param.dTheta;
     p|param.dTheta2;
     p|param.daSwitchTheta;
     p|param.iOrder;
     p|param.bConcurrentSph;
     p|param.dFracNoDomainDecomp;
+    p|param.dRefitTol;
 #ifdef PUSH_GRAVITY
     p|param.dFracPushParticles;
 #endif
@@ -264,6 +290,20 @@ inline void operator|(PUP::er &p, Parameters &param) {
     p|param.iDirector;
     p|param.bLiveViz;
     p|param.bUseCkLoopPar;
+    p|param.bSoAGravity;
+    p|param.bFarFieldFloat;
+    p|param.bFmmGravity;
+    p|param.bMutualGravity;
+    p|param.bDepthFirstTree;
+    p|param.bRadixSort;
+    p|param.bCompactFill;
+    p|param.bRetainNodes;
+    p|param.dCacheBudget;
+    p|param.bAdaptiveCacheDepth;
+    p|param.bHistoryPrefetch;
+    p|param.nBucketGroup;
+    p|param.dAccErrTol;
+    p|param.iInterListDump;
     p|param.iVerbosity;
     }
 
@@ -151,9 +151,11 @@ void SmoothCompute::nodeMissedEvent(int reqID, int chunk, State *state, TreePiec
 
 // called after constructor, so tp should be set
 State *KNearestSmoothCompute::getNewState(int nBuckets){
-  NearNeighborState *state = new NearNeighborState(tp->myNumParticles+2, nSmooth);
+  CkAssert(arena != NULL);
+  NearNeighborState *state = new (stateStorage(sizeof(NearNeighborState)))
+      NearNeighborState(tp->myNumParticles+2, nSmooth, arena);
   // array to keep track of outstanding requests
-  state->counterArrays[0] = new int [nBuckets];
+  state->counterArrays[0] = newCounters(nBuckets);
   state->counterArrays[1] = 0;
 
   for(int j = 0; j < nBuckets; ++j){
@@ -361,6 +363,7 @@ void TreePiece::startSmooth(// type of smoothing and parameters
   twSmooth = new BottomUpTreeWalk;
   sSmooth = new KNearestSmoothCompute(this, params, nSmooth, iLowhFix,
 				      dfBall2OverSoft2);
+  sSmooth->setArena(&smoothArena);
       
   initBucketsSmooth(sSmooth);
 
@@ -700,6 +703,7 @@ void TreePiece::finishSmoothWalk()
 
   if(myNumParticles != 0) {
       sSmooth->freeState(sSmoothState);
+      smoothArena.reset();
       delete sSmooth;
       delete optSmooth;
       delete twSmooth;
@@ -759,9 +763,11 @@ void KNearestSmoothCompute::walkDone(State *state) {
 ///
 /// called after constructor, so tp should be set
 State *ReSmoothCompute::getNewState(int nBucket){
-  ReNearNeighborState *state = new ReNearNeighborState(tp->myNumParticles+2);
+  CkAssert(arena != NULL);
+  ReNearNeighborState *state = new (stateStorage(sizeof(ReNearNeighborState)))
+      ReNearNeighborState(tp->myNumParticles+2, arena);
   // array to keep track of outstanding requests
-  state->counterArrays[0] = new int [nBucket];
+  state->counterArrays[0] = newCounters(nBucket);
   state->counterArrays[1] = 0;
   for (int j = 0; j < nBucket; ++j) {
     state->counterArrays[0][j] = 1;	// so we know that the local
@@ -889,6 +895,7 @@ void TreePiece::startReSmooth(SmoothParams* params,
   // Create objects that are reused by all buckets
   twSmooth = new TopDownTreeWalk;
   sSmooth = new ReSmoothCompute(this, params);
+  sSmooth->setArena(&smoothArena);
 
   initBucketsSmooth(sSmooth);
 
@@ -1011,8 +1018,9 @@ void ReSmoothCompute::walkDone(State *state) {
 
 // called after constructor, so tp should be set
 State *MarkSmoothCompute::getNewState(int nBucket){
-  MarkNeighborState *state = new MarkNeighborState(tp->myNumParticles+2);
-  state->counterArrays[0] = new int [nBucket];
+  MarkNeighborState *state = new (stateStorage(sizeof(MarkNeighborState)))
+      MarkNeighborState(tp->myNumParticles+2);
+  state->counterArrays[0] = newCounters(nBucket);
   state->counterArrays[1] = 0;
   for (int j = 0; j < nBucket; ++j) {
     state->counterArrays[0][j] = 1;	// so we know that the local
@@ -1122,6 +1130,7 @@ void TreePiece::startMarkSmooth(SmoothParams* params,
   // Create objects that are reused by all buckets
   twSmooth = new TopDownTreeWalk;
   sSmooth = new MarkSmoothCompute(this, params);
+  sSmooth->setArena(&smoothArena);
 
   initBucketsSmooth(sSmooth);
 
@@ -22,23 +22,43 @@ class pqSmoothNode
     };
 
 	
-/// Object to bookkeep a Bucket Smooth Walk.
+/// Neighbor list of a particle in a smooth walk.
+typedef CkVec<pqSmoothNode> NeighborQueue;
+
+/// @brief An array of n empty NeighborQueues in arena.
+inline NeighborQueue *newNeighborQueues(Arena *arena, int n) {
+    NeighborQueue *Qs = arena->alloc<NeighborQueue>(n);
+    for(int i = 0; i < n; i++)
+	new (&Qs[i]) NeighborQueue;
+    return Qs;
+    }
 
+/// @brief Free the storage of the queues of newNeighborQueues().
+inline void deleteNeighborQueues(NeighborQueue *Qs, int n) {
+    for(int i = 0; i < n; i++)
+	Qs[i].~NeighborQueue();
+    }
+
+/// Object to bookkeep a Bucket Smooth Walk.
+///
+/// The state and its array of queues are allocated from the smooth
+/// walk arena of the TreePiece; the queues keep their own storage,
+/// which is given back as each particle is finished.
 class NearNeighborState: public State {
 public:
-    CkVec<pqSmoothNode> *Qs; 
+    NeighborQueue *Qs; 
     int nParticlesPending;
     int mynParts; 
     bool started;
     
-    NearNeighborState(int nParts, int nSmooth) {
-        Qs = new CkVec<pqSmoothNode>[nParts+2];
+    NearNeighborState(int nParts, int nSmooth, Arena *arena) {
+        Qs = newNeighborQueues(arena, nParts+2);
 	mynParts = nParts; 
         }
 
     void finishBucketSmooth(int iBucket, TreePiece *tp);
     ~NearNeighborState() {
-	delete [] Qs; 
+	deleteNeighborQueues(Qs, mynParts+2);
         }
 };
 
@@ -172,14 +192,16 @@ public:
 
 class ReNearNeighborState: public State {
 public:
-    CkVec<pqSmoothNode> *Qs;
+    NeighborQueue *Qs;
     int nParticlesPending;
+    int mynParts;
     bool started;
-    ReNearNeighborState(int nParts) {
-	Qs = new CkVec<pqSmoothNode>[nParts+2];
+    ReNearNeighborState(int nParts, Arena *arena) {
+	Qs = newNeighborQueues(arena, nParts+2);
+	mynParts = nParts;
 	}
     void finishBucketSmooth(int iBucket, TreePiece *tp);
-    ~ReNearNeighborState() { delete [] Qs; }
+    ~ReNearNeighborState() { deleteNeighborQueues(Qs, mynParts+2); }
 };
 
 /// @brief Class for computation over a set smoothing length
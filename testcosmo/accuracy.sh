@@ -0,0 +1,32 @@
+#!/bin/sh
+#
+# Compare the accelerations from the single precision far-field
+# option (-farfloat) against the all-double path on the cube300
+# initial conditions.  Each run takes zero steps, so only the initial
+# force calculation and the .acc2 output are done.
+#
+CHARMRUN=../charmrun
+CHANGA=../ChaNGa
+#
+echo "Running double precision reference"
+$CHARMRUN $CHANGA -n 0 -o cube300.dbl cube300.param > cube300.dbl.out
+echo "Running single precision far field"
+$CHARMRUN $CHANGA -n 0 -farfloat -o cube300.flt cube300.param > cube300.flt.out
+#
+# ASCII vector files hold the particle count followed by all x, then
+# all y, then all z components.
+#
+paste cube300.dbl.000000.acc2 cube300.flt.000000.acc2 | awk '
+NR == 1 { n = $1; next }
+{ i = (NR - 2) % n; ad[i] += $1*$1; dd[i] += ($1 - $2)*($1 - $2) }
+END {
+    for (i = 0; i < n; i++) {
+	err = sqrt(dd[i]/ad[i]);
+	sum += err*err;
+	if (err > max) max = err;
+    }
+    printf "particles: %d\n", n;
+    printf "rms relative acceleration error: %g\n", sqrt(sum/n);
+    printf "max relative acceleration error: %g\n", max;
+}'
+rm -f cube300.dbl.* cube300.flt.*